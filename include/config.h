@@ -4,7 +4,7 @@
 #include <cstdint>
 #include <string>
 namespace BwtFS{
-    const uint8_t VERSION = 0;         // 文件系统版本
+    const uint8_t VERSION = 5;         // 文件系统版本，1起超级块中记录块校验和区域，2起记录元数据日志区域，3起记录擦除队列区域，4起记录节点加密算法，5起ChaCha20的nonce保存在块末尾
     const size_t KB = 1024;            // 1KB
     const size_t MB = 1024 * KB;       // 1MB
     const size_t GB = 1024 * MB;       // 1GB
@@ -36,6 +36,19 @@ namespace BwtFS{
         const size_t SYSTEM_FILE_SIZE = 512 * MB;             // 系统文件大小
         const std::string SYSTEM_FILE_PREFIX = "";          // 系统文件前缀
         const size_t SYSTEM_FILE_MIN_SIZE = 64 * MB;        // 系统文件最小大小
+        const std::string SYSTEM_FILE_IO_MODE = "pread";    // 系统文件读写方式: pread, mmap, direct
+        const bool SYSTEM_FILE_MMAP_POPULATE = false;       // mmap模式下是否预读整个文件
+        const std::string SYSTEM_FILE_MMAP_ADVICE = "random"; // mmap模式下的访问提示: normal, random, sequential, willneed
+        const std::string SYSTEM_FILE_IO_ENGINE = "auto";   // 批量写入引擎: auto, io_uring, thread
+        const unsigned SYSTEM_FILE_IO_QUEUE_DEPTH = 32;     // 批量写入的队列深度
+        const unsigned SYSTEM_FILE_CREATE_THREADS = 0;      // 创建文件时填充随机数据的线程数，0表示使用CPU核数
+        const bool SYSTEM_FILE_SPARSE = false;              // 是否创建精简文件（数据区在块分配时才填充随机数据）
+        const size_t SYSTEM_FILE_SPARSE_FILL_RATE = 16;     // 精简文件后台填充的速度(MB/s)，0表示不在后台填充
+        const std::string SYSTEM_FILE_STRIPE_MEMBERS = "";  // 创建条带卷(.bwts)时的成员文件路径，以逗号分隔
+        const size_t SYSTEM_FILE_JOURNAL_BLOCKS = 256;      // 初始化时元数据日志区域的块数
+        const size_t SYSTEM_FILE_SCRUB_RATE = 64;           // 后台擦除已删除块的速度(MB/s)，0表示删除时直接释放、不擦除
+        const unsigned SYSTEM_FILE_CRYPTO_THREADS = 0;      // 节点加解密的线程数，0表示使用CPU核数
+        const std::string SYSTEM_FILE_CIPHER = "rca";       // 初始化时选择的节点加密算法: rca, chacha20
 
         const std::string FILESYSTEM_STRUCTURE_JSON = "./filesystem_structure.json"; // 文件系统结构JSON路径
 
@@ -0,0 +1,50 @@
+#ifndef ASYNC_IO_H
+#define ASYNC_IO_H
+#ifndef _WIN32
+#include <vector>
+#include <mutex>
+#include <memory>
+#include "file/system_file.h"
+#include "util/thread_pool.h"
+namespace BwtFS::System{
+    /*
+    * 异步块写入引擎
+    * 一次提交一批块写入，等待全部完成后返回，使设备队列深度大于1
+    *
+    * 优先使用io_uring（直接通过系统调用，不依赖liburing），
+    * 内核不支持或被禁用时退化为线程池并发pwrite
+    *
+    * 配置项([system]):
+    *   io_engine     : auto, io_uring, thread
+    *   io_queue_depth: 单次提交的最大块数
+    */
+    class AsyncBlockEngine{
+        public:
+            AsyncBlockEngine(int fd);
+            AsyncBlockEngine(const AsyncBlockEngine& other) = delete;
+            AsyncBlockEngine& operator=(const AsyncBlockEngine& other) = delete;
+            AsyncBlockEngine(AsyncBlockEngine&& other) = delete;
+            AsyncBlockEngine& operator=(AsyncBlockEngine&& other) = delete;
+            ~AsyncBlockEngine();
+            // 写入一批块，全部完成后返回，失败时抛出异常
+            void write(const std::vector<BlockWrite>& writes);
+            // 是否使用io_uring
+            bool usingIoUring() const;
+
+        private:
+            struct Ring;
+            // 通过io_uring提交一批写入（不超过队列深度）
+            void submit_ring(const BlockWrite* writes, size_t count);
+            // 通过线程池提交一批写入
+            void submit_threads(const BlockWrite* writes, size_t count);
+
+            int fd;
+            unsigned queue_depth;
+            std::unique_ptr<Ring> ring;
+            std::unique_ptr<ThreadPool> pool;
+            // io_uring的提交队列和完成队列不支持多线程同时使用
+            std::mutex submit_mutex;
+    };
+}
+#endif
+#endif
@@ -4,12 +4,32 @@
 #include <string>
 #include <vector>
 #include <utility>
+#include <mutex>
+#include <span>
+#include <array>
+#include <random>
+#include <atomic>
+#include <memory>
+#include "config.h"
 #include "node/binary.h"
 #include "file/system_file.h"
+#include "file/journal.h"
 namespace BwtFS::System{
+    // 位图之外的其它元数据区域（如校验和表），由位图保留
+    struct Region{
+        // 起始块
+        size_t start;
+        // 区域字节数
+        size_t bytes;
+    };
+
     /*
     * 位图类
     * 用于位图的读写操作
+    * 空闲块按区域划分为若干分片，每个分片有自己的锁、磨损直方图和随机数发生器，
+    * 不同线程优先在不同的分片中分配，分配时只锁所在分片
+    * 位图和磨损值只在提交锁下修改（set/clear/flush），修改时同时持有所涉及分片的锁
+    * 加锁顺序：提交锁在前，分片锁按编号从小到大；初始化和扩容时锁住全部分片
     * @author: zaoweiceng
     * @data: 2025-03-30
     */
@@ -24,12 +44,20 @@ namespace BwtFS::System{
             // 设置指定位置位图的值
             // 传入索引和值(第index个块)，设置位图的值
             void set(const size_t index);
+            // 批量设置，所有位和磨损值在内存中一次完成，磨损均衡最多执行一次
+            void setMany(std::span<const size_t> indices);
             // 清空指定位置位图的值
             void clear(const size_t index);
+            // 批量清空
+            void clearMany(std::span<const size_t> indices);
+            // 归还getFreeBlock分配后未写入的块，已写入的块不受影响
+            void release(std::span<const size_t> indices);
             // 获取指定位置位图的值
             // 传入索引(第index个块)，返回位图的值
             bool get(const size_t index) const;
             // 获取一个空闲块
+            // 在当前线程所用分片中磨损值最小的空闲块中随机选择，分片用完时依次尝试其它分片
+            // 返回前记为已分配，不会重复分配
             // 返回空闲块的索引
             // 0表示没有空闲块
             // 大于0表示有空闲块，其值为空闲块的索引
@@ -38,9 +66,26 @@ namespace BwtFS::System{
             // 传入索引(第index个块)，返回磨损值
             uint8_t getWearBlock(const size_t index) const;
             // 初始化位图
-            void init(unsigned last_index);
-            // 获取系统大小
+            // regions为需要一并保留的其它元数据区域
+            void init(unsigned last_index, const std::vector<Region>& regions = {});
+            // 获取系统已用大小，O(1)
             size_t getSystemUsedSize() const;
+            // 扩容
+            // 传入新的块数量和新的位图、磨损位图起始块，新位置必须位于新增的块中
+            // 释放原位图区域和原认证块，保留新位图区域和新认证块，并写入新位置
+            // released和reserved为随之迁移的其它元数据区域的原位置和新位置
+            void grow(size_t bitmap_count, size_t bitmap_start, size_t bitmap_wear_start,
+                      const std::vector<Region>& released = {}, const std::vector<Region>& reserved = {});
+            // 位图占用的块数
+            static size_t regionBlocks(size_t bytes);
+            // 将修改过的位图页和磨损位图页写回文件，相邻的页合并为一次写入
+            // set和clear只修改内存，在事务提交（FileSystem::sync）时调用
+            // 写回后清空尚未取出的日志项
+            void flush();
+            // 取出上次取出或写回以来的位图和磨损值变化，用于写日志
+            std::vector<JournalEntry> takeChanges();
+            // 重放日志项，完成后重新统计空闲块，只在打开文件系统时调用
+            void replay(const std::vector<JournalEntry>& entries);
 
 
         private:
@@ -60,23 +105,90 @@ namespace BwtFS::System{
             size_t bitmap_count;
             // 文件对象
             std::shared_ptr<BwtFS::System::File> file;
-            // BPM
-            std::vector<std::pair<size_t, std::pair<bool, uint8_t>>> bpm;
+            // 已分配但尚未写入位图的块（每块一位），写入或清空时去掉
+            std::vector<uint64_t> pending;
+            // 汇总层：每个区域REGION_WORDS个字（4096个块），与一页磨损位图对应
+            static constexpr size_t REGION_WORDS = 64;
+            static_assert(REGION_WORDS * 64 == BwtFS::BLOCK_SIZE, "a region must match one wear page");
+            // 各区域的可分配块数，分配时跳过没有可分配块的区域
+            std::vector<uint32_t> region_free;
+            // 各区域可分配块磨损值的下界，254表示没有可分配块；归还块时降低，分配时不更新，
+            // 分配时跳过下界大于所需磨损值的区域，区域内没有找到时改为实际的最小值
+            std::vector<uint8_t> region_min_wear;
+            // 尚未写入日志的变化，在提交锁下追加
+            std::vector<JournalEntry> changes;
+            // 已用块数，set/clear时增量维护
+            std::atomic<size_t> used_blocks = 0;
+            // 分配分片：连续的regions_per_shard个区域，最后一个分片包含剩余的区域
+            struct Shard{
+                // 保护分片内区域的pending、区域计数和直方图
+                std::mutex mutex;
+                // 磨损直方图：各磨损值的可分配块数（空闲且不在pending中）
+                std::array<size_t, 256> free_by_wear{};
+                // 随机选择分配位置
+                std::mt19937_64 rng;
+            };
+            // 分片数在构造时确定，扩容后只重新划分区域
+            std::vector<std::unique_ptr<Shard>> shards;
+            std::atomic<size_t> regions_per_shard = 1;
+            // 块所在的分片
+            size_t shard_of_(size_t index) const;
+            // 按编号顺序锁住indices所在的分片
+            std::vector<std::unique_lock<std::mutex>> lock_shards_(std::span<const size_t> indices) const;
+            // 锁住全部分片
+            std::vector<std::unique_lock<std::mutex>> lock_all_() const;
+            // 在第index个分片中分配一个块，分片没有可分配块时返回0
+            size_t allocate_(size_t index);
 
+            // 以下操作不加锁，由调用者持有锁
+            // 块变为可分配：更新所在分片的直方图和所在区域的计数、磨损下界
+            void free_(const size_t index);
             void set_(const size_t index);
+            void clear_(const size_t index);
+            bool get_(const size_t index) const;
+            // 保留系统块：置位，磨损值为wear
+            void reserve_(const size_t index, uint8_t wear);
+            // 保留位图区域
+            void reserve_region_(size_t start, size_t bytes);
 
-            // 初始化BPM
-            void init_bpm();
-            // bpm指针
-            size_t bpm_ptr;
+            // 位图按64位字划分的字数
+            size_t words_() const;
+            // 第word个字中可分配的块（空闲、不在pending中且在块数量范围内）
+            uint64_t free_word_(size_t word) const;
+            // 重新统计各磨损值、各区域的可分配块数和已用块数，仅在初始化和扩容后调用
+            void count_free_();
 
+            // 写入整个位图和磨损位图，并清除脏页标记
             void save();
             // 保存位图
             void save_bitmap();
             // 保存磨损位图
             void save_bitmap_wear();
-            // 均衡磨损
-            void wear_balance();
+            // 位图和磨损位图中修改过、尚未写回的页（每页一个块）
+            std::vector<bool> dirty_bitmap;
+            std::vector<bool> dirty_wear;
+            // 标记第byte个字节所在的页
+            static void mark_(std::vector<bool>& dirty, size_t byte);
+            // 收集region中连续的脏页，写入位置为start块起
+            static void collect_(std::vector<BlockWrite>& writes, size_t start,
+                                 const BwtFS::Node::Binary& region, std::vector<bool>& dirty);
+            // 磨损均衡
+            // 磨损值以每页（一个块）为单位延迟下移：全局偏移wear_epoch记录累计下移量，
+            // page_epoch记录各页已应用的偏移，两者之差即该页尚未应用的下移量
+            unsigned long long wear_epoch = 0;
+            std::vector<unsigned long long> page_epoch;
+            // 读取块的当前磨损值（已扣除未应用的下移量）
+            uint8_t wear_(const size_t index) const;
+            // 写入块的磨损值，先改写所在页
+            void set_wear_(const size_t index, uint8_t wear);
+            // 对页应用尚未应用的下移量
+            void normalize_page_(size_t page);
+            // 分片内空闲块的最小磨损值，没有空闲块时返回-1
+            int min_free_wear_(const Shard& shard) const;
+            // 所有磨损值减去全部空闲块的最小磨损值，只修改全局偏移和计数，需锁住全部分片
+            void rebase_();
+            // 提交锁：保护位图、磨损位图和脏页标记的修改，以及初始化和扩容
+            mutable std::mutex mutex;
     };
 }
 
@@ -0,0 +1,65 @@
+#ifndef CHECKSUM_MAP_H
+#define CHECKSUM_MAP_H
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "node/binary.h"
+#include "file/system_file.h"
+#include "file/journal.h"
+namespace BwtFS::System{
+    /*
+    * 块校验和表
+    * 每个块对应一个4字节的CRC32C，连续存放在校验和区域中（与位图区域一样由位图保留）
+    * 写数据块时更新，读数据块时校验，不一致时在出错的块上直接报错
+    * 值为0表示该块没有校验和（从未整块写入过），读取时跳过校验
+    * 修改只记录脏页，sync时把脏页写回
+    */
+    class ChecksumMap{
+        public:
+            ChecksumMap(size_t start, size_t block_count, std::shared_ptr<BwtFS::System::File> file);
+            ChecksumMap(const ChecksumMap& other) = delete;
+            ChecksumMap& operator=(const ChecksumMap& other) = delete;
+            ChecksumMap(ChecksumMap&& other) = delete;
+            ~ChecksumMap() = default;
+
+            // 写入整块后更新校验和，不满一块的写入清除该块的校验和
+            void update(size_t index, const BwtFS::Node::BinaryView& data);
+            // 校验读到的整块，不一致时抛出异常
+            void verify(size_t index, const BwtFS::Node::Binary& data) const;
+            // 将脏页写回文件，写回后清空尚未取出的日志项
+            void flush();
+            // 取出上次取出或写回以来的校验和变化，用于写日志
+            std::vector<JournalEntry> takeChanges();
+            // 重放日志中的校验和项
+            void replay(const std::vector<JournalEntry>& entries);
+            // 初始化：全部清零并写入整个区域
+            void init();
+            // 扩容：迁移到新的起始块，新增块没有校验和
+            void grow(size_t block_count, size_t start);
+            // 校验和区域的字节数
+            static size_t regionBytes(size_t block_count);
+
+        private:
+            // 校验和区域起始块
+            size_t start;
+            // 块数量
+            size_t block_count;
+            // 每个块的校验和
+            std::vector<uint32_t> sums;
+            // 需要写回的页（每页一个块）
+            std::vector<bool> dirty;
+            // 尚未写入日志的变化
+            std::vector<JournalEntry> changes;
+            std::shared_ptr<BwtFS::System::File> file;
+            mutable std::mutex mutex;
+
+            // 计算存储的校验和，CRC为0时存为1，0保留为“无校验和”
+            static uint32_t checksum(const BwtFS::Node::BinaryView& data);
+            // 写入整个区域
+            void save();
+    };
+}
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef DIRECT_FILE_H
+#define DIRECT_FILE_H
+#ifndef _WIN32
+#include <array>
+#include <mutex>
+#include "file/system_file.h"
+#include "util/memory_pool.h"
+namespace BwtFS::System{
+    /*
+    * O_DIRECT文件类
+    * 数据块读写绕过页缓存，避免镜像远大于内存时页缓存的双重缓冲
+    *
+    * O_DIRECT要求偏移、长度和内存地址都按DIRECT_ALIGNMENT对齐：
+    *   - 内存统一从对齐缓冲区池中取出，读写时经由缓冲区中转
+    *   - prefix未对齐时，一个块会跨两个对齐页，读取整个覆盖区间后截取；
+    *     写入时对覆盖区间做读-改-写，并按页加分段锁，防止相邻块的写入互相覆盖
+    *   - 文件末尾不足一页的部分（含prefix大小字段）走普通读写，避免O_DIRECT扩展文件
+    *
+    * 文件系统不支持O_DIRECT时退化为普通读写
+    */
+    class DirectFile : public File {
+        public:
+            // O_DIRECT的对齐要求
+            static constexpr size_t DIRECT_ALIGNMENT = 4096;
+
+            DirectFile(const std::string& path);
+            DirectFile(const DirectFile& other) = delete;
+            DirectFile& operator=(const DirectFile& other) = delete;
+            DirectFile(DirectFile&& other) = delete;
+            DirectFile& operator=(DirectFile&& other) = delete;
+            ~DirectFile() override;
+            BwtFS::Node::Binary read(unsigned long long index) override;
+            BwtFS::Node::Binary read(unsigned long long index, size_t size) override;
+            void write(unsigned long long index, const BwtFS::Node::Binary& data) override;
+            // 逐块写入
+            void writeBatch(const std::vector<BlockWrite>& writes) override;
+            void sync() override;
+            // 扩大文件后更新可以使用O_DIRECT访问的范围
+            void grow(size_t size, const BwtFS::Node::Binary& tail = BwtFS::Node::Binary(0)) override;
+            void close() override;
+
+        protected:
+            // 整段读入对齐缓冲区后按块拷贝
+            void read_contiguous(unsigned long long offset, const std::vector<std::byte*>& blocks) override;
+
+        private:
+            // 读取文件中[offset, offset+size)的数据（offset为绝对偏移）
+            void read_span(unsigned long long offset, std::byte* out, size_t size);
+            // 写入文件中[offset, offset+size)的数据（offset为绝对偏移）
+            void write_span(unsigned long long offset, const std::byte* in, size_t size);
+            // 写入块内偏移（不含prefix）处的数据
+            void write_view(unsigned long long index, const BwtFS::Node::BinaryView& data);
+
+            // O_DIRECT文件描述符，不支持时为-1
+            int direct_fd = -1;
+            // 可以使用O_DIRECT访问的范围上界（按页向下对齐的文件大小）
+            unsigned long long direct_limit = 0;
+            // 按页分段的写锁
+            std::array<std::mutex, 64> stripes;
+    };
+}
+#endif
+#endif
@@ -0,0 +1,81 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "node/binary.h"
+#include "file/system_file.h"
+namespace BwtFS::System{
+    // 日志项：一个块的位图、磨损值或校验和的新值
+    struct JournalEntry{
+        enum Type : uint8_t{
+            // 置位，wear为新的磨损值
+            SET = 1,
+            // 清空
+            CLEAR = 2,
+            // 校验和，checksum为新的值
+            CHECKSUM = 3,
+            // 加入待擦除队列
+            SCRUB = 4,
+            // 擦除完成，移出待擦除队列
+            SCRUBBED = 5
+        };
+        uint64_t index;
+        uint32_t checksum;
+        uint8_t type;
+        uint8_t wear;
+        uint8_t reserved[2];
+    };
+    static_assert(sizeof(JournalEntry) == 16, "journal entry must be 16 bytes");
+
+    /*
+    * 元数据预写日志
+    * 位于文件系统内部的一段连续块中（与校验和区域一样由位图保留），位置记录在超级块中（版本2起）
+    * 第一个块为日志头，记录当前代数；之后按块对齐依次追加记录，每条记录包含一次提交的
+    * 位图、磨损值和校验和的变化以及修改时间，带CRC32C
+    * 提交时只追加一条记录并刷盘，位图页和校验和页在日志写满（检查点）时才写回
+    * 打开文件系统时按顺序重放当前代数的记录，遇到第一条不完整的记录即停止
+    * 日志项都是绝对值，重复重放结果不变
+    * 只由FileSystem的提交线程调用，不加锁
+    */
+    class Journal{
+        public:
+            Journal(size_t start, size_t blocks, std::shared_ptr<BwtFS::System::File> file);
+            Journal(const Journal& other) = delete;
+            Journal& operator=(const Journal& other) = delete;
+            Journal(Journal&& other) = delete;
+            ~Journal() = default;
+
+            // 追加一条记录（不刷盘），剩余空间不足时返回false
+            bool append(const std::vector<JournalEntry>& entries, unsigned long long modify_time);
+            // 读取当前代数的所有有效记录，按提交顺序合并日志项
+            // modify_time为最后一条记录的修改时间，没有记录时不修改
+            std::vector<JournalEntry> replay(unsigned long long& modify_time);
+            // 清空日志：代数加一并重写日志头，之前的记录全部失效
+            // 调用前位图和校验和必须已经写回并刷盘
+            void reset();
+            // 初始化：写入新的日志头
+            void init();
+            // 日志区域的字节数
+            static size_t regionBytes(size_t blocks);
+
+        private:
+            // 日志区域起始块
+            size_t start;
+            // 日志区域块数（含日志头）
+            size_t blocks;
+            // 当前代数
+            uint64_t generation = 0;
+            // 下一条记录的序号
+            uint64_t sequence = 0;
+            // 下一条记录的位置（相对起始块）
+            size_t head = 1;
+            std::shared_ptr<BwtFS::System::File> file;
+
+            // 写入日志头
+            void write_header_();
+    };
+}
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+#ifndef _WIN32
+#include <mutex>
+#include <vector>
+#include <utility>
+#include "file/system_file.h"
+namespace BwtFS::System{
+    /*
+    * 内存映射文件类
+    * 将整个系统文件以MAP_SHARED方式映射到内存
+    * 读取为一次内存拷贝，只读视图直接指向映射区，写入为memcpy，不再产生系统调用
+    * 写入的范围记录为脏区间，在事务提交(sync)时统一msync
+    *
+    * 配置项([system]):
+    *   mmap_populate: 映射时是否预读整个文件(MAP_POPULATE)
+    *   mmap_advice  : madvise访问提示
+    */
+    class MappedFile : public File {
+        public:
+            MappedFile(const std::string& path);
+            MappedFile(const MappedFile& other) = delete;
+            MappedFile& operator=(const MappedFile& other) = delete;
+            MappedFile(MappedFile&& other) = delete;
+            MappedFile& operator=(MappedFile&& other) = delete;
+            ~MappedFile() override;
+            // 读取数据
+            BwtFS::Node::Binary read(unsigned long long index) override;
+            BwtFS::Node::Binary read(unsigned long long index, size_t size) override;
+            // 映射区的视图，不拷贝；扩大文件后旧的映射区保留，视图在关闭文件前一直有效
+            BwtFS::Node::BinaryView view(unsigned long long index, size_t size = 1) override;
+            // 写入数据，只拷贝到映射区
+            void write(unsigned long long index, const BwtFS::Node::Binary& data) override;
+            // 批量写入，逐块拷贝到映射区
+            void writeBatch(const std::vector<BlockWrite>& writes) override;
+            // 将脏区间刷回磁盘
+            void sync() override;
+            // 扩大文件后重新映射
+            // 旧的映射区保留到关闭文件时再解除，正在读写旧映射区的线程不受影响
+            void grow(size_t size, const BwtFS::Node::Binary& tail = BwtFS::Node::Binary(0)) override;
+            // 解除映射并关闭文件
+            void close() override;
+
+        protected:
+            // 从映射区逐块拷贝
+            void read_contiguous(unsigned long long offset, const std::vector<std::byte*>& blocks) override;
+
+        private:
+            // 拷贝到映射区并记录脏区间
+            void write_view(unsigned long long index, const BwtFS::Node::BinaryView& data);
+            // 映射区起始地址
+            std::byte* map_base = nullptr;
+            // 映射区大小
+            size_t map_size = 0;
+            // madvise访问提示
+            int map_advice = 0;
+            // 扩大文件时被替换下来的映射区
+            std::vector<std::pair<std::byte*, size_t>> retired_maps;
+            // 脏区间 [dirty_begin, dirty_end)
+            size_t dirty_begin = 0;
+            size_t dirty_end = 0;
+            std::mutex dirty_mutex;
+    };
+}
+#endif
+#endif
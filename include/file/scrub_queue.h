@@ -0,0 +1,75 @@
+#ifndef SCRUB_QUEUE_H
+#define SCRUB_QUEUE_H
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+#include "node/binary.h"
+#include "file/system_file.h"
+#include "file/journal.h"
+namespace BwtFS::System{
+    /*
+    * 待擦除块队列
+    * 删除文件时块不直接释放，而是加入队列，由后台线程写入新的随机数据后再释放，
+    * 删除后磁盘上不会残留旧的密文
+    * 队列以位图形式保存在擦除队列区域中（与校验和区域一样由位图保留），位置记录在超级块中（版本3起）
+    * 修改只记录脏页并记入元数据日志，检查点时把脏页写回
+    * 队列中的块在位图中保持置位，不会被getFreeBlock分配
+    */
+    class ScrubQueue{
+        public:
+            ScrubQueue(size_t start, size_t block_count, std::shared_ptr<BwtFS::System::File> file);
+            ScrubQueue(const ScrubQueue& other) = delete;
+            ScrubQueue& operator=(const ScrubQueue& other) = delete;
+            ScrubQueue(ScrubQueue&& other) = delete;
+            ~ScrubQueue() = default;
+
+            // 加入队列
+            void enqueue(std::span<const size_t> indices);
+            // 从上次取到的位置起按块号顺序取出最多count个待擦除块，块仍留在队列中
+            std::vector<size_t> next(size_t count);
+            // 擦除完成后移出队列
+            void remove(std::span<const size_t> indices);
+            // 队列中的块数
+            size_t size() const;
+            // 将脏页写回文件，写回后清空尚未取出的日志项
+            void flush();
+            // 取出上次取出或写回以来的变化，用于写日志
+            std::vector<JournalEntry> takeChanges();
+            // 重放日志中的擦除队列项
+            void replay(const std::vector<JournalEntry>& entries);
+            // 初始化：清空队列并写入整个区域
+            void init();
+            // 扩容：迁移到新的起始块，队列内容不变
+            void grow(size_t block_count, size_t start);
+            // 擦除队列区域的字节数
+            static size_t regionBytes(size_t block_count);
+
+        private:
+            // 擦除队列区域起始块
+            size_t start;
+            // 块数量
+            size_t block_count;
+            // 每块一位，置位表示待擦除
+            std::vector<uint64_t> words;
+            // 需要写回的页（每页一个块）
+            std::vector<bool> dirty;
+            // 尚未写入日志的变化
+            std::vector<JournalEntry> changes;
+            // 队列中的块数
+            size_t queued = 0;
+            // 下一次从哪个字开始取
+            size_t cursor = 0;
+            std::shared_ptr<BwtFS::System::File> file;
+            mutable std::mutex mutex;
+
+            // 修改一位，返回是否有变化
+            bool assign_(size_t index, bool value);
+            // 写入整个区域
+            void save();
+    };
+}
+
+#endif
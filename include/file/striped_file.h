@@ -0,0 +1,85 @@
+#ifndef STRIPED_FILE_H
+#define STRIPED_FILE_H
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include "file/system_file.h"
+#include "util/thread_pool.h"
+namespace BwtFS::System{
+    /*
+    * 条带卷
+    * 一个逻辑卷由多个成员文件（最好位于不同磁盘）组成，块按轮转方式条带化：
+    *   逻辑块b -> 成员 b % n 的第 b / n 个块
+    * 每个成员有自己的文件对象（按io_mode打开）和一个工作线程作为I/O队列，
+    * 批量读写按成员拆分后并行提交，聚合多块磁盘的带宽
+    *
+    * 条带清单为文本文件（扩展名 .bwts），每行一个成员文件路径，
+    * 相对路径相对于清单所在目录，以#开头的行为注释
+    *
+    * 逻辑卷没有prefix，逻辑大小为 n * 最小成员块数 * 块大小，
+    * 超级块、位图和认证块都按逻辑块号存放，与单文件卷一致
+    */
+    class StripedFile : public File {
+        public:
+            // 条带清单的扩展名
+            static constexpr const char* MANIFEST_EXTENSION = ".bwts";
+
+            StripedFile(const std::string& manifest);
+            StripedFile(const StripedFile& other) = delete;
+            StripedFile& operator=(const StripedFile& other) = delete;
+            StripedFile(StripedFile&& other) = delete;
+            StripedFile& operator=(StripedFile&& other) = delete;
+            ~StripedFile() override;
+
+            // 路径是否为条带清单
+            static bool isManifest(const std::string& path);
+            // 解析以逗号分隔的成员路径列表
+            static std::vector<std::string> parseMembers(const std::string& members);
+            // 创建条带卷：并行创建各成员文件，再写入清单
+            // size为逻辑卷的大小，平均分配到各成员；最小大小按整个卷检查
+            // 任一成员创建失败时删除本次创建的成员文件后抛出异常
+            static void create(const std::string& manifest, const std::vector<std::string>& members, size_t size);
+
+            BwtFS::Node::Binary read(unsigned long long index) override;
+            BwtFS::Node::Binary read(unsigned long long index, size_t size) override;
+            // 对齐的单个块使用成员的视图，其余情况读取拷贝
+            BwtFS::Node::BinaryView view(unsigned long long index, size_t size = 1) override;
+            // 按成员拆分后并行读取，成员内部再合并相邻的块
+            std::vector<BwtFS::Node::Binary> readBatch(const std::vector<unsigned long long>& offsets) override;
+            void write(unsigned long long index, const BwtFS::Node::Binary& data) override;
+            // 按成员拆分后并行写入，跨块的写入按块拆分
+            void writeBatch(const std::vector<BlockWrite>& writes) override;
+            // 并行刷盘
+            void sync() override;
+            // 各成员扩大相同的块数，已有逻辑块的位置不变
+            void grow(size_t size, const BwtFS::Node::Binary& tail = BwtFS::Node::Binary(0)) override;
+            void materialize(unsigned long long index) override;
+            void startBackgroundFill() override;
+            bool isThin() const override;
+            void close() override;
+            // 成员个数
+            size_t memberCount() const;
+
+        private:
+            struct Member{
+                std::shared_ptr<File> file;
+                // 成员的I/O队列，单线程按提交顺序执行
+                std::unique_ptr<ThreadPool> worker;
+            };
+            std::vector<Member> members;
+
+            // 逻辑偏移 -> (成员序号, 成员内偏移)
+            std::pair<size_t, unsigned long long> locate(unsigned long long offset) const;
+            // 按成员当前大小重新计算逻辑文件大小
+            void update_size();
+            // 读取任意逻辑区间，逐段拷贝
+            void read_range(unsigned long long offset, std::byte* out, size_t size);
+            // 对涉及的成员并行执行task(成员序号)，只涉及一个成员时在当前线程执行
+            template<typename F>
+            void for_members(const std::vector<size_t>& used, F&& task);
+            // 读取清单中的成员路径
+            static std::vector<std::string> read_manifest(const std::string& manifest);
+    };
+}
+#endif
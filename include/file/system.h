@@ -3,14 +3,21 @@
 #include <cstddef>
 #include <string>
 #include <vector>
+#include <span>
 #include <fstream>
 #include <iostream>
 #include <shared_mutex>
+#include <mutex>
+#include <condition_variable>
 #include <thread>
+#include <atomic>
 #include "config.h"
 #include "node/binary.h"
 #include "util/prefix.h"
 #include "file/bitmap.h"
+#include "file/checksum_map.h"
+#include "file/journal.h"
+#include "file/scrub_queue.h"
 #include "file/system_file.h"
 namespace BwtFS::System{
     /*
@@ -30,6 +37,10 @@ namespace BwtFS::System{
     *   ±--------------±-----------------±--------------------±--------------+ 
     *   | 系统创建时间 | 系统位图起始位置 | 系统位图磨损起始位置| 系统位图大小     | 
     *   ±--------------±-----------------±--------------------±--------------+ 
+    *   | 校验和起始位置（版本1起）| 日志起始位置（版本2起）| 日志块数（版本2起）| 
+    *   ±--------------±-----------------±--------------------±--------------+ 
+    *   | 擦除队列起始位置（版本3起）|                                        | 
+    *   ±--------------±-----------------±--------------------±--------------+ 
     *   |                        系统数据部分                                 |
     *   ±--------------±-----------------±--------------------±--------------+ 
     *   | 系统修改时间 |    系统头校验    |    RCA_Seed         |(预留空间)    | 
@@ -49,14 +60,25 @@ namespace BwtFS::System{
             FileSystem& operator=(const FileSystem& other) = delete;
             FileSystem(FileSystem&& other) = delete;
             FileSystem& operator=(FileSystem&& other) = delete;
-            ~FileSystem() = default;
+            ~FileSystem();
 
             // // ------------ 文件系统操作 -------------
             // 文件系统操作
+            // 读取时按块校验和校验，不一致时抛出异常
             virtual BwtFS::Node::Binary read(const unsigned long long index);
             virtual void write(const unsigned long long index, const BwtFS::Node::Binary& data);
+            // 批量读取数据块，物理相邻的块合并为一次读取，结果按传入顺序返回
+            virtual std::vector<BwtFS::Node::Binary> readBlocks(std::span<const size_t> indices);
+            // 批量写入数据块，一次提交，全部完成后返回；数据只在调用期间使用，不拷贝
+            virtual void writeBlocks(const std::vector<std::pair<unsigned long long, BwtFS::Node::BinaryView>>& blocks);
+            // 将已写入的数据、位图和校验和刷到磁盘
+            // 多个事务同时提交时合并为一次刷盘，返回时调用前的修改都已落盘
+            // 有日志时只追加一条日志记录，日志写满时再写回位图和校验和
+            virtual void sync();
             // 获取文件系统版本
             virtual uint8_t getVersion() const;
+            // 获取节点加密算法，取值为BwtFS::Util::Cipher
+            virtual uint8_t getCipher() const;
             // 获取文件系统大小
             virtual size_t getFileSize() const;
             // 校验文件系统
@@ -78,6 +100,17 @@ namespace BwtFS::System{
             
             size_t getBitmapSize() const;
 
+            // 在线扩容
+            // 传入新的文件系统大小（字节），扩大系统文件，把位图、磨损位图和认证块
+            // 迁移到新增的空间中，最后重写超级块；扩容期间已有文件可以继续读写
+            // 新增空间至少要能容纳新的位图、磨损位图和两个系统块
+            virtual void grow(size_t new_size);
+
+            // 释放已删除文件占用的块
+            // 有擦除队列时块加入队列，由后台线程按 scrub_rate 写入随机数据后再释放，
+            // 此前块不会被重新分配；否则直接清空位图
+            virtual void freeBlocks(std::span<const size_t> indices);
+
             std::shared_ptr<BwtFS::System::Bitmap> bitmap;
 
             void setHashValue(const size_t& hash_value);
@@ -103,6 +136,15 @@ namespace BwtFS::System{
             unsigned long long BITMAP_WEAR_START;
             // 文件系统位图大小
             unsigned long long BITMAP_SIZE;
+            // 块校验和区域起始位置，版本0的文件系统没有校验和区域
+            unsigned long long CHECKSUM_START;
+            // 元数据日志区域起始位置和块数，版本2之前的文件系统没有日志
+            unsigned long long JOURNAL_START;
+            unsigned long long JOURNAL_BLOCKS;
+            // 擦除队列区域起始位置，版本3之前的文件系统删除时直接释放块
+            unsigned long long SCRUB_START;
+            // 节点加密算法，版本4之前的文件系统为RCA
+            uint8_t CIPHER;
             // 文件系统字符串哈希值
             size_t STRING_HASH_VALUE; 
             // 文件系统随机数种子
@@ -112,11 +154,44 @@ namespace BwtFS::System{
             bool is_open;
             // 文件系统对象
             std::shared_ptr<BwtFS::System::File> file;
+            // 块校验和表，为空时不校验
+            std::shared_ptr<BwtFS::System::ChecksumMap> checksums;
+            // 元数据日志，为空时每次提交直接写回位图和校验和
+            std::shared_ptr<BwtFS::System::Journal> journal;
+            // 待擦除块队列，为空时删除直接释放块
+            std::shared_ptr<BwtFS::System::ScrubQueue> scrubs;
+            // 后台擦除线程
+            std::thread scrubber;
+            std::atomic<bool> scrubber_stop{false};
+            // 擦除线程是否在处理队列，连续失败退出后为false，删除的块直接释放
+            // 在scrubber_mutex下修改
+            bool scrubber_running = false;
+            std::mutex scrubber_mutex;
+            std::condition_variable scrubber_cv;
             
-            // 读写锁
+            // 读写锁，仅保护元数据（超级块、认证块），数据块读写不经过此锁
             std::shared_mutex rw_lock;
 
-            void updateModifyTime();
+            // 组提交状态：已请求和已完成的刷盘序号，是否有线程正在刷盘
+            std::mutex sync_mutex;
+            std::condition_variable sync_cv;
+            unsigned long long sync_requested = 0;
+            unsigned long long sync_completed = 0;
+            bool syncing = false;
+            // 同一时间只有一个线程写日志或写回元数据（提交线程、扩容）
+            std::mutex commit_mutex;
+
+            // 写入认证块中的修改时间
+            void updateModifyTime(unsigned long long modify_time);
+            // 提交一次：数据刷盘后追加日志记录并刷盘
+            // 没有日志、日志写满或checkpoint为true时写回位图和校验和，刷盘后清空日志
+            void commit_(bool checkpoint);
+            // 后台擦除：按块号顺序成批写入随机数据，释放后提交，rate为每秒字节数
+            // 一批失败时留在队列中退避重试，连续失败过多时退出并直接释放队列中的块
+            void scrub_(size_t rate);
+            // 启动后台擦除线程，scrub_rate为0时直接释放队列中的块
+            void start_scrub_();
+            void stop_scrub_();
             
     };
 
@@ -3,9 +3,28 @@
 #include <string>
 #include <vector>
 #include <fstream>
+#include <mutex>
+#include <memory>
+#include <functional>
+#include <array>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
 #include "node/binary.h"
 #include "util/prefix.h"
 namespace BwtFS::System{
+    class AsyncBlockEngine;
+
+    /*
+    * 批量写入的单个块
+    * offset: 块的偏移（不含prefix，与File::write的参数一致）
+    * data  : 写入的数据，Binary的视图会共享其数据；引用BlockBuffer时调用者保证写入完成前缓冲区有效
+    */
+    struct BlockWrite{
+        unsigned long long offset;
+        BwtFS::Node::BinaryView data;
+    };
+
     /*
     * 文件类
     * 用于物理文件的基本读写操作
@@ -17,7 +36,20 @@ namespace BwtFS::System{
     * | prefix (可选) | data (数据)   | prefix大小|
     * +---------------+--------------+----------+
     * 
+    * 读写采用pread/pwrite按位置访问，不共享文件指针，
+    * 多个线程可以同时读写不同的块，无需额外加锁
+    * （Windows下退化为带锁的文件流）
+    * 
+    * 可通过 File::open 按配置 [system] io_mode 选择实现：
+    *   pread : 默认实现（本类）
+    *   mmap  : 内存映射实现（MappedFile）
+    *   direct: O_DIRECT绕过页缓存（DirectFile）
+    * 路径为条带清单（.bwts）时打开为条带卷（StripedFile），各成员再按io_mode打开
     * 
+    * 精简配置（[system] sparse = true）创建的文件，数据区初始为空洞：
+    *   - 块被分配时由 materialize 把所在区段中的空洞填充为随机数据
+    *   - 后台填充线程按 sparse_fill_rate 限速逐步填满剩余空洞
+    *   打开文件时根据实际占用的磁盘空间判断是否为精简文件
     */
     class File {
         public:
@@ -28,18 +60,54 @@ namespace BwtFS::System{
             File& operator=(const File& other) = delete;
             File(File&& other) = delete;
             File& operator=(File&& other) = delete;
-            ~File();
+            virtual ~File();
+            // 按配置打开文件，返回对应的实现
+            static std::shared_ptr<File> open(const std::string& path);
             // 读取数据
             // 传入块的位置，返回读取的数据
-            BwtFS::Node::Binary read(unsigned long long index);
+            virtual BwtFS::Node::Binary read(unsigned long long index);
             // 读取数据
             // 传入块的位置和大小，返回读取的数据
-            BwtFS::Node::Binary read(unsigned long long index, size_t size);
+            virtual BwtFS::Node::Binary read(unsigned long long index, size_t size);
+            // 只读视图
+            // 传入位置和块数，返回数据的视图，不能原地修改（如解密）
+            // 默认实现读取一份拷贝并由视图持有；映射文件直接返回映射区的视图，在文件关闭前有效
+            virtual BwtFS::Node::BinaryView view(unsigned long long index, size_t size = 1);
+            // 批量读取数据块
+            // 传入各块的位置（不含prefix），按位置排序后将相邻的块合并为一次读取，
+            // 结果按传入顺序返回
+            virtual std::vector<BwtFS::Node::Binary> readBatch(const std::vector<unsigned long long>& offsets);
             // 写入数据
             // 传入块的位置和数据，写入数据
-            void write(unsigned long long index, const BwtFS::Node::Binary& data);
+            virtual void write(unsigned long long index, const BwtFS::Node::Binary& data);
+            // 批量写入数据
+            // 类Unix系统下通过异步块写入引擎一次提交，全部完成后返回
+            virtual void writeBatch(const std::vector<BlockWrite>& writes);
+            // 将已写入的数据刷到磁盘，在事务提交时调用
+            virtual void sync();
+            // 块分配前调用，精简文件中若块所在区段还有空洞，则先填充为随机数据
+            // 传入块的位置（不含prefix），非精简文件不做任何操作
+            virtual void materialize(unsigned long long index);
+            // 启动后台填充线程，逐步填满精简文件中剩余的空洞
+            virtual void startBackgroundFill();
+            // 文件是否为精简文件（数据区还有空洞）
+            virtual bool isThin() const;
+            // 创建文件的进度回调，参数为已写入字节数和总字节数
+            using CreateProgress = std::function<void(size_t bytesWritten, size_t totalBytes)>;
             // 创建文件
-            static unsigned createFile(const std::string& path, size_t size, std::string prefix = "");
+            // 预分配空间后多线程并行填充随机数据，prefix文件按块流式拷贝
+            // [system] sparse = true 时只设置文件大小，数据区保留为空洞
+            // 路径为条带清单（.bwts）时按 [system] stripe_members 创建各成员文件
+            // 未传入进度回调时按10%的间隔输出日志
+            static unsigned createFile(const std::string& path, size_t size, std::string prefix = "",
+                                       CreateProgress progress = nullptr);
+            // 扩大文件
+            // 传入新的数据区大小（不含prefix和末尾的prefix大小字段），
+            // 新增的空间填充随机数据，prefix大小字段移到新的文件末尾
+            // tail写在新的最后一个块开头，与prefix大小字段一起先写入并刷盘，
+            // 文件长度改变时最后一个块中已经是tail，其余新增空间之后再填充
+            // 已有块的位置不变，扩大期间可以继续读写已有的块
+            virtual void grow(size_t size, const BwtFS::Node::Binary& tail = BwtFS::Node::Binary(0));
             // 获取文件大小
             size_t getFileSize() const;
             // 获取文件prefix大小
@@ -47,21 +115,65 @@ namespace BwtFS::System{
             // 获取文件是否有前缀
             bool hasPrefix() const;
             // 关闭文件
-            void close();
+            virtual void close();
 
-        private:
+        protected:
+            // 不对应物理文件的实现（条带卷）使用，由子类设置文件大小
+            File();
+            // 创建单个物理文件，不检查最小大小（条带卷的成员只要求总大小达到最小值）
+            static unsigned create_file_(const std::string& path, size_t size, std::string prefix,
+                                         CreateProgress progress);
+            // 从绝对偏移offset开始连续读取blocks.size()个块，依次分散到blocks中
+            virtual void read_contiguous(unsigned long long offset, const std::vector<std::byte*>& blocks);
+            // 按位置读取，返回实际读取的字节数
+            size_t pread_at(unsigned long long offset, void* buffer, size_t size);
+            // 按位置写入全部数据
+            void pwrite_at(unsigned long long offset, const void* buffer, size_t size);
+#ifndef _WIN32
+            // 在指定文件描述符上按位置读写，处理EINTR和短读写
+            static size_t pread_fd(int fd, unsigned long long offset, void* buffer, size_t size);
+            static void pwrite_fd(int fd, unsigned long long offset, const void* buffer, size_t size);
+            // 填充第extent个区段中的空洞，返回填充的字节数
+            size_t fill_extent(size_t extent);
+            // 后台填充线程，rate为每秒填充的字节数
+            void background_fill(size_t rate);
+            // 停止后台填充线程
+            void stop_background_fill();
+#endif
+#ifdef _WIN32
             // 文件对象
             std::shared_ptr<std::fstream> file;
             // 文件缓冲区对象
-            std::filebuf* fb;
+            std::filebuf* fb = nullptr;
+            // 文件流共享读写指针，需要加锁
+            std::mutex io_mutex;
+#else
+            // 文件描述符
+            int fd = -1;
+            // 异步块写入引擎，第一次批量写入时创建
+            std::unique_ptr<AsyncBlockEngine> engine;
+            std::once_flag engine_once;
+            // 是否为精简文件
+            bool thin = false;
+            // 各区段是否已填满（不再有空洞）
+            std::unique_ptr<std::atomic<bool>[]> extent_filled;
+            size_t extent_count = 0;
+            // 按区段分段的填充锁，分配时的填充和后台填充互斥
+            std::array<std::mutex, 64> fill_stripes;
+            // 后台填充线程
+            std::thread filler;
+            std::atomic<bool> filler_stop{false};
+            std::mutex filler_mutex;
+            std::condition_variable filler_cv;
+#endif
             // 文件是否有前缀
-            bool has_prefix;
+            bool has_prefix = false;
             // 前缀对象
             std::shared_ptr<BwtFS::Util::Prefix> prefix;
             // prefix的大小
-            unsigned prefix_size;
+            unsigned prefix_size = 0;
             // 文件大小
-            size_t file_size;
+            size_t file_size = 0;
     };
 }
 #endif
\ No newline at end of file
@@ -4,6 +4,9 @@
 #include <iostream>
 #include <string>
 #include <memory>
+#include <span>
+#include <cstring>
+#include <stdexcept>
 
 namespace BwtFS::Node{
     enum StringType{
@@ -11,6 +14,7 @@ namespace BwtFS::Node{
         ASCII,  // ASCII
         BASE64  // Base64
     };
+    class BinaryView;
     /*
     * 二进制数据类
     * 用于二进制数据的读写操作
@@ -68,6 +72,10 @@ namespace BwtFS::Node{
             virtual std::vector<std::byte> read() const;
             // 获取数据，参数为size_t类型
             virtual std::byte get(const size_t index) const;
+            // 不拷贝地截取[index, index+size)，越界部分截断，与read一致
+            BinaryView slice(const size_t index, const size_t size) const;
+            // 整个数据的视图
+            BinaryView view() const;
             
         // ------------ 写数据 -------------
             // 写入数据，参数为size_t类型和std::byte类型
@@ -87,6 +95,8 @@ namespace BwtFS::Node{
             virtual Binary& append(const size_t size, const std::byte* data);
             // 追加数据，参数为std::vector<std::byte>类型
             virtual Binary& append(const std::vector<std::byte>& data);
+            // 追加视图中的数据
+            virtual Binary& append(const BinaryView& data);
 
         // ------------ 其他操作 -------------
             // 清空数据
@@ -95,6 +105,8 @@ namespace BwtFS::Node{
             virtual size_t size() const;
             // 调整数据大小，参数为size_t类型
             virtual Binary& resize(const size_t size);
+            // 预留容量，之后追加不超过容量时不重新分配
+            virtual Binary& reserve(const size_t size);
             // 将数据转换为字符串，参数为size_t类型
             virtual std::string to_hex_string(const size_t index, const size_t size) const;
             // 将数据转换为字符串，无参数
@@ -111,6 +123,8 @@ namespace BwtFS::Node{
             virtual bool is_null() const;
             // 获取数据指针
             virtual std::byte* data();
+            // 获取只读数据指针
+            virtual const std::byte* data() const;
 
         // ----------- 静态函数 ------------
             // 将std::byte*类型的数据转换为字符串
@@ -134,6 +148,49 @@ namespace BwtFS::Node{
             std::shared_ptr<std::vector<std::byte>>  binary_array;
     };
 
+    /*
+    * 二进制数据视图
+    * 不拥有数据，保存底层数组的共享指针以保证数据在视图存在期间有效
+    * 节点解析、entry解码和读取拼接通过视图访问块中的数据，不再逐段拷贝
+    * 视图创建后不应再改变原Binary的大小：底层数组重新分配后视图指向旧的内存
+    */
+    class BinaryView{
+        public:
+            BinaryView() = default;
+            BinaryView(std::shared_ptr<std::vector<std::byte>> owner, const size_t index, const size_t size);
+            // 整个Binary的视图，与Binary共享底层数组
+            BinaryView(const Binary& binary);
+            // 引用外部内存（如BlockBuffer），不持有数据，由调用者保证视图使用期间数据有效
+            BinaryView(const std::byte* data, const size_t size);
+
+            const std::byte* data() const { return this->ptr; }
+            size_t size() const { return this->length; }
+            bool empty() const { return this->length == 0; }
+            std::span<const std::byte> span() const { return {this->ptr, this->length}; }
+            // 获取数据，越界时抛出异常
+            std::byte get(const size_t index) const;
+            // 截取子视图，越界部分截断
+            BinaryView slice(const size_t index, const size_t size) const;
+            // 按本机字节序读取定长的值，越界时抛出异常
+            template<typename T>
+            T load(const size_t index) const{
+                if (index + sizeof(T) > this->length){
+                    throw std::runtime_error(std::string("BinaryView::load: Index out of range: ") + __FILE__ + ":" + std::to_string(__LINE__));
+                }
+                T value;
+                std::memcpy(&value, this->ptr + index, sizeof(T));
+                return value;
+            }
+            // 拷贝为独立的Binary
+            Binary to_binary() const;
+            std::vector<std::byte> to_vector() const;
+
+        private:
+            std::shared_ptr<std::vector<std::byte>> owner;
+            const std::byte* ptr = nullptr;
+            size_t length = 0;
+    };
+
     // 重载<<运算符
     // 要用 operator<< 进行合并，必须定义为非成员函数，否则会因为隐式 this 参数导致编译错误。
     Binary& operator<<(Binary&& dest, Binary&& src);
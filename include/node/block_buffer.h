@@ -0,0 +1,115 @@
+#ifndef BLOCK_BUFFER_H
+#define BLOCK_BUFFER_H
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include "config.h"
+#include "node/binary.h"
+
+namespace BwtFS::Node{
+    /*
+    * 块缓冲区池
+    * 缓冲区大小为BLOCK_SIZE并按页对齐，每次向系统申请一组，之后只在池内循环使用，不归还给系统
+    * 空闲缓冲区组成无锁栈，取出和归还各只需一次CAS，池内没有空闲缓冲区时加锁扩充
+    * 栈顶同时保存版本号和缓冲区编号，每次修改版本号加一，避免ABA问题
+    */
+    class BlockPool{
+        public:
+            // 池已达上限时返回的编号，此时缓冲区直接从堆上分配
+            static constexpr uint32_t NONE = UINT32_MAX;
+
+            static BlockPool& getInstance();
+            BlockPool(const BlockPool& other) = delete;
+            BlockPool& operator=(const BlockPool& other) = delete;
+            BlockPool(BlockPool&& other) = delete;
+            BlockPool& operator=(BlockPool&& other) = delete;
+            ~BlockPool();
+
+            // 取出一个空闲缓冲区，返回编号，缓冲区内容未初始化
+            uint32_t acquire();
+            // 归还缓冲区
+            void release(uint32_t id);
+            // 编号对应的缓冲区地址
+            std::byte* buffer(uint32_t id) const;
+            // 已向系统申请的缓冲区总数
+            size_t capacity() const;
+            // 池已达上限时从堆上分配缓冲区，从没有到有时记录一次警告
+            std::byte* acquireOverflow();
+            void releaseOverflow(std::byte* buffer);
+            // 尚未释放的堆上缓冲区个数
+            size_t overflow() const;
+
+        private:
+            BlockPool() = default;
+            // 申请一组新的缓冲区并压入空闲栈
+            void expand();
+
+            // 每组缓冲区的个数
+            static constexpr uint32_t BUFFERS_PER_CHUNK = 64;
+            // 最多的组数（64MB），池不会收缩，上限按写入积压的常见峰值设定，超过后直接从堆上分配、用完即释放
+            static constexpr uint32_t MAX_CHUNKS = 256;
+            struct Chunk{
+                std::byte* memory;
+                // 空闲栈中下一个缓冲区的编号加一，0表示栈底
+                std::atomic<uint32_t> next[BUFFERS_PER_CHUNK];
+            };
+            std::atomic<Chunk*> chunks[MAX_CHUNKS] = {};
+            std::atomic<uint32_t> chunk_count{0};
+            // 高32位为版本号，低32位为栈顶缓冲区的编号加一
+            std::atomic<uint64_t> head{0};
+            std::mutex expand_mutex;
+            std::atomic<size_t> overflow_count{0};
+    };
+
+    /*
+    * 块缓冲区
+    * 容量固定为BLOCK_SIZE、按页对齐的缓冲区，从BlockPool中取出，析构时归还
+    * 白节点、黑节点在其中组装并原地加密，再交给事务写入，稳定写入时每个块不再有堆分配
+    * 只能移动不能拷贝；默认构造不占用缓冲区，第一次写入时才从池中取出
+    */
+    class BlockBuffer{
+        public:
+            BlockBuffer() = default;
+            // 取出缓冲区并设置大小，内容未初始化
+            explicit BlockBuffer(const size_t size);
+            BlockBuffer(const BlockBuffer& other) = delete;
+            BlockBuffer& operator=(const BlockBuffer& other) = delete;
+            BlockBuffer(BlockBuffer&& other) noexcept;
+            BlockBuffer& operator=(BlockBuffer&& other) noexcept;
+            ~BlockBuffer();
+
+            std::byte* data() { return this->ptr; }
+            const std::byte* data() const { return this->ptr; }
+            size_t size() const { return this->length; }
+            bool empty() const { return this->length == 0; }
+            static constexpr size_t capacity() { return BwtFS::BLOCK_SIZE; }
+            // 调整大小，超过容量时抛出异常，新增部分内容未初始化
+            BlockBuffer& resize(const size_t size);
+            // 清空数据，缓冲区保留
+            BlockBuffer& clear();
+            // 追加数据，超过容量时抛出异常
+            BlockBuffer& append(const std::byte* data, const size_t size);
+            BlockBuffer& append(const BinaryView& data);
+            // 在末尾扩展size个字节并返回其起始地址，由调用者填充
+            std::byte* extend(const size_t size);
+            std::span<std::byte> span() { return {this->ptr, this->length}; }
+            // 不持有数据的视图，调用者保证视图使用期间缓冲区未被释放
+            BinaryView view() const { return BinaryView(this->ptr, this->length); }
+            // 拷贝为独立的Binary
+            Binary to_binary() const;
+
+        private:
+            // 还没有缓冲区时从池中取出
+            void ensure_();
+            // 把缓冲区还给池（或释放堆分配的缓冲区）
+            void release_();
+
+            std::byte* ptr = nullptr;
+            uint32_t id = BlockPool::NONE;
+            size_t length = 0;
+    };
+}
+
+#endif
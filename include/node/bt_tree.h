@@ -1,14 +1,17 @@
 #ifndef __BWT_H__
 #define __BWT_H__
 #include <cstring>
+#include <algorithm>
 #include <map>
 #include <vector>
 #include <queue>
 #include <stack>
 #include <mutex>
+#include <condition_variable>
 #include <functional>
 #include "bw_node.h"
 #include "binary.h"
+#include "block_buffer.h"
 #include "util/secure_ptr.h"
 #include "util/memory_pool.h"
 #include "util/thread_pool.h"
@@ -16,8 +19,10 @@
 #include "util/log.h"
 #include "util/random.h"
 #include "util/cell.h"
+#include "util/crypto_engine.h"
 #include "util/safe_queue.h"
 #include "util/token.h"
+#include "util/ini_parser.h"
 #include "file/system.h"
 #include "entry.h"
 #include "config.h"
@@ -31,13 +36,13 @@ namespace BwtFS::Node{
     };
 
     struct white_node_info{
-        Binary data;
+        BlockBuffer data;
         unsigned start;
         unsigned length;
     };
 
     struct binary_node_info{
-        Binary data;
+        BlockBuffer data;
         size_t bitmap;
     };
 
@@ -64,6 +69,7 @@ namespace BwtFS::Node{
 
     typedef visit_node_list VisitNodeList;
 
+    // 白节点数据的最大字节数，实际容量还要减去加密算法在块末尾占用的部分，见CryptoEngine::nodeDataSize
     constexpr size_t SIZE_OF_NODE_DATA = BwtFS::BLOCK_SIZE - sizeof(uint8_t);
 
     /*
@@ -83,38 +89,80 @@ namespace BwtFS::Node{
         public:
             TransactionWriter(){
                 m_fs = BwtFS::System::getBwtFS();
+                m_batch_size = std::max<size_t>(1, std::stoul(BwtFS::Config::getInstance().get("system", "io_queue_depth",
+                    std::to_string(BwtFS::DefaultConfig::SYSTEM_FILE_IO_QUEUE_DEPTH))));
             }
             TransactionWriter(const TransactionWriter&) = delete;
             TransactionWriter& operator=(const TransactionWriter&) = delete;
             TransactionWriter(TransactionWriter&&) = delete;
             TransactionWriter& operator=(TransactionWriter&&) = delete;
-            ~TransactionWriter() = default;
+            ~TransactionWriter(){
+                // 未提交的事务归还已分配的块，避免这些块一直处于已分配状态
+                std::lock_guard<std::mutex> lock(m_allocated_mutex);
+                if (!m_allocated.empty()){
+                    try{
+                        m_fs->bitmap->release(m_allocated);
+                    }catch(const std::exception& e){
+                        LOG_ERROR << "Failed to release allocated blocks: " << e.what();
+                    }
+                }
+            }
 
             /*
-            * 写入数据
-            * 返回写入的块的索引
+            * 分配一个块
+            * 节点加密需要用到块的索引，先分配再加密，最后调用write写入
             */
-            size_t write(Binary& data){
-                BinaryNodeInfo info;
-                info.data = data;
+            size_t allocate(){
                 auto t = m_fs->bitmap->getFreeBlock();
                 if (t == 0){
                     LOG_ERROR << "No free block";
                     throw std::runtime_error("No free block");
                 }
-                info.bitmap = t;
-                // LOG_DEBUG << "Writing block bitmap: " << info.bitmap;
-                m_data_queue.enqueue(info);
+                {
+                    std::lock_guard<std::mutex> lock(m_allocated_mutex);
+                    m_allocated.push_back(t);
+                }
                 return t;
             }
+            /*
+            * 写入数据到allocate分配的块
+            * 缓冲区移入队列，写入完成后归还块缓冲区池
+            */
+            void write(size_t bitmap, BlockBuffer&& data){
+                BinaryNodeInfo info;
+                info.data = std::move(data);
+                info.bitmap = bitmap;
+                // LOG_DEBUG << "Writing block bitmap: " << info.bitmap;
+                // 队列中的块达到上限时等待写入线程取走，缓冲区占用不随文件大小增长
+                {
+                    std::unique_lock<std::mutex> lock(m_queued_mutex);
+                    m_queued_cv.wait(lock, [this]{ return m_queued < MAX_QUEUED_BLOCKS; });
+                    m_queued++;
+                }
+                m_data_queue.enqueue(std::move(info));
+            }
             void commit(){
-                // 提交事务的逻辑
-                while(!m_size_queue.empty()){
-                    size_t bitmap;
-                    m_size_queue.dequeue(bitmap);
-                    m_fs->bitmap->set(bitmap);
+                // 有块写入失败时不提交：归还已分配的块，抛出写入时的异常
+                {
+                    std::lock_guard<std::mutex> lock(m_error_mutex);
+                    if (m_error){
+                        rollback_();
+                        std::rethrow_exception(m_error);
+                    }
                 }
-                
+                // 提交事务的逻辑：事务的所有块一次写入位图
+                std::vector<size_t> bitmaps;
+                size_t bitmap;
+                while(m_size_queue.dequeue(bitmap)){
+                    bitmaps.push_back(bitmap);
+                }
+                m_fs->bitmap->setMany(bitmaps);
+                {
+                    std::lock_guard<std::mutex> lock(m_allocated_mutex);
+                    m_allocated.clear();
+                }
+                // 数据块和位图都已写入，统一刷盘
+                m_fs->sync();
             }
             void set_write_finished(bool finished){
                 std::unique_lock<std::mutex> lock(m_write_finish_mutex);
@@ -127,28 +175,88 @@ namespace BwtFS::Node{
             bool has_all_written(){
                 return all_written;
             }
+            /*
+            * 将队列中的块批量写入文件系统
+            * 每次取出队列中已有的块（不超过io_queue_depth）一次提交
+            * 写入失败时记录异常，之后的块直接丢弃，由commit抛出
+            */
             void write_fs(){
-                while(!m_data_queue.empty() || !get_write_finished()){
-                    if (m_data_queue.empty()){
+                std::vector<std::pair<unsigned long long, BinaryView>> batch;
+                // 批次中的缓冲区，writeBlocks返回后才归还
+                std::vector<BlockBuffer> buffers;
+                batch.reserve(m_batch_size);
+                buffers.reserve(m_batch_size);
+                while(true){
+                    // 先读取结束标志再取队列，避免最后一个块和结束标志同时到达时漏写
+                    bool finished = get_write_finished();
+                    BinaryNodeInfo data;
+                    while(batch.size() < m_batch_size && m_data_queue.dequeue(data)){
+                        batch.emplace_back(data.bitmap, data.data.view());
+                        buffers.push_back(std::move(data.data));
+                    }
+                    if (!batch.empty()){
+                        std::lock_guard<std::mutex> lock(m_queued_mutex);
+                        m_queued -= batch.size();
+                        m_queued_cv.notify_all();
+                    }
+                    if (batch.empty()){
+                        if (finished){
+                            break;
+                        }
+                        std::this_thread::yield();
                         continue;
                     }
-                    BinaryNodeInfo data;
-                    m_data_queue.dequeue(data);
-                    m_fs->write(data.bitmap, data.data);
-                    // LOG_DEBUG << "Write content: " << data.data.to_base64_string();
-                    m_size_queue.enqueue(data.bitmap);
-                    Binary d = m_fs->read(data.bitmap); // 读取以确保写入成功
-                    // LOG_DEBUG << "Read " << data.bitmap <<" back content: " << d.to_base64_string();
+                    if (!failed_()){
+                        try{
+                            m_fs->writeBlocks(batch);
+                            for (auto& [bitmap, _] : batch){
+                                size_t b = bitmap;
+                                m_size_queue.enqueue(b);
+                            }
+                        }catch(const std::exception& e){
+                            LOG_ERROR << "Failed to write blocks, transaction aborted: " << e.what();
+                            std::lock_guard<std::mutex> lock(m_error_mutex);
+                            m_error = std::current_exception();
+                        }
+                    }
+                    batch.clear();
+                    buffers.clear();
                 }
                 all_written = true;
             }
         private:
             std::shared_ptr<BwtFS::System::FileSystem> m_fs;
             safe_queue<BinaryNodeInfo> m_data_queue;
+            // 等待写入的块数上限（4MB），超过后write阻塞
+            static constexpr size_t MAX_QUEUED_BLOCKS = 1024;
+            size_t m_queued = 0;
+            std::mutex m_queued_mutex;
+            std::condition_variable m_queued_cv;
             safe_queue<size_t> m_size_queue;
             std::mutex m_write_finish_mutex;
             bool m_write_finished = false;
-            bool all_written = false;
+            std::atomic<bool> all_written = false;
+            // 单次批量写入的最大块数
+            size_t m_batch_size;
+            // 已分配、尚未提交的块
+            std::vector<size_t> m_allocated;
+            std::mutex m_allocated_mutex;
+            // 块写入失败时的异常
+            std::exception_ptr m_error;
+            std::mutex m_error_mutex;
+
+            bool failed_(){
+                std::lock_guard<std::mutex> lock(m_error_mutex);
+                return m_error != nullptr;
+            }
+            // 归还已分配、尚未提交的块
+            void rollback_(){
+                std::lock_guard<std::mutex> lock(m_allocated_mutex);
+                if (!m_allocated.empty()){
+                    m_fs->bitmap->release(m_allocated);
+                    m_allocated.clear();
+                }
+            }
     };
 
     class TreeDataReader{
@@ -207,37 +315,50 @@ namespace BwtFS::Node{
             // }
             Binary read(size_t index, size_t size){
                 Binary binary_data;
-                size_t visit_index = index / (BwtFS::BLOCK_SIZE - sizeof(uint8_t));
+                size_t visit_index = index / m_node_data_size;
                 if (visit_index >= m_visit_nodes->size()){
                     LOG_WARNING << "Get Tree Data: Out of range: " << visit_index 
                               << ", size: " << m_visit_nodes->size();
                     // throw std::runtime_error("Get Tree Data: Out of range");
                     return binary_data; // 返回空的Binary
                 }
-                size_t node_data_start = index - visit_index * (BwtFS::BLOCK_SIZE - sizeof(uint8_t));
+                size_t node_data_start = index - visit_index * m_node_data_size;
                 size_t size_ = size;
+                // 结果一次分配，剩余节点的容量作为上限
+                binary_data.reserve(std::min(size, (m_visit_nodes->size() - visit_index) * m_node_data_size));
+                // 预读的数据块，blocks[i]对应第blocks_begin+i个访问节点
+                std::vector<Binary> blocks;
+                size_t blocks_begin = visit_index;
                 while(binary_data.size() < size){
                     // LOG_DEBUG << "Total size: " << binary_data.size() 
                     //           << ", size: " << size 
                     //           << ", visit_index: " << visit_index;
+                    if (visit_index >= blocks_begin + blocks.size()){
+                        // 按剩余大小估算还需要的节点数，一次批量读取
+                        size_t count = (node_data_start + size_ + m_node_data_size - 1) / m_node_data_size;
+                        count = std::clamp<size_t>(count, 1, READ_BATCH_BLOCKS);
+                        count = std::min(count, m_visit_nodes->size() - visit_index);
+                        blocks_begin = visit_index;
+                        blocks = load_blocks(visit_index, count);
+                    }
                     auto node = m_visit_nodes->at(visit_index);
                     // LOG_DEBUG << "Visiting node bitmap: " << node.bitmap 
                     //           << ", start: " << node.start 
                     //           << ", length: " << node.length 
                     //           << ", seed: " << node.seed 
                     //           << ", level: " << int(node.level);
-                    Binary data = m_fs->read(node.bitmap);
-                    
-                    white_node<RCAEncryptor> wnode(
-                        data, node.level, node.seed, node.start, node.length);
+                    Binary data = std::move(blocks[visit_index - blocks_begin]);
+                    // 块在load_blocks中已经解密，节点内容直接从块中拷贝到结果，不经过中间副本
+                    white_node<RCAEncryptor> wnode(data, node.start, node.length);
+                    auto payload = wnode.payload();
                     size_t read_size;
-                    if (wnode.data().size() - node_data_start < size_){
-                        read_size = wnode.data().size() - node_data_start;
-                        binary_data.append(wnode.data().read(node_data_start, read_size)); 
+                    if (payload.size() - node_data_start < size_){
+                        read_size = payload.size() - node_data_start;
+                        binary_data.append(payload.slice(node_data_start, read_size)); 
                         node_data_start = 0;
                     }else{
                         read_size = size_;
-                        binary_data.append(wnode.data().read(node_data_start, read_size)); 
+                        binary_data.append(payload.slice(node_data_start, read_size)); 
                         node_data_start = 0;
                         break;
                     }
@@ -263,16 +384,22 @@ namespace BwtFS::Node{
 
         void delete_file(){
             // 删除访问节点
-            for (auto& bitmap : delete_bitmap){
-                m_fs->bitmap->clear(bitmap);
-            }
+            std::vector<size_t> bitmaps(delete_bitmap.begin(), delete_bitmap.end());
             for (auto it = m_visit_nodes->begin(); it != m_visit_nodes->end(); ++it){
-                m_fs->bitmap->clear(it->bitmap);
+                bitmaps.push_back(it->bitmap);
             }
+            // 块先进入擦除队列，后台写入随机数据后才释放
+            m_fs->freeBlocks(bitmaps);
+            // 位图只在内存中修改，统一写回
+            m_fs->sync();
         }
 
         private:
+            // 一次批量读取的最大节点数
+            static constexpr size_t READ_BATCH_BLOCKS = 256;
             std::shared_ptr<BwtFS::System::FileSystem> m_fs;
+            // 除最后一个外每个白节点的数据字节数
+            size_t m_node_data_size = BwtFS::Util::CryptoEngine::getInstance().nodeDataSize();
             std::queue<entry> m_entry_queue;
             secure_ptr<std::vector<VisitNode>> m_visit_nodes = 
                     make_secure<std::vector<VisitNode>>();
@@ -283,55 +410,90 @@ namespace BwtFS::Node{
             void init(bool is_delete = false){
                 // LOG_DEBUG << "Init visit nodes";
                 while(!m_entry_queue.empty()){
-                    auto entry = m_entry_queue.front();
-                    m_entry_queue.pop();
-                    // LOG_DEBUG << "Entry bitmap: " << entry.get_bitmap() 
-                    //           << ", level: " << (int)entry.get_level() 
-                    //           << ", seed: " << entry.get_seed() 
-                    //           << ", start: " << entry.get_start() 
-                    //           << ", length: " << entry.get_length();
-                    Binary bd = m_fs->read(entry.get_bitmap());
-                    // LOG_DEBUG << "Read content: " << bd.to_base64_string();
-                    // LOG_DEBUG << "Read bitmap: " << entry.get_bitmap() 
-                    //           << ", size: " << bd.size();
-                    if(is_delete){
-                        delete_bitmap.push_back(entry.get_bitmap());
+                    // 同一层的黑节点一次批量读取，处理顺序与逐个出队一致
+                    std::vector<BwtFS::Node::entry> level;
+                    std::vector<size_t> bitmaps;
+                    while(!m_entry_queue.empty()){
+                        level.push_back(m_entry_queue.front());
+                        bitmaps.push_back(m_entry_queue.front().get_bitmap());
+                        m_entry_queue.pop();
                     }
-                    black_node<RCAEncryptor> node(
-                        bd, entry.get_level(), entry.get_seed(),
-                         entry.get_start(), entry.get_length());
-                    std::vector<BwtFS::Node::entry> entries;
-                    for (int i = 0; i < node.get_size_of_entry(); i++){
-                        auto e = node.get_entry(i);
-                        // LOG_DEBUG << "Black node entry bitmap: " << e.get_bitmap() 
-                        //           << ", level: " << (int)e.get_level() 
-                        //           << ", seed: " << e.get_seed() 
-                        //           << ", start: " << e.get_start() 
-                        //           << ", length: " << e.get_length();
-                        entries.push_back(e);
+                    auto level_blocks = m_fs->readBlocks(bitmaps);
+                    std::vector<BwtFS::Util::CryptoJob> jobs;
+                    jobs.reserve(level.size());
+                    for (size_t i = 0; i < level.size(); i++){
+                        jobs.push_back({{level_blocks[i].data(), level_blocks[i].size()}, bitmaps[i], level[i].get_seed(), level[i].get_level()});
                     }
-                    for (size_t i = 0; i < entries.size(); i++){
-                        auto e = entries[i];
-                        VisitNode node;
-                        node.bitmap = e.get_bitmap();
-                        if (node.bitmap <= 0){
-                            LOG_ERROR << "Bitmap is 0, entry: " << e.get_bitmap();
-                            throw std::runtime_error("Bitmap is 0");
+                    BwtFS::Util::CryptoEngine::getInstance().decrypt(jobs);
+                    for (size_t level_index = 0; level_index < level.size(); level_index++){
+                        auto entry = level[level_index];
+                        // LOG_DEBUG << "Entry bitmap: " << entry.get_bitmap() 
+                        //           << ", level: " << (int)entry.get_level() 
+                        //           << ", seed: " << entry.get_seed() 
+                        //           << ", start: " << entry.get_start() 
+                        //           << ", length: " << entry.get_length();
+                        Binary bd = std::move(level_blocks[level_index]);
+                        // LOG_DEBUG << "Read content: " << bd.to_base64_string();
+                        // LOG_DEBUG << "Read bitmap: " << entry.get_bitmap() 
+                        //           << ", size: " << bd.size();
+                        if(is_delete){
+                            delete_bitmap.push_back(entry.get_bitmap());
                         }
-                        node.start = e.get_start();
-                        node.length = e.get_length();
-                        node.seed = e.get_seed();
-                        node.level = e.get_level();
-                        if (e.get_type() == NodeType::BLACK_NODE){
-                            m_entry_queue.emplace(node.bitmap, NodeType::BLACK_NODE, 
-                                                    node.start, node.length, 
-                                                    node.seed, node.level);
-                        }else{
-                            m_visit_nodes->push_back(node);
+                        // 块在上面已经解密
+                        black_node<RCAEncryptor> node(bd, entry.get_start(), entry.get_length());
+                        std::vector<BwtFS::Node::entry> entries;
+                        for (int i = 0; i < node.get_size_of_entry(); i++){
+                            auto e = node.get_entry(i);
+                            // LOG_DEBUG << "Black node entry bitmap: " << e.get_bitmap() 
+                            //           << ", level: " << (int)e.get_level() 
+                            //           << ", seed: " << e.get_seed() 
+                            //           << ", start: " << e.get_start() 
+                            //           << ", length: " << e.get_length();
+                            entries.push_back(e);
+                        }
+                        for (size_t i = 0; i < entries.size(); i++){
+                            auto e = entries[i];
+                            VisitNode node;
+                            node.bitmap = e.get_bitmap();
+                            if (node.bitmap <= 0){
+                                LOG_ERROR << "Bitmap is 0, entry: " << e.get_bitmap();
+                                throw std::runtime_error("Bitmap is 0");
+                            }
+                            node.start = e.get_start();
+                            node.length = e.get_length();
+                            node.seed = e.get_seed();
+                            node.level = e.get_level();
+                            if (e.get_type() == NodeType::BLACK_NODE){
+                                m_entry_queue.emplace(node.bitmap, NodeType::BLACK_NODE, 
+                                                        node.start, node.length, 
+                                                        node.seed, node.level);
+                            }else{
+                                m_visit_nodes->push_back(node);
+                            }
                         }
                     }
                 }
             }
+
+            /*
+            * 批量读取从第from个访问节点开始的count个数据块，并行解密后返回
+            */
+            std::vector<Binary> load_blocks(size_t from, size_t count){
+                std::vector<size_t> bitmaps;
+                bitmaps.reserve(count);
+                for (size_t i = from; i < from + count; i++){
+                    bitmaps.push_back(m_visit_nodes->at(i).bitmap);
+                }
+                auto blocks = m_fs->readBlocks(bitmaps);
+                std::vector<BwtFS::Util::CryptoJob> jobs;
+                jobs.reserve(count);
+                for (size_t i = 0; i < count; i++){
+                    auto node = m_visit_nodes->at(from + i);
+                    jobs.push_back({{blocks[i].data(), blocks[i].size()}, node.bitmap, node.seed, node.level});
+                }
+                BwtFS::Util::CryptoEngine::getInstance().decrypt(jobs);
+                return blocks;
+            }
     };
     /*
     * 黑白树
@@ -362,7 +524,16 @@ namespace BwtFS::Node{
         public:
             bw_tree(){
                 m_thread_pool.submit([this]{
-                    this->generate_tree();
+                    try{
+                        this->generate_tree();
+                    }catch(const std::exception& e){
+                        // 任务的异常保存在未使用的future中，这里记录下来由join抛出
+                        LOG_ERROR << "Failed to generate tree: " << e.what();
+                        this->m_transaction_writer.set_write_finished(true);
+                        std::lock_guard<std::mutex> lock(m_error_mutex);
+                        m_error = std::current_exception();
+                        is_generate = true;
+                    }
                 });
                 m_thread_pool.submit([this]{
                     this->m_transaction_writer.write_fs();
@@ -397,13 +568,13 @@ namespace BwtFS::Node{
                 }
                 size_t used_size = 0;
                 while(size){
-                    size_t copy_size = std::min(size, SIZE_OF_NODE_DATA - m_cache_data->size);
+                    size_t copy_size = std::min(size, m_node_data_size - m_cache_data->size);
                     std::memcpy(m_cache_data->data + m_cache_data->size, data + used_size, copy_size);
                     size -= copy_size;
                     m_cache_data->size += copy_size;
                     used_size += copy_size;
                     // LOG_INFO << "copy_size: " << copy_size << ", size: " << size << ", m_cache_data->size: " << m_cache_data->size;
-                    if (m_cache_data->size == SIZE_OF_NODE_DATA){
+                    if (m_cache_data->size == m_node_data_size){
                         // LOG_INFO << std::string(reinterpret_cast<char*>(m_cache_data->data), SIZE_OF_NODE_DATA);
                         m_nodes.enqueue(m_cache_data);
                         this->get_node();
@@ -462,25 +633,58 @@ namespace BwtFS::Node{
                 black_node<RCAEncryptor>* bkn = new black_node<RCAEncryptor>(0);
                 constexpr size_t entry_num = BwtFS::BLOCK_SIZE / SIZE_OF_ENTRY;
                 constexpr int max_level = 1;
-                auto seeds = BwtFS::Util::RandNumbers<uint16_t>(entry_num, std::hash<std::queue<black_node<RCAEncryptor>*>*>{}(&bkn_queue), 1, 1 << 15);
-                auto levels = BwtFS::Util::RandNumbers<uint8_t>(entry_num, std::hash<std::vector<uint16_t>*>{}(&seeds), 1, 1 << max_level);
+                // seed和level参与生成节点的nonce，每次写入都从系统熵源取种子，不能由栈地址等可重复的值决定
+                std::random_device entropy;
+                auto seeds = BwtFS::Util::RandNumbers<uint16_t>(entry_num, entropy(), 1, 1 << 15);
+                auto levels = BwtFS::Util::RandNumbers<uint8_t>(entry_num, entropy(), 1, 1 << max_level);
                 uint16_t seed;
                 uint8_t level;
+                // 窗口用到的数组在各窗口间复用，稳定写入时不再分配
+                std::vector<TreeNode*> window;
+                std::vector<uint16_t> window_seeds;
+                std::vector<uint8_t> window_levels;
+                std::vector<size_t> window_bitmaps;
+                std::vector<WhiteNodeInfo> nodes;
+                std::vector<BwtFS::Util::CryptoJob> jobs;
+                window.reserve(entry_list::capacity());
+                window_seeds.reserve(entry_list::capacity());
+                window_levels.reserve(entry_list::capacity());
+                window_bitmaps.reserve(entry_list::capacity());
+                nodes.reserve(entry_list::capacity());
+                jobs.reserve(entry_list::capacity());
                 while(!is_write_finished() || !m_nodes.empty()){
                     while(!m_nodes.empty()){
-                        auto index = bkn->size();
-                        seed = seeds.back();
-                        level = levels.back();
-                        seeds.pop_back();
-                        levels.pop_back();
-                        if (seeds.empty()){
-                            seeds = BwtFS::Util::RandNumbers<uint16_t>(entry_num, std::hash<std::queue<black_node<RCAEncryptor>*>*>{}(&bkn_queue), 1, 1 << 15);
-                            levels = BwtFS::Util::RandNumbers<uint8_t>(entry_num, std::hash<std::vector<uint16_t>*>{}(&seeds), 1, 1 << max_level);
+                        // 一次取出当前黑节点剩余容量以内的白节点，并行生成和加密后按顺序写入
+                        window.clear();
+                        window_seeds.clear();
+                        window_levels.clear();
+                        window_bitmaps.clear();
+                        size_t capacity = entry_list::capacity() - bkn->size();
+                        TreeNode* tree_node;
+                        while(window.size() < capacity && m_nodes.dequeue(tree_node)){
+                            window.push_back(tree_node);
+                        }
+                        for (size_t i = 0; i < window.size(); i++){
+                            window_seeds.push_back(seeds.back());
+                            window_levels.push_back(levels.back());
+                            seeds.pop_back();
+                            levels.pop_back();
+                            if (seeds.empty()){
+                                seeds = BwtFS::Util::RandNumbers<uint16_t>(entry_num, entropy(), 1, 1 << 15);
+                                levels = BwtFS::Util::RandNumbers<uint8_t>(entry_num, entropy(), 1, 1 << max_level);
+                            }
+                        }
+                        for (size_t i = 0; i < window.size(); i++){
+                            window_bitmaps.push_back(m_transaction_writer.allocate());
+                        }
+                        get_nodes(window, bkn->size(), window_bitmaps, window_seeds, window_levels, nodes, jobs);
+                        for (size_t i = 0; i < nodes.size(); i++){
+                            seed = window_seeds[i];
+                            level = window_levels[i];
+                            m_transaction_writer.write(window_bitmaps[i], std::move(nodes[i].data));
+                            auto entry = generate_entry(window_bitmaps[i], nodes[i].start, nodes[i].length, seed, level, false);
+                            bkn->add_entry(entry);
                         }
-                        auto node = get_node(index, seed, level);
-                        auto bitmap = m_transaction_writer.write(node.data);
-                        auto entry = generate_entry(bitmap, node.start, node.length, seed, level, false);
-                        bkn->add_entry(entry);
                         if (bkn->is_fill()){
                             bkn_queue.push(bkn);
                             bkn = new black_node<RCAEncryptor>(0);
@@ -504,12 +708,11 @@ namespace BwtFS::Node{
                         seeds.pop_back();
                         levels.pop_back();
                         if (seeds.empty()){
-                            seeds = BwtFS::Util::RandNumbers<uint16_t>(entry_num, std::hash<std::queue<black_node<RCAEncryptor>*>*>{}(&bkn_queue), 1, 1 << 15);
-                            levels = BwtFS::Util::RandNumbers<uint8_t>(entry_num, std::hash<std::vector<uint16_t>*>{}(&seeds), 1, 1 << max_level);
+                            seeds = BwtFS::Util::RandNumbers<uint16_t>(entry_num, entropy(), 1, 1 << 15);
+                            levels = BwtFS::Util::RandNumbers<uint8_t>(entry_num, entropy(), 1, 1 << max_level);
                         }
                         bkn_tmp->set_index(bkn->size());
-                        auto binary_data = bkn_tmp->to_binary(seed, level);
-                        auto bitmap = m_transaction_writer.write(binary_data);
+                        auto bitmap = write_black_node(bkn_tmp, seed, level);
                         auto entry = generate_entry(bitmap, bkn_tmp->get_start(), bkn_tmp->get_length(), seed, level, true);
                         delete bkn_tmp;
                         bkn->add_entry(entry);
@@ -536,12 +739,11 @@ namespace BwtFS::Node{
                         seeds.pop_back();
                         levels.pop_back();
                         if (seeds.empty()){
-                            seeds = BwtFS::Util::RandNumbers<uint16_t>(entry_num, std::hash<std::queue<black_node<RCAEncryptor>*>*>{}(&bkn_queue), 1, 1 << 15);
-                            levels = BwtFS::Util::RandNumbers<uint8_t>(entry_num, std::hash<std::vector<uint16_t>*>{}(&seeds), 1, 1 << max_level);
+                            seeds = BwtFS::Util::RandNumbers<uint16_t>(entry_num, entropy(), 1, 1 << 15);
+                            levels = BwtFS::Util::RandNumbers<uint8_t>(entry_num, entropy(), 1, 1 << max_level);
                         }
                         bkn_tmp->set_index(bkn->size());
-                        auto binary_data = bkn_tmp->to_binary(seed, level);
-                        auto bitmap = m_transaction_writer.write(binary_data);
+                        auto bitmap = write_black_node(bkn_tmp, seed, level);
                         auto entry = generate_entry(bitmap, bkn_tmp->get_start(), bkn_tmp->get_length(), seed, level, true);
                         delete bkn_tmp;
                         bkn->add_entry(entry);
@@ -570,8 +772,7 @@ namespace BwtFS::Node{
                     bkn = bkn_queue_temp.front();
                     bkn_queue_temp.pop();
                 }
-                auto binary_data = bkn->to_binary(seed, level);
-                auto bitmap = m_transaction_writer.write(binary_data);
+                auto bitmap = write_black_node(bkn, seed, level);
                 // LOG_INFO << "Bitmap of token: " << bitmap;
                 
                 this->m_transaction_writer.set_write_finished(true);
@@ -594,10 +795,17 @@ namespace BwtFS::Node{
                 return is_generate;
             }
 
+            /*
+            * 等待树生成完成，生成失败时抛出异常
+            */
             void join(){
                 while(!is_generate){
                     std::this_thread::sleep_for(std::chrono::milliseconds(10));
                 }
+                std::lock_guard<std::mutex> lock(m_error_mutex);
+                if (m_error){
+                    std::rethrow_exception(m_error);
+                }
             }
 
             std::string get_token(){
@@ -609,10 +817,15 @@ namespace BwtFS::Node{
             safe_queue<TreeNode*> m_nodes;
             ThreadPool m_thread_pool = ThreadPool(BwtFS::SIZE::__THREAD_POOL_SIZE);
             TreeNode* m_cache_data = nullptr;
+            // 一个白节点存放的数据字节数，随卷的加密算法而定
+            size_t m_node_data_size = BwtFS::Util::CryptoEngine::getInstance().nodeDataSize();
             safe_vector<black_node<RCAEncryptor>*> m_black_nodes;
             bool write_finished = false;
             bool is_generate = false;
             std::mutex m_write_finish_mutex;
+            // 生成树失败时的异常
+            std::exception_ptr m_error;
+            std::mutex m_error_mutex;
             TransactionWriter m_transaction_writer;
             TreeDataReader* m_tree_data_reader = nullptr;
             std::string m_token;
@@ -629,28 +842,57 @@ namespace BwtFS::Node{
             WhiteNodeInfo get_node(int index){
                 if (m_nodes.empty()){
                     LOG_ERROR << "No available nodes in the pool";
-                    return {Binary(), 0, 0};
+                    return {BlockBuffer(), 0, 0};
                 }
                 TreeNode* node;
                 m_nodes.dequeue(node);
                 auto wnb = Binary(reinterpret_cast<std::byte*>(node->data), node->size);
                 auto wn = white_node<void>(wnb, index);
-                auto binary_data = wn.to_binary();
+                BlockBuffer block;
+                wn.to_block(block);
                 m_memory_pool.destroy(node);
-                return {binary_data, wn.get_start(), wn.get_length()};
+                return {std::move(block), wn.get_start(), wn.get_length()};
             }
-            WhiteNodeInfo get_node(int index, unsigned seed, uint8_t level){
-                if (m_nodes.empty()){
-                    LOG_ERROR << "No available nodes in the pool";
-                    return {Binary(), 0, 0};
+            /*
+            * 批量生成加密的白节点，结果写入infos，jobs为复用的加密任务数组
+            * 第i个节点的索引为first_index+i，写入bitmaps[i]块，生成（含随机填充）和加密都分到加解密服务的线程上
+            * 节点直接从内存池中的文件数据组装到块缓冲区，原地加密，不经过中间的Binary
+            */
+            void get_nodes(const std::vector<TreeNode*>& nodes, size_t first_index,
+                           const std::vector<size_t>& bitmaps,
+                           const std::vector<uint16_t>& seeds, const std::vector<uint8_t>& levels,
+                           std::vector<WhiteNodeInfo>& infos, std::vector<BwtFS::Util::CryptoJob>& jobs){
+                infos.resize(nodes.size());
+                auto& crypto = BwtFS::Util::CryptoEngine::getInstance();
+                auto build = [&](size_t begin, size_t end){
+                    for (size_t i = begin; i < end; i++){
+                        auto wn = white_node<RCAEncryptor>(BinaryView(nodes[i]->data, nodes[i]->size),
+                                                           static_cast<uint8_t>(first_index + i));
+                        wn.to_block(infos[i].data);
+                        infos[i].start = wn.get_start();
+                        infos[i].length = wn.get_length();
+                    }
+                };
+                // 按引用传入，std::function不为捕获分配内存
+                crypto.parallel(nodes.size(), std::ref(build));
+                jobs.clear();
+                for (size_t i = 0; i < nodes.size(); i++){
+                    jobs.push_back({infos[i].data.span(), bitmaps[i], seeds[i], levels[i]});
+                    m_memory_pool.destroy(nodes[i]);
                 }
-                TreeNode* node;
-                m_nodes.dequeue(node);
-                auto wnb = Binary(reinterpret_cast<std::byte*>(node->data), node->size);
-                auto wn = white_node<RCAEncryptor>(wnb, index);
-                auto binary_data = wn.to_binary(seed, level);
-                m_memory_pool.destroy(node);
-                return {binary_data, wn.get_start(), wn.get_length()};
+                crypto.encrypt(jobs);
+            }
+            /*
+            * 分配块，加密黑节点后写入，返回块的索引
+            */
+            size_t write_black_node(black_node<RCAEncryptor>* node, uint16_t seed, uint8_t level){
+                auto bitmap = m_transaction_writer.allocate();
+                BlockBuffer block;
+                node->to_block(block);
+                std::vector<BwtFS::Util::CryptoJob> jobs{{block.span(), bitmap, seed, level}};
+                BwtFS::Util::CryptoEngine::getInstance().encrypt(jobs);
+                m_transaction_writer.write(bitmap, std::move(block));
+                return bitmap;
             }
             /*
             * 生成entry
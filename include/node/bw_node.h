@@ -12,10 +12,14 @@
 #include <cstdlib>   
 #include <climits>     
 #include <iostream> 
+#include <random>
+#include <thread>
 #include "binary.h"
+#include "block_buffer.h"
 #include "util/secure_ptr.h"
 #include "util/random.h"
 #include "util/cell.h"
+#include "util/crypto_engine.h"
 #include "entry.h"
 #include "config.h"
 #include "util/log.h"
@@ -24,28 +28,39 @@ using BwtFS::Util::Logger;
 
 namespace BwtFS::Node{
 
+    // 节点随机填充使用的发生器，每个线程一个，不用于加密
+    inline BwtFS::Util::FastRandom& padding_random(){
+        thread_local BwtFS::Util::FastRandom rng(std::random_device{}() ^ std::hash<std::thread::id>{}(std::this_thread::get_id()));
+        return rng;
+    }
+
+    // 不持有数据的节点共享的空内容，避免每个节点都分配
+    inline const Binary& empty_node_value(){
+        static const Binary value;
+        return value;
+    }
+
     template<typename E = Encryptor>
     class tree_base_node{
         public:
+            // ChaCha20需要卷的密钥和按块生成的nonce，只能通过CryptoEngine使用，默认构造会得到全零的密钥
+            static_assert(!std::is_same<E, ChaCha20Encryptor>::value, "ChaCha20Encryptor must be used through CryptoEngine");
             // 加密的构造函数
             tree_base_node(Binary value, uint8_t level, unsigned seed, unsigned start, unsigned length)
              : m_value(value), start(start), length(length){
                 E e;
                 // if constexpr (E::value == "RCAEncryptor") {
                 if constexpr (std::is_same<E, RCAEncryptor>::value) {
-                    auto seeds = BwtFS::Util::RandNumbers<uint16_t>(level, seed, 0, 1<<15);
-                    std::reverse(seeds.begin(), seeds.end());
+                    auto seeds = BwtFS::Util::CryptoEngine::levelSeeds(seed, level);
                     // LOG_DEBUG << "Decrypting with level: " << int(level) << ", seed: " << seed;
-                    for (int i = 0; i < level; i++) {
-                        E e;
-                        e.setBinary(m_value);
-                        e.setSeed(seeds[i]);
-                        e.decrypt(m_value.data(), m_value.size());
-                    }
+                    // 按加密的相反顺序逐层解密，各层在同一遍中完成
+                    BwtFS::Util::RCA::backwardLevels(m_value, seeds);
                 }else{
                     e.decrypt(m_value.data(), m_value.size());
                 }
              }
+            // 不解密，直接使用value
+            explicit tree_base_node(const Binary& value) : m_value(value) {}
             tree_base_node() = default;
         protected:
             Binary m_value; // 节点内容
@@ -61,6 +76,7 @@ namespace BwtFS::Node{
             // 未加密数据的构造函数
             tree_base_node(Binary value, unsigned start, unsigned length)
              : m_value(value), start(start), length(length) {}
+            explicit tree_base_node(const Binary& value) : m_value(value) {}
             tree_base_node() = default;
         protected:
             Binary m_value; // 节点内容
@@ -75,54 +91,78 @@ namespace BwtFS::Node{
 
             white_node(Binary value, uint8_t level, uint16_t seed, uint16_t start, uint16_t length)
              : tree_base_node<E>(value, level, seed, start, length) {
-                this->index = *reinterpret_cast<uint8_t*>(value.read(0, sizeof(uint8_t)).data());
-                this->m_value = Binary(value.read(start, length));
+                this->index = static_cast<uint8_t>(value.get(0));
+                this->m_payload = value.slice(start, length);
              }
 
             white_node(Binary value, uint16_t start, uint16_t length) {
                 // LOG_DEBUG << "start: " << start << ", length: " << length;
-                this->index = *reinterpret_cast<uint8_t*>(value.read(0, sizeof(uint8_t)).data());
+                this->index = static_cast<uint8_t>(value.get(0));
                 // LOG_DEBUG << "index: " << this->index;
-                this->m_value = Binary(value.read(start, length));
+                // 节点内容直接引用块中的数据，不拷贝
+                this->m_payload = value.slice(start, length);
              }
 
             white_node(Binary& data, uint8_t index){
                 this->index = index;
                 this->m_value = data;
+                this->m_payload = this->m_value.view();
                 this->length = this->m_value.size();
                 this->start = 0;
             }
 
+            // 直接引用data（如内存池中的文件数据），不拷贝，调用者保证节点使用期间数据有效
+            white_node(const BinaryView& data, uint8_t index) : tree_base_node<E>(empty_node_value()) {
+                this->index = index;
+                this->m_payload = data;
+                this->m_borrowed = true;
+                this->length = data.size();
+                this->start = 0;
+            }
+
             white_node() = delete;
 
-            Binary data() const { return this->m_value; }
+            // 节点内容的拷贝
+            Binary data() const { return this->m_payload.to_binary(); }
+            // 节点内容的视图，与所在的块共享数据
+            BinaryView payload() const { return this->m_payload; }
+
+            /*
+            * 在block中组装整个块：索引、随机长度的填充、节点内容、随机填充至BLOCK_SIZE
+            * 节点内容的起始位置记录在start中，块末尾留给加密算法的部分不放节点内容
+            */
+            void to_block(BlockBuffer& block) {
+                auto& rng = padding_random();
+                size_t capacity = BwtFS::Util::CryptoEngine::getInstance().nodeDataSize();
+                if (this->m_payload.size() > capacity){
+                    LOG_ERROR << "White node too large: " << this->m_payload.size() << " > " << capacity;
+                    throw std::runtime_error(std::string("White node too large: ") + __FILE__ + ":" + std::to_string(__LINE__));
+                }
+                block.clear();
+                block.append(reinterpret_cast<std::byte*>(&this->index), sizeof(uint8_t));
+                size_t gap = capacity - this->m_payload.size();
+                size_t rand = rng.next() % (gap + 1);
+                rng.fill(block.extend(rand), rand);
+                this->start = block.size();
+                block.append(this->m_payload);
+                size_t tail = BwtFS::BLOCK_SIZE - block.size();
+                rng.fill(block.extend(tail), tail);
+                // LOG_INFO << "Block size: " << block.size() << ", start: " << this->start << ", length: " << this->length;
+            }
 
             Binary to_binary() {
-                Binary binary_data;
-                binary_data.append(sizeof(uint8_t), reinterpret_cast<std::byte*>(&this->index));
-                unsigned gap = BwtFS::BLOCK_SIZE - sizeof(uint8_t) - this->m_value.size();
-                int rand = BwtFS::Util::RandNumber(std::time(nullptr), 0, gap);
-                binary_data += Binary(BwtFS::Util::RandBytes(rand, std::time(nullptr), 0, 255));
-                this->start = binary_data.size();
-                binary_data += std::move(this->m_value);
-                binary_data += Binary(BwtFS::Util::RandBytes(BwtFS::BLOCK_SIZE - binary_data.size(), std::time(nullptr), 0, 255));
-                // LOG_INFO << binary_data.to_ascll_string();
-                // LOG_INFO << "Binary data size: " << binary_data.size() << ", start: " << this->start << ", length: " << this->length;
-                return binary_data;
+                BlockBuffer block;
+                this->to_block(block);
+                return block.to_binary();
             }
 
             Binary to_binary(uint16_t seed, uint8_t level) {
                 Binary binary_data = this->to_binary();
                 // LOG_INFO << binary_data.to_ascll_string();
-                auto seeds = BwtFS::Util::RandNumbers<uint16_t>(level, seed, 0, 1<<15);
+                auto seeds = BwtFS::Util::CryptoEngine::levelSeeds(seed, level);
                 // if constexpr (E::value == "RCAEncryptor") {
                 if constexpr (std::is_same<E, RCAEncryptor>::value) {
-                    for (int i = 0; i < level; i++) {
-                        E e;
-                        e.setBinary(binary_data);
-                        e.setSeed(seeds[i]);
-                        e.encrypt(binary_data.data(), binary_data.size());
-                    }
+                    BwtFS::Util::RCA::forwardLevels(binary_data, seeds);
                 }else{
                     E e;
                     e.encrypt(binary_data.data(), binary_data.size());
@@ -131,12 +171,16 @@ namespace BwtFS::Node{
             }
 
             void set_data(Binary value) {
-                this->m_value.write(value);
+                this->own_();
+                this->m_value.write(value.read());
+                this->m_payload = this->m_value.view();
                 this->length = value.size();
             }
 
             void append_data(Binary value) {
-                this->m_value.append(value);
+                this->own_();
+                this->m_value.append(value.view());
+                this->m_payload = this->m_value.view();
                 this->length += value.size();
             }
 
@@ -155,8 +199,25 @@ namespace BwtFS::Node{
             void set_index(uint8_t index) {
                 this->index = index;
             }
+
+        private:
+            // 内容引用外部数据时先拷贝一份，之后才能修改
+            void own_() {
+                if (this->m_borrowed){
+                    this->m_value = this->m_payload.to_binary();
+                    this->m_borrowed = false;
+                }
+            }
+
+            BinaryView m_payload;
+            // m_payload是否引用外部数据
+            bool m_borrowed = false;
     };
 
+    // 满的entry列表加上索引、entry个数和nonce仍放得下一个块
+    static_assert(2 * sizeof(uint8_t) + entry_list::capacity() * SIZE_OF_ENTRY + BwtFS::Util::CHACHA20_NONCE_TRAILER <= BwtFS::BLOCK_SIZE,
+                  "a full black node leaves no room for the ChaCha20 nonce");
+
     template<typename E>
     class black_node : public tree_base_node<E>{
         public:
@@ -169,27 +230,27 @@ namespace BwtFS::Node{
                 
                 
                 
-                this->index = *reinterpret_cast<uint8_t*>(value.read(0, sizeof(uint8_t)).data());
-                this->size_of_entry = *reinterpret_cast<uint8_t*>(value.read(sizeof(uint8_t), sizeof(uint8_t)).data());
+                this->index = static_cast<uint8_t>(value.get(0));
+                this->size_of_entry = static_cast<uint8_t>(value.get(sizeof(uint8_t)));
                 // LOG_DEBUG << "level: " << int(level) << ", seed: " << seed;
                 // LOG_DEBUG << "Original size_of_entry: " << int(this->size_of_entry);
                 // validate_and_correct_size_of_entry(length);
                 // LOG_DEBUG << "Validated size_of_entry: " << int(this->size_of_entry);
-                this->m_value = Binary(value.read(start, length));
+                this->m_payload = value.slice(start, length);
                 // this->size_of_entry = length/entry::size();
                 BwtFS::Node::entry_list entry_data;
                 // LOG_DEBUG << "start: " << start << ", length: " << length
-                //           << ", value size: " << this->m_value.size()
+                //           << ", value size: " << this->m_payload.size()
                 //           << ", entry size: " << length/entry::size()
                 //           << ", size_of_entry: " << int(this->size_of_entry);
-                if (this->m_value.size() < length) {
-                    LOG_ERROR << "Insufficient data: m_value size (" << this->m_value.size()
+                if (this->m_payload.size() < length) {
+                    LOG_ERROR << "Insufficient data: payload size (" << this->m_payload.size()
                              << ") is less than requested length (" << length << ")";
                 }
                 if (this->size_of_entry == 0){
-                    entry_data = entry_list::from_binary(this->m_value, length/entry::size());
+                    entry_data = entry_list::from_binary(this->m_payload, length/entry::size());
                 }else{
-                    entry_data = entry_list::from_binary(this->m_value, this->size_of_entry);
+                    entry_data = entry_list::from_binary(this->m_payload, this->size_of_entry);
                 }
                 // LOG_DEBUG << "entry_data size: " << entry_data.size();
                 for (size_t i = 0; i < entry_data.size(); i++) {
@@ -201,20 +262,21 @@ namespace BwtFS::Node{
             black_node(Binary value, uint16_t start, uint16_t length)
              : m_entry_list(make_secure<entry_list>()) {
                 this->length = 0;
-                this->index = *reinterpret_cast<uint8_t*>(value.read(0, sizeof(uint8_t)).data());
-                this->size_of_entry = *reinterpret_cast<uint8_t*>(value.read(sizeof(uint8_t), sizeof(uint8_t)).data());
+                this->index = static_cast<uint8_t>(value.get(0));
+                this->size_of_entry = static_cast<uint8_t>(value.get(sizeof(uint8_t)));
                 // LOG_DEBUG << "Constructor2 - Original size_of_entry: " << int(this->size_of_entry);
                 validate_and_correct_size_of_entry(length);
                 // LOG_DEBUG << "Constructor2 - Validated size_of_entry: " << int(this->size_of_entry);
-                this->m_value = Binary(value.read(start, length));
+                // entry直接从块中解码，不拷贝
+                this->m_payload = value.slice(start, length);
                 // LOG_DEBUG << "start: " << start << ", length: " << length << ", value: " << length/entry::size();
                 BwtFS::Node::entry_list entry_data;
                 if (this->size_of_entry == 0){
-                    entry_data = entry_list::from_binary(this->m_value, length/entry::size());
+                    entry_data = entry_list::from_binary(this->m_payload, length/entry::size());
                 }else{
-                    entry_data = entry_list::from_binary(this->m_value, this->size_of_entry);
+                    entry_data = entry_list::from_binary(this->m_payload, this->size_of_entry);
                 }
-                for (int i = 0; i < entry_data.size(); i++) {
+                for (size_t i = 0; i < entry_data.size(); i++) {
                     this->m_entry_list->add_entry(entry_data.get_entry(i));
                 }
             }
@@ -222,10 +284,11 @@ namespace BwtFS::Node{
             black_node(Binary& data, uint8_t index) : m_entry_list(make_secure<entry_list>()){
                 this->index = index;
                 this->m_value = data;
+                this->m_payload = this->m_value.view();
                 this->length = this->m_value.size();
                 this->start = 0;
-                auto entry_data = entry_list::from_binary(this->m_value, this->length/entry::size());
-                for (int i = 0; i < entry_data.size(); i++) {
+                auto entry_data = entry_list::from_binary(this->m_payload, this->length/entry::size());
+                for (size_t i = 0; i < entry_data.size(); i++) {
                     this->m_entry_list->add_entry(entry_data.get_entry(i));
                 }
             }
@@ -237,39 +300,50 @@ namespace BwtFS::Node{
                 this->index = index;
             };
 
-            Binary data() const { return this->m_value; }
+            // 节点内容的拷贝
+            Binary data() const { return this->m_payload.to_binary(); }
+            // 节点内容的视图，与所在的块共享数据
+            BinaryView payload() const { return this->m_payload; }
+
+            /*
+            * 在block中组装整个块：索引、entry个数、随机长度的填充、entry列表、随机填充至BLOCK_SIZE
+            * entry列表的起始位置记录在start中
+            */
+            void to_block(BlockBuffer& block) {
+                auto& rng = padding_random();
+                block.clear();
+                block.append(reinterpret_cast<std::byte*>(&this->index), sizeof(uint8_t));
+                block.append(reinterpret_cast<std::byte*>(&this->size_of_entry), sizeof(uint8_t));
+                // LOG_INFO << "index: " << int(this->index) << ", size_of_entry: " << int(this->size_of_entry);
+                // entry列表直接序列化到块中
+                size_t entry_size = m_entry_list->size() * entry::size();
+                size_t gap = BwtFS::BLOCK_SIZE - sizeof(uint8_t) - sizeof(uint8_t) - entry_size
+                                - BwtFS::Util::CryptoEngine::getInstance().trailerSize();
+                size_t rand = rng.next() % (gap + 1);
+                rng.fill(block.extend(rand), rand);
+                this->start = block.size();
+                m_entry_list->write(block.extend(entry_size));
+                size_t tail = BwtFS::BLOCK_SIZE - block.size();
+                rng.fill(block.extend(tail), tail);
+            }
 
             Binary to_binary() {
-                Binary binary_data;
-                binary_data.append(sizeof(uint8_t), reinterpret_cast<std::byte*>(&this->index));
-                binary_data.append(sizeof(uint8_t), reinterpret_cast<std::byte*>(&this->size_of_entry));
-                // LOG_INFO << "index: " << int(this->index) << ", size_of_entry: " << int(this->size_of_entry);
-                Binary entry_data = m_entry_list->to_binary();
-                unsigned gap = BwtFS::BLOCK_SIZE - sizeof(uint8_t) - sizeof(uint8_t) - entry_data.size();
-                int rand = BwtFS::Util::RandNumber(std::time(nullptr), 0, gap);
-                binary_data += Binary(BwtFS::Util::RandBytes(rand, std::time(nullptr), 0, 255));
-                this->start = binary_data.size();
-                binary_data += std::move(entry_data);
-                binary_data += Binary(BwtFS::Util::RandBytes(BwtFS::BLOCK_SIZE - binary_data.size(), std::time(nullptr), 0, 255));
-                return binary_data;
+                BlockBuffer block;
+                this->to_block(block);
+                return block.to_binary();
             }
 
             Binary to_binary(uint16_t seed, uint8_t level) {
                 Binary binary_data = this->to_binary();
                 // LOG_DEBUG << "seed: " << seed << ", level: " << int(level);
-                auto seeds = BwtFS::Util::RandNumbers<uint16_t>(level, seed, 0, 1<<15);
+                auto seeds = BwtFS::Util::CryptoEngine::levelSeeds(seed, level);
 
                 
                 // LOG_DEBUG << "de Content before encryption: " << binary_data.to_base64_string();
                 
                 // if constexpr (E::value == "RCAEncryptor") {
                 if constexpr (std::is_same<E, RCAEncryptor>::value) {
-                    for (int i = 0; i < level; i++) {
-                        E e;
-                        e.setBinary(binary_data);
-                        e.setSeed(seeds[i]);
-                        e.encrypt(binary_data.data(), binary_data.size());
-                    }
+                    BwtFS::Util::RCA::forwardLevels(binary_data, seeds);
                 }else{
                     E e;
                     e.encrypt(binary_data.data(), binary_data.size());
@@ -333,6 +407,7 @@ namespace BwtFS::Node{
 
             secure_ptr<BwtFS::Node::entry_list> m_entry_list;
             uint8_t size_of_entry = 0;
+            BinaryView m_payload;
     };
 
     // 打开文件时使用secure_ptr
@@ -37,7 +37,11 @@ namespace BwtFS::Node{
             inline uint16_t get_seed() const { return seed; }
             inline uint8_t get_level() const { return level; }
             Binary to_binary();
+            // 序列化到out开始的entry::size()个字节，与to_binary的格式相同
+            void write(std::byte* out) const;
             static entry from_binary(Binary& binary_data);
+            // 从视图中解码，不拷贝数据
+            static entry from_binary(const BinaryView& binary_data);
             static inline size_t size() {
                 return sizeof(size_t) + sizeof(bool) + sizeof(uint16_t) + sizeof(uint16_t) + sizeof(uint16_t) + sizeof(uint8_t);
             }
@@ -65,7 +69,12 @@ namespace BwtFS::Node{
             }
 
             inline bool is_fill() const {
-                return entries.size() >= (BwtFS::BLOCK_SIZE - sizeof(uint8_t)) / SIZE_OF_ENTRY;
+                return entries.size() >= capacity();
+            }
+
+            // 一个黑节点最多容纳的entry数
+            static constexpr size_t capacity() {
+                return (BwtFS::BLOCK_SIZE - sizeof(uint8_t)) / SIZE_OF_ENTRY;
             }
 
             inline entry get_entry(size_t index) {
@@ -80,8 +89,12 @@ namespace BwtFS::Node{
             }
 
             static entry_list from_binary(Binary& binary_data, int num_entries);
+            // 从视图中解码，不拷贝数据
+            static entry_list from_binary(const BinaryView& binary_data, int num_entries);
 
             Binary to_binary();
+            // 依次序列化所有entry到out，共size()*entry::size()个字节
+            void write(std::byte* out) const;
 
             void shuffle() {
                 std::shuffle(entries.begin(), entries.end(), std::mt19937(std::random_device()()));
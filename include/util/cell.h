@@ -2,6 +2,8 @@
 # define CELL_H
 #include<vector>
 #include <random>
+#include <cstdint>
+#include <span>
 #include "node/binary.h"
 
 namespace BwtFS::Util{
@@ -9,6 +11,10 @@ namespace BwtFS::Util{
     * Cell类
     * 可逆细胞自动机
     * 用于细胞自动机的操作
+    * 每种操作都是字节上的固定置换，预先展开为256项的查找表
+    * x86-64上CPU支持AVX2或SSE4.1时按半字节查表（pshufb）一次变换32或16个字节，否则逐字节查表
+    * 几种实现结果一致，运行时自动选择
+    * 多层加密时各层在同一遍中依次作用于每个字节，数据只读写一遍
     * @author: zaoweiceng
     * @data: 2025-03-26
     * */
@@ -46,6 +52,17 @@ namespace BwtFS::Util{
             static void TD_BACK(std::byte& b);
             //应用操作
             static void apply(std::byte& b, short operation, bool forward);
+            // 多层前向迭代：依次用seeds中的每个种子前向迭代，与逐层调用forward的结果一致
+            static void forwardLevels(BwtFS::Node::Binary& binary, std::span<const uint16_t> seeds);
+            // 多层反向迭代：forwardLevels的逆，按相反顺序用seeds中的种子反向迭代
+            static void backwardLevels(BwtFS::Node::Binary& binary, std::span<const uint16_t> seeds);
+            // 同上，直接变换一段内存
+            static void forwardLevels(std::span<std::byte> data, std::span<const uint16_t> seeds);
+            static void backwardLevels(std::span<std::byte> data, std::span<const uint16_t> seeds);
+            // 按规则变换data的前size个字节，rule按2位压缩，第i个字节的操作（0~3）在rule[i/4]的第2*(i%4)位起
+            static void transform(std::byte* data, const uint8_t* rule, size_t size, bool forward);
+            // 是否使用SIMD实现
+            static bool simd();
             // 设置细胞自动机的种子
             void setSeed(unsigned seed);
             // 设置细胞自动机的二进制数据
@@ -57,8 +74,11 @@ namespace BwtFS::Util{
             unsigned seed;
             // 细胞自动机的二进制数据
             BwtFS::Node::Binary binary;
-            // 细胞自动机的规则
-            std::vector<int> rule;
+            // 细胞自动机的规则（按2位压缩）
+            std::vector<uint8_t> rule;
+
+            // 由种子生成规则
+            void make_rule_();
     };
 };
 
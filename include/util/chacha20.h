@@ -0,0 +1,21 @@
+#ifndef CHACHA20_H
+#define CHACHA20_H
+#include <array>
+#include <cstddef>
+#include <cstdint>
+namespace BwtFS::Util{
+    /*
+    * ChaCha20流密码（RFC 8439，32位计数器、96位nonce）
+    * x86-64上CPU支持AVX2时一次计算两个64字节的密钥流块，否则使用标量实现
+    * 两种实现结果一致，运行时自动选择
+    */
+    using ChaCha20Key = std::array<uint8_t, 32>;
+    using ChaCha20Nonce = std::array<uint8_t, 12>;
+
+    // 用密钥流异或data的前size个字节，加密和解密相同；counter为第一个密钥流块的计数
+    void chacha20(std::byte* data, size_t size, const ChaCha20Key& key, const ChaCha20Nonce& nonce, uint32_t counter = 0);
+    // 是否使用SIMD实现
+    bool chacha20Simd();
+};
+
+#endif
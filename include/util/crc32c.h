@@ -0,0 +1,17 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+#include <cstddef>
+#include <cstdint>
+namespace BwtFS::Util{
+    /*
+    * CRC32C（Castagnoli）校验
+    * x86-64上CPU支持SSE4.2时使用crc32指令，否则使用查表（slicing-by-8）实现
+    * 两种实现结果一致，运行时自动选择
+    */
+    // 计算data前size个字节的CRC32C，crc为上一段的结果，用于分段计算
+    uint32_t crc32c(const std::byte* data, size_t size, uint32_t crc = 0);
+    // 是否使用硬件指令
+    bool crc32cHardware();
+};
+
+#endif
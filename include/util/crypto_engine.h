@@ -0,0 +1,94 @@
+#ifndef CRYPTO_ENGINE_H
+#define CRYPTO_ENGINE_H
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <vector>
+#include "node/binary.h"
+#include "util/chacha20.h"
+#include "util/thread_pool.h"
+
+namespace BwtFS::Util{
+    // 节点加密算法，数值记录在超级块中
+    enum class Cipher : uint8_t{
+        RCA = 0,        // 元胞自动机，按seed和level逐层变换
+        CHACHA20 = 1    // ChaCha20，密钥存放在超级块中，每次写入的nonce明文保存在块末尾
+    };
+
+    // ChaCha20节点块末尾保存nonce的字节数（版本5起），这部分不加密，节点内容不能占用
+    constexpr size_t CHACHA20_NONCE_TRAILER = sizeof(ChaCha20Nonce);
+
+    // 一个加解密任务：data原地变换（Binary或BlockBuffer中的数据），bitmap为节点所在的块，seed和level与节点entry中的相同
+    // ChaCha20（版本5起）时data为整个块，加密时在末尾写入nonce，解密时从末尾读取
+    struct CryptoJob{
+        std::span<std::byte> data;
+        size_t bitmap;
+        uint16_t seed;
+        uint8_t level;
+    };
+
+    /*
+    * 批量加解密服务
+    * 进程内共享一个线程池，把一批节点的加解密分到各个线程上，调用线程也参与计算
+    * 写入时黑白树按窗口批量生成并加密白节点，读取时一次解密范围读取涉及的所有块
+    * 线程数由crypto_threads配置，0表示使用CPU核数
+    * 加密算法随卷记录，打开文件系统时通过setCipher设置，默认为RCA
+    */
+    class CryptoEngine{
+        public:
+            static CryptoEngine& getInstance();
+            CryptoEngine(const CryptoEngine& other) = delete;
+            CryptoEngine& operator=(const CryptoEngine& other) = delete;
+            CryptoEngine(CryptoEngine&& other) = delete;
+            CryptoEngine& operator=(CryptoEngine&& other) = delete;
+            ~CryptoEngine();
+
+            // 并行加密一批任务
+            void encrypt(std::vector<CryptoJob>& jobs);
+            // 并行解密一批任务
+            void decrypt(std::vector<CryptoJob>& jobs);
+            // 把[0, count)切分为连续的几段并行执行fn(begin, end)，全部完成后返回
+            // 任务抛出异常时等待其余任务结束后抛出第一个异常
+            void parallel(size_t count, const std::function<void(size_t, size_t)>& fn);
+            // 参与计算的线程数（含调用线程）
+            size_t threads() const;
+            // 节点各层的种子，加密时按顺序使用，解密时按相反顺序使用
+            static std::vector<uint16_t> levelSeeds(uint16_t seed, uint8_t level);
+            // 同上，写入out的前level个元素，不分配内存
+            static void levelSeeds(uint16_t seed, uint8_t level, std::span<uint16_t> out);
+            // 设置当前卷的加密算法和密钥，RCA不使用密钥
+            // legacy_nonce为true时ChaCha20沿用版本4的nonce（由bitmap、seed、level生成，块末尾不保存nonce）
+            // 每次设置时重新随机选取nonce的前缀和计数起点
+            void setCipher(Cipher cipher, const ChaCha20Key& key = {}, bool legacy_nonce = false);
+            Cipher cipher() const;
+            // 节点块末尾留给加密算法的字节数，只有版本5起的ChaCha20卷不为0
+            size_t trailerSize() const;
+            // 一个白节点能存放的数据字节数：块大小减去节点编号和加密算法的尾部
+            size_t nodeDataSize() const;
+            // 算法名称与枚举的转换，名称不合法时抛出异常
+            static Cipher parseCipher(const std::string& name);
+            static std::string cipherName(Cipher cipher);
+
+        private:
+            CryptoEngine();
+            mutable std::mutex cipher_mutex;
+            Cipher current_cipher = Cipher::RCA;
+            ChaCha20Key key{};
+            bool legacy_nonce = false;
+            std::atomic<size_t> trailer{0};
+            // ChaCha20的nonce：前缀(4字节) | 计数(8字节)，每个块取一个计数
+            // 前缀和计数起点在每次打开卷时随机选取，同一次打开内计数不重复
+            uint32_t nonce_prefix = 0;
+            std::atomic<uint64_t> nonce_counter{0};
+            // 工作线程，线程数为1时为空，所有任务在调用线程执行
+            std::unique_ptr<ThreadPool> pool;
+            size_t workers;
+    };
+};
+
+#endif
@@ -59,6 +59,19 @@ namespace BwtFS{
                     {"path", BwtFS::DefaultConfig::SYSTEM_FILE_PATH}, 
                     {"size", std::to_string(BwtFS::DefaultConfig::SYSTEM_FILE_SIZE)}, 
                     {"prefix", BwtFS::DefaultConfig::SYSTEM_FILE_PREFIX},
+                    {"io_mode", BwtFS::DefaultConfig::SYSTEM_FILE_IO_MODE},
+                    {"mmap_populate", BwtFS::DefaultConfig::SYSTEM_FILE_MMAP_POPULATE ? "true" : "false"},
+                    {"mmap_advice", BwtFS::DefaultConfig::SYSTEM_FILE_MMAP_ADVICE},
+                    {"io_engine", BwtFS::DefaultConfig::SYSTEM_FILE_IO_ENGINE},
+                    {"io_queue_depth", std::to_string(BwtFS::DefaultConfig::SYSTEM_FILE_IO_QUEUE_DEPTH)},
+                    {"create_threads", std::to_string(BwtFS::DefaultConfig::SYSTEM_FILE_CREATE_THREADS)},
+                    {"sparse", BwtFS::DefaultConfig::SYSTEM_FILE_SPARSE ? "true" : "false"},
+                    {"sparse_fill_rate", std::to_string(BwtFS::DefaultConfig::SYSTEM_FILE_SPARSE_FILL_RATE)},
+                    {"stripe_members", BwtFS::DefaultConfig::SYSTEM_FILE_STRIPE_MEMBERS},
+                    {"journal_blocks", std::to_string(BwtFS::DefaultConfig::SYSTEM_FILE_JOURNAL_BLOCKS)},
+                    {"scrub_rate", std::to_string(BwtFS::DefaultConfig::SYSTEM_FILE_SCRUB_RATE)},
+                    {"crypto_threads", std::to_string(BwtFS::DefaultConfig::SYSTEM_FILE_CRYPTO_THREADS)},
+                    {"cipher", BwtFS::DefaultConfig::SYSTEM_FILE_CIPHER},
                     {"filesystem_structure_json", BwtFS::DefaultConfig::FILESYSTEM_STRUCTURE_JSON}
                 }},
                 {"server", { 
@@ -32,16 +32,18 @@ protected:
         size_t size;  // 内存块大小
     };
 
-    MemoryPoolBase(size_t blockSize, size_t initialSize)
-        : blockSize_(std::max(blockSize, sizeof(FreeNode))),
+    // alignment: 每个块的起始地址对齐（需为2的幂），块大小会向上取整为对齐的整数倍
+    MemoryPoolBase(size_t blockSize, size_t initialSize, size_t alignment = alignof(std::max_align_t))
+        : blockSize_(alignUp(std::max(blockSize, sizeof(FreeNode)), alignment)),
           initSize(initialSize * 2),
-          totalBlocks_(0) {
+          totalBlocks_(0),
+          alignment_(alignment) {
         expandPool(initialSize);
     }
 
     virtual ~MemoryPoolBase() {
         for (auto& chunk : chunks_) {
-            delete[] chunk.memory;
+            freeChunk(chunk.memory);
         }
     }
 
@@ -78,8 +80,16 @@ protected:
     size_t blockSize() const { return blockSize_; }
 
 private:
+    static size_t alignUp(size_t size, size_t alignment) {
+        return (size + alignment - 1) / alignment * alignment;
+    }
+
+    void freeChunk(char* memory) {
+        ::operator delete(memory, std::align_val_t(alignment_));
+    }
+
     void expandPool(size_t size) {
-        char* memory = new char[blockSize_ * size];
+        char* memory = static_cast<char*>(::operator new(blockSize_ * size, std::align_val_t(alignment_)));
         chunks_.push_back({memory, size});
         
         for (size_t i = 0; i < size; ++i) {
@@ -129,7 +139,7 @@ private:
 
             // 6. 如果这个chunk的所有块都在空闲列表中，可以安全释放整个chunk
             if (blocksInChunk == chunk.size) {
-                delete[] chunk.memory;
+                freeChunk(chunk.memory);
                 blocksFreed += blocksInChunk;
                 totalBlocks_ -= chunk.size;
                 freeBlocks_ -= blocksInChunk;
@@ -157,10 +167,31 @@ protected:
     size_t freeBlocks_ = 0;
     size_t totalBlocks_ = 0;
     size_t initSize;
+    size_t alignment_;
     std::vector<MemoryChunk> chunks_;
     std::mutex mutex_;
 };
 
+// 对齐缓冲区池
+// 提供固定大小、按指定边界对齐的原始缓冲区，用于O_DIRECT等要求内存对齐的读写
+class AlignedBufferPool : private MemoryPoolBase {
+public:
+    AlignedBufferPool(size_t bufferSize, size_t alignment, size_t initial = initialSize)
+        : MemoryPoolBase(bufferSize, initial, alignment) {}
+
+    // 取出一个缓冲区，内容未初始化
+    void* acquire() {
+        return allocate();
+    }
+
+    // 归还缓冲区
+    void release(void* ptr) {
+        deallocate(ptr);
+    }
+
+    size_t bufferSize() const { return blockSize(); }
+};
+
 // 模板化内存池
 // 重写MemoryPoolBase类之后，可以将内存池的指针指向块设备，以实现在块设备上分配内存
 // 这里的内存池是使用链表来管理空闲块
@@ -1,6 +1,8 @@
 #ifndef RANDOM_H
 #define RANDOM_H
 #include <vector>
+#include <cstddef>
+#include <cstdint>
 namespace BwtFS::Util{
     // 生成随机数
     // n: 随机数的个数
@@ -15,6 +17,21 @@ namespace BwtFS::Util{
 
     // 生成随机数
     int RandNumber(unsigned seed, int min, int max);
+
+    /*
+    * 快速随机数发生器（xoshiro256**）
+    * 一次生成64位，用于大块随机填充，不用于加密
+    */
+    class FastRandom{
+        public:
+            explicit FastRandom(uint64_t seed);
+            // 生成下一个64位随机数
+            uint64_t next();
+            // 用随机字节填充data的前size个字节
+            void fill(std::byte* data, size_t size);
+        private:
+            uint64_t state[4];
+    };
 };
 
 #endif
\ No newline at end of file
@@ -62,6 +62,18 @@ class safe_queue{
             queue.push(item);
         }
 
+        void enqueue(T&& item){
+            /*
+            * 将item移动到队列中，用于只能移动的元素
+            * Args:
+            *   item: 待加入的元素
+            * Returns:
+            *   None
+            */
+            std::unique_lock<std::mutex> lock(mutex);
+            queue.push(std::move(item));
+        }
+
         bool dequeue(T& item){
             /*
             * 从队列中取出元素
@@ -6,6 +6,7 @@
 #include <type_traits> 
 #include "node/binary.h"
 #include "cell.h"
+#include "chacha20.h"
 
 using BwtFS::Node::Binary;
 
@@ -70,6 +71,44 @@ class RCAEncryptor : public RCA, public Encryptor{
         }
 };
 
+// ChaCha20加密，nonce由CryptoEngine按写入分配并保存在块末尾（版本5起）
+// 版本4的卷nonce由节点所在的块和entry中的seed、level生成，块重新分配后可能重复
+// 需要密钥和nonce，只能通过CryptoEngine使用，不能作为tree_base_node的模板参数
+class ChaCha20Encryptor : public Encryptor{
+    public:
+        constexpr static const char* value = "ChaCha20Encryptor";
+        ChaCha20Encryptor() = default;
+        ChaCha20Encryptor(const BwtFS::Util::ChaCha20Key& key) : m_key(key) {}
+
+        void encrypt(void* data, size_t size) override {
+            BwtFS::Util::chacha20(static_cast<std::byte*>(data), size, m_key, m_nonce);
+        }
+
+        void decrypt(void* data, size_t size) override {
+            BwtFS::Util::chacha20(static_cast<std::byte*>(data), size, m_key, m_nonce);
+        }
+
+        void setKey(const BwtFS::Util::ChaCha20Key& key) {
+            m_key = key;
+        }
+
+        void setNonce(const BwtFS::Util::ChaCha20Nonce& nonce) {
+            m_nonce = nonce;
+        }
+
+        // 版本4的nonce：bitmap(8字节) | seed(2字节) | level(1字节) | 0
+        void setNonce(uint64_t bitmap, uint16_t seed, uint8_t level) {
+            std::memcpy(m_nonce.data(), &bitmap, sizeof(bitmap));
+            std::memcpy(m_nonce.data() + sizeof(bitmap), &seed, sizeof(seed));
+            m_nonce[sizeof(bitmap) + sizeof(seed)] = level;
+            m_nonce[sizeof(bitmap) + sizeof(seed) + sizeof(level)] = 0;
+        }
+
+    private:
+        BwtFS::Util::ChaCha20Key m_key{};
+        BwtFS::Util::ChaCha20Nonce m_nonce{};
+};
+
 class EncryptedObject {
     public:
         EncryptedObject(void* ptr, size_t size, Encryptor& encryptor)
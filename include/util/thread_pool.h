@@ -8,6 +8,7 @@
 #include <functional>
 #include <future>
 #include <stdexcept>
+#include <atomic>
 #include "safe_queue.h"
 class ThreadPool{
     /*
@@ -16,7 +17,7 @@ class ThreadPool{
     private:
         std::vector<std::thread> workers;           // 工作线程列表
         safe_queue<std::function<void()>> tasks;     // 任务队列，存储可调用对象
-        bool stop;                                  // 停止标志，用于指示线程池是否应该停止
+        std::atomic<bool> stop;                     // 停止标志，用于指示线程池是否应该停止
         std::mutex mutex;                           // 互斥锁
         std::condition_variable condition;          // 条件变量，用于等待任务
         std::vector<std::atomic<bool>> finished;    // 用于判断线程是否完成任务
@@ -65,7 +66,10 @@ class ThreadPool{
         /*
         * 关闭线程池
         */
-        stop = true;
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            stop = true;
+        }
         condition.notify_all();
         for(auto& worker: workers)
             if (worker.joinable()) worker.join();
@@ -103,7 +107,11 @@ class ThreadPool{
             (*task_ptr)();
         };
         // 队列通用安全封包函数，并压入安全队列
-        tasks.enqueue(warpper_func);
+        // 在条件变量的锁内入队，避免工作线程检查队列后、进入等待前错过唤醒
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            tasks.enqueue(warpper_func);
+        }
         // 唤醒一个等待中的线程
         condition.notify_one();
         // 返回先前注册的任务指针
@@ -419,6 +419,31 @@ public:
             res.set_content(obj.dump(), "application/json");
         });
 
+        // Online grow endpoint, size is the new file system size in bytes
+        server.Post("/grow", [](const httplib::Request& req, httplib::Response& res) {
+            try {
+                if (!req.has_param("size")) {
+                    res.status = 400;
+                    res.set_content("{\"status\":\"error\",\"message\":\"size is required\"}", "application/json");
+                    return;
+                }
+                auto fs = BwtFS::System::getBwtFS();
+                fs->grow(std::stoull(req.get_param_value("size")));
+                json obj;
+                obj["status"] = "success";
+                obj["system_size"] = fs->getFileSize();
+                obj["free_size"] = fs->getFreeSize();
+                res.set_content(obj.dump(), "application/json");
+            } catch (const std::exception& e) {
+                LOG_ERROR << "Error growing file system: " << e.what();
+                res.status = 400;
+                json error_obj;
+                error_obj["status"] = "error";
+                error_obj["message"] = e.what();
+                res.set_content(error_obj.dump(), "application/json");
+            }
+        });
+
         // File download endpoint
         server.Get("(.*)", [this](const httplib::Request& req, httplib::Response& res) {
             std::string path = req.matches[1];
@@ -0,0 +1,280 @@
+#ifndef _WIN32
+#include "file/async_io.h"
+#include "util/ini_parser.h"
+#include "util/log.h"
+#include "config.h"
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <future>
+#include <unistd.h>
+#include <sys/uio.h>
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define BWTFS_HAS_IO_URING 1
+#endif
+
+using BwtFS::Util::Logger;
+
+namespace{
+    // 按位置写入全部数据
+    void pwrite_full(int fd, unsigned long long offset, const std::byte* data, size_t size){
+        size_t done = 0;
+        while (done < size){
+            auto n = ::pwrite(fd, data + done, size - done, offset + done);
+            if (n < 0){
+                if (errno == EINTR) continue;
+                LOG_ERROR << "Failed to write file at " << offset + done << ": " << std::strerror(errno);
+                throw std::runtime_error(std::string("Failed to write file: ") + __FILE__ + ":" + std::to_string(__LINE__));
+            }
+            done += n;
+        }
+    }
+}
+
+#ifdef BWTFS_HAS_IO_URING
+/*
+* io_uring环
+* 仅使用IORING_OP_WRITEV，兼容5.1及以上内核
+*/
+struct BwtFS::System::AsyncBlockEngine::Ring{
+    int ring_fd = -1;
+    unsigned entries = 0;
+    // 提交队列
+    void* sq_ptr = nullptr;
+    size_t sq_size = 0;
+    unsigned* sq_head = nullptr;
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_mask = nullptr;
+    unsigned* sq_array = nullptr;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqes_size = 0;
+    // 完成队列
+    void* cq_ptr = nullptr;
+    size_t cq_size = 0;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned* cq_mask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+    // 每个请求对应的iovec，提交到完成期间必须保持有效
+    std::vector<iovec> iovs;
+
+    bool setup(unsigned depth){
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        ring_fd = (int)::syscall(__NR_io_uring_setup, depth, &params);
+        if (ring_fd < 0){
+            return false;
+        }
+        entries = params.sq_entries;
+        sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap){
+            sq_size = cq_size = std::max(sq_size, cq_size);
+        }
+        sq_ptr = ::mmap(nullptr, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+        if (sq_ptr == MAP_FAILED){
+            sq_ptr = nullptr;
+            release();
+            return false;
+        }
+        if (single_mmap){
+            cq_ptr = sq_ptr;
+        }else{
+            cq_ptr = ::mmap(nullptr, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+            if (cq_ptr == MAP_FAILED){
+                cq_ptr = nullptr;
+                release();
+                return false;
+            }
+        }
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        void* p = ::mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+        if (p == MAP_FAILED){
+            release();
+            return false;
+        }
+        sqes = static_cast<io_uring_sqe*>(p);
+        auto sq = static_cast<char*>(sq_ptr);
+        sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        auto cq = static_cast<char*>(cq_ptr);
+        cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        iovs.resize(entries);
+        return true;
+    }
+
+    void release(){
+        if (sqes != nullptr){
+            ::munmap(sqes, sqes_size);
+            sqes = nullptr;
+        }
+        if (cq_ptr != nullptr && cq_ptr != sq_ptr){
+            ::munmap(cq_ptr, cq_size);
+        }
+        cq_ptr = nullptr;
+        if (sq_ptr != nullptr){
+            ::munmap(sq_ptr, sq_size);
+            sq_ptr = nullptr;
+        }
+        if (ring_fd >= 0){
+            ::close(ring_fd);
+            ring_fd = -1;
+        }
+    }
+
+    ~Ring(){
+        release();
+    }
+};
+#else
+struct BwtFS::System::AsyncBlockEngine::Ring{};
+#endif
+
+BwtFS::System::AsyncBlockEngine::AsyncBlockEngine(int fd) : fd(fd){
+    auto& config = BwtFS::Config::getInstance();
+    auto engine = config.get("system", "io_engine", BwtFS::DefaultConfig::SYSTEM_FILE_IO_ENGINE);
+    this->queue_depth = std::stoul(config.get("system", "io_queue_depth",
+        std::to_string(BwtFS::DefaultConfig::SYSTEM_FILE_IO_QUEUE_DEPTH)));
+    if (this->queue_depth == 0){
+        this->queue_depth = 1;
+    }
+    if (engine != "auto" && engine != "io_uring" && engine != "thread"){
+        LOG_WARNING << "Unknown io_engine: " << engine << ", use auto.";
+        engine = "auto";
+    }
+#ifdef BWTFS_HAS_IO_URING
+    if (engine != "thread"){
+        auto r = std::make_unique<Ring>();
+        if (r->setup(this->queue_depth)){
+            this->ring = std::move(r);
+            // 内核可能向上取整为2的幂
+            this->queue_depth = this->ring->entries;
+            LOG_INFO << "Async block engine: io_uring, queue depth " << this->queue_depth;
+            return;
+        }
+        LOG_WARNING << "io_uring is unavailable (" << std::strerror(errno) << "), fall back to thread pool.";
+    }
+#else
+    if (engine == "io_uring"){
+        LOG_WARNING << "io_uring is not supported on this platform, fall back to thread pool.";
+    }
+#endif
+    this->pool = std::make_unique<ThreadPool>(std::min<unsigned>(this->queue_depth, BwtFS::SIZE::__THREAD_POOL_SIZE));
+    LOG_INFO << "Async block engine: thread pool, queue depth " << this->queue_depth;
+}
+
+BwtFS::System::AsyncBlockEngine::~AsyncBlockEngine(){
+    if (this->pool != nullptr){
+        this->pool->shutdown();
+    }
+}
+
+bool BwtFS::System::AsyncBlockEngine::usingIoUring() const{
+    return this->ring != nullptr;
+}
+
+void BwtFS::System::AsyncBlockEngine::write(const std::vector<BlockWrite>& writes){
+    std::lock_guard<std::mutex> lock(this->submit_mutex);
+    for (size_t i = 0; i < writes.size(); i += this->queue_depth){
+        auto count = std::min<size_t>(this->queue_depth, writes.size() - i);
+        if (this->ring != nullptr){
+            this->submit_ring(writes.data() + i, count);
+        }else{
+            this->submit_threads(writes.data() + i, count);
+        }
+    }
+}
+
+void BwtFS::System::AsyncBlockEngine::submit_ring(const BlockWrite* writes, size_t count){
+#ifdef BWTFS_HAS_IO_URING
+    auto& r = *this->ring;
+    unsigned tail = *r.sq_tail;
+    for (size_t i = 0; i < count; i++){
+        unsigned index = tail & *r.sq_mask;
+        r.iovs[index].iov_base = const_cast<std::byte*>(writes[i].data.data());
+        r.iovs[index].iov_len = writes[i].data.size();
+        auto sqe = &r.sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_WRITEV;
+        sqe->fd = this->fd;
+        sqe->off = writes[i].offset;
+        sqe->addr = reinterpret_cast<unsigned long long>(&r.iovs[index]);
+        sqe->len = 1;
+        sqe->user_data = i;
+        r.sq_array[index] = index;
+        tail++;
+    }
+    // 内核通过tail看到新的提交项，需保证之前的写入先可见
+    __atomic_store_n(r.sq_tail, tail, __ATOMIC_RELEASE);
+    size_t submitted = 0, completed = 0;
+    // 短写或失败的请求，完成后同步补写
+    std::vector<std::pair<size_t, size_t>> retry;
+    while (completed < count){
+        unsigned to_submit = count - submitted;
+        int ret = (int)::syscall(__NR_io_uring_enter, r.ring_fd, to_submit, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+        if (ret < 0){
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+            LOG_ERROR << "io_uring_enter failed: " << std::strerror(errno);
+            throw std::runtime_error(std::string("io_uring_enter failed: ") + __FILE__ + ":" + std::to_string(__LINE__));
+        }
+        submitted += ret;
+        unsigned head = *r.cq_head;
+        while (head != __atomic_load_n(r.cq_tail, __ATOMIC_ACQUIRE)){
+            auto cqe = &r.cqes[head & *r.cq_mask];
+            size_t i = cqe->user_data;
+            if (cqe->res < 0){
+                LOG_WARNING << "Async write failed at " << writes[i].offset << ": " << std::strerror(-cqe->res) << ", retry synchronously.";
+                retry.push_back({i, 0});
+            }else if ((size_t)cqe->res < writes[i].data.size()){
+                retry.push_back({i, (size_t)cqe->res});
+            }
+            head++;
+            completed++;
+        }
+        __atomic_store_n(r.cq_head, head, __ATOMIC_RELEASE);
+    }
+    for (auto& [i, done] : retry){
+        pwrite_full(this->fd, writes[i].offset + done, writes[i].data.data() + done, writes[i].data.size() - done);
+    }
+#else
+    (void)writes;
+    (void)count;
+#endif
+}
+
+void BwtFS::System::AsyncBlockEngine::submit_threads(const BlockWrite* writes, size_t count){
+    // 按线程数切分为连续的几段并发写入
+    size_t threads = std::min<size_t>(count, BwtFS::SIZE::__THREAD_POOL_SIZE);
+    size_t step = (count + threads - 1) / threads;
+    std::vector<std::future<void>> futures;
+    for (size_t begin = 0; begin < count; begin += step){
+        size_t end = std::min(count, begin + step);
+        futures.push_back(this->pool->submit([this, writes, begin, end]{
+            for (size_t i = begin; i < end; i++){
+                pwrite_full(this->fd, writes[i].offset, writes[i].data.data(), writes[i].data.size());
+            }
+        }));
+    }
+    // 全部等待完成后再抛出第一个异常，避免任务还在使用writes
+    std::exception_ptr error;
+    for (auto& f : futures){
+        try{
+            f.get();
+        }catch(...){
+            if (!error) error = std::current_exception();
+        }
+    }
+    if (error){
+        std::rethrow_exception(error);
+    }
+}
+#endif
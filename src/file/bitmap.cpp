@@ -2,6 +2,10 @@
 #include "config.h"
 #include "util/log.h"
 #include <algorithm>
+#include <atomic>
+#include <bit>
+#include <thread>
+#include <cstring>
 #include <random>
 
 using BwtFS::Util::Logger;
@@ -12,36 +16,74 @@ BwtFS::System::Bitmap::Bitmap(size_t bitmap_start, size_t bitmap_wear_start, siz
     this->bitmap_start = bitmap_start;
     this->bitmap_wear_start = bitmap_wear_start;
     this->file = file;
-    this->bitmap = file->read(bitmap_start*BwtFS::BLOCK_SIZE, this->size / BwtFS::BLOCK_SIZE + 1);
-    this->bitmap_wear = file->read(bitmap_wear_start*BwtFS::BLOCK_SIZE, this->size_wear / BwtFS::BLOCK_SIZE + 1);
+    this->bitmap = file->read(bitmap_start*BwtFS::BLOCK_SIZE, regionBlocks(this->size));
+    this->bitmap_wear = file->read(bitmap_wear_start*BwtFS::BLOCK_SIZE, regionBlocks(this->size_wear));
     this->bitmap_count = bitmap_count;
-    this->init_bpm();
+    this->dirty_bitmap.assign(regionBlocks(this->size), false);
+    this->dirty_wear.assign(regionBlocks(this->size_wear), false);
+    this->page_epoch.assign(regionBlocks(this->size_wear), this->wear_epoch);
+    // 分片数与CPU核数一致，但不超过区域数
+    auto regions = (this->words_() + REGION_WORDS - 1) / REGION_WORDS;
+    auto shard_count = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, std::max<size_t>(regions, 1));
+    std::random_device device;
+    for (size_t i = 0; i < shard_count; i++) {
+        this->shards.push_back(std::make_unique<Shard>());
+        this->shards.back()->rng.seed(device());
+    }
+    this->count_free_();
     // LOG_INFO << "Bitmap initialized." ;
 }
 
 void BwtFS::System::Bitmap::set(const size_t index) {
-    // LOG_DEBUG << "index: " << index << " size: " << this->size;
-    if (index >= this->size*8) {
-        LOG_ERROR << "Index out of range: " << index;
-        throw std::out_of_range(std::string("Index out of range") + __FILE__ + ":" + std::to_string(__LINE__));
+    this->setMany(std::span<const size_t>(&index, 1));
+}
+
+void BwtFS::System::Bitmap::setMany(std::span<const size_t> indices) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    for (auto index : indices) {
+        if (index >= this->bitmap_count) {
+            LOG_ERROR << "Index out of range: " << index;
+            throw std::out_of_range(std::string("Index out of range") + __FILE__ + ":" + std::to_string(__LINE__));
+        }
     }
-    auto byte_index = index / 8;
-    auto bit_index = index % 8;
-    auto byte = (uint8_t)this->bitmap.get(byte_index);
-    auto bit = (uint8_t)(byte | (1 << bit_index));
-    auto wear = (uint8_t)this->bitmap_wear.get(index);
-    if (wear >= 254) {
-        LOG_WARNING << "Attempt to set a system block. This may cause system error.";
-        return;
+    // 磨损值只在提交锁下修改，可以先读取
+    // 有块的磨损值将超过250时，在写入前整体下移一次，下移需要锁住所有分片
+    std::vector<uint8_t> wears(indices.size());
+    for (size_t i = 0; i < indices.size(); i++) {
+        wears[i] = this->wear_(indices[i]);
     }
-    this->bitmap.set(byte_index, std::byte(bit));
-    this->save_bitmap();
-    wear = wear + 1;
-    if (wear > 250 && wear < 254) {
-        this->wear_balance();
+    bool rebase = std::any_of(wears.begin(), wears.end(), [](uint8_t w) { return w + 1 > 250 && w + 1 < 254; });
+    auto locks = rebase ? this->lock_all_() : this->lock_shards_(indices);
+    if (rebase) {
+        this->rebase_();
+        for (size_t i = 0; i < indices.size(); i++) {
+            wears[i] = this->wear_(indices[i]);
+        }
+    }
+    for (size_t i = 0; i < indices.size(); i++) {
+        auto index = indices[i];
+        if (wears[i] >= 254) {
+            LOG_WARNING << "Attempt to set a system block. This may cause system error.";
+            continue;
+        }
+        // 已分配的块离开待写集合，直接设置的空闲块从空闲计数中去掉
+        auto word = index / 64;
+        auto bit = 1ULL << (index % 64);
+        if (this->pending[word] & bit) {
+            this->pending[word] &= ~bit;
+        } else if (!this->get_(index)) {
+            this->shards[this->shard_of_(index)]->free_by_wear[wears[i]]--;
+            this->region_free[word / REGION_WORDS]--;
+        }
+        if (!this->get_(index)) {
+            this->used_blocks++;
+        }
+        this->set_(index);
+        mark_(this->dirty_bitmap, index / 8);
+        // 最小磨损值为0时无法下移，磨损值停在253，不会变成系统块的标记
+        this->set_wear_(index, std::min<uint8_t>(wears[i] + 1, 253));
+        this->changes.push_back({index, 0, JournalEntry::SET, this->wear_(index), {}});
     }
-    this->bitmap_wear.set(index, std::byte(wear));
-    this->save_bitmap_wear();
 }
 
 void BwtFS::System::Bitmap::set_(const size_t index) {
@@ -55,26 +97,91 @@ void BwtFS::System::Bitmap::set_(const size_t index) {
     auto byte = (uint8_t)this->bitmap.get(byte_index);
     auto bit = (uint8_t)(byte | (1 << bit_index));
     this->bitmap.set(byte_index, std::byte(bit));
-    this->save_bitmap();
-    auto wear = (uint8_t)this->bitmap_wear.get(index);
 }
 
-void BwtFS::System::Bitmap::clear(const size_t index) {
-    // LOG_DEBUG << "index: " << index << " size: " << this->size;
-    if (index >= this->size*8) {
-        LOG_ERROR << "Index out of range: " << index;
-        throw std::out_of_range(std::string("Index out of range") + __FILE__ + ":" + std::to_string(__LINE__));
-    }
-    if ((uint8_t)this->bitmap_wear.get(index) > 254){
-        LOG_WARNING << "Attempt to clear a system block. This may cause system error.";
-        return;
-    }
+void BwtFS::System::Bitmap::clear_(const size_t index) {
     auto byte_index = index / 8;
     auto bit_index = index % 8;
     auto byte = (uint8_t)this->bitmap.get(byte_index);
-    auto bit = (uint8_t)(byte & ~(1 << bit_index));
-    this->bitmap.set(byte_index, std::byte(bit));
-    this->save_bitmap();
+    this->bitmap.set(byte_index, std::byte((uint8_t)(byte & ~(1 << bit_index))));
+}
+
+bool BwtFS::System::Bitmap::get_(const size_t index) const {
+    auto byte = (uint8_t)this->bitmap.get(index / 8);
+    return (byte >> (index % 8)) & 1;
+}
+
+void BwtFS::System::Bitmap::reserve_(const size_t index, uint8_t wear) {
+    this->set_(index);
+    this->bitmap_wear.set(index, std::byte(wear));
+}
+
+void BwtFS::System::Bitmap::reserve_region_(size_t start, size_t bytes) {
+    for (size_t i = start; i < start + regionBlocks(bytes); i++) {
+        this->reserve_(i, 0);
+    }
+}
+
+size_t BwtFS::System::Bitmap::regionBlocks(size_t bytes) {
+    return bytes / BwtFS::BLOCK_SIZE + 1;
+}
+
+void BwtFS::System::Bitmap::clear(const size_t index) {
+    this->clearMany(std::span<const size_t>(&index, 1));
+}
+
+void BwtFS::System::Bitmap::clearMany(std::span<const size_t> indices) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    for (auto index : indices) {
+        if (index >= this->bitmap_count) {
+            LOG_ERROR << "Index out of range: " << index;
+            throw std::out_of_range(std::string("Index out of range") + __FILE__ + ":" + std::to_string(__LINE__));
+        }
+    }
+    auto locks = this->lock_shards_(indices);
+    for (auto index : indices) {
+        if (this->wear_(index) > 254){
+            LOG_WARNING << "Attempt to clear a system block. This may cause system error.";
+            continue;
+        }
+        // 释放已用块，或者放弃尚未写入的已分配块
+        auto word = index / 64;
+        auto bit = 1ULL << (index % 64);
+        if (this->get_(index) || (this->pending[word] & bit)) {
+            this->free_(index);
+        }
+        if (this->get_(index)) {
+            this->used_blocks--;
+        }
+        this->pending[word] &= ~bit;
+        this->clear_(index);
+        mark_(this->dirty_bitmap, index / 8);
+        this->changes.push_back({index, 0, JournalEntry::CLEAR, this->wear_(index), {}});
+    }
+}
+
+void BwtFS::System::Bitmap::release(std::span<const size_t> indices) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto locks = this->lock_shards_(indices);
+    for (auto index : indices) {
+        if (index >= this->bitmap_count) {
+            continue;
+        }
+        auto word = index / 64;
+        auto bit = 1ULL << (index % 64);
+        if (this->pending[word] & bit) {
+            this->pending[word] &= ~bit;
+            this->free_(index);
+        }
+    }
+}
+
+void BwtFS::System::Bitmap::free_(const size_t index) {
+    auto wear = this->wear_(index);
+    auto region = index / 64 / REGION_WORDS;
+    this->shards[this->shard_of_(index)]->free_by_wear[wear]++;
+    this->region_free[region]++;
+    this->region_min_wear[region] = std::min(this->region_min_wear[region], wear);
 }
 
 bool BwtFS::System::Bitmap::get(const size_t index) const {
@@ -83,31 +190,77 @@ bool BwtFS::System::Bitmap::get(const size_t index) const {
         LOG_ERROR << "Index out of range: " << index;
         throw std::out_of_range(std::string("Index out of range") + __FILE__ + ":" + std::to_string(__LINE__));
     }
-    auto byte_index = index / 8;
-    auto bit_index = index % 8;
-    auto byte = (uint8_t)this->bitmap.get(byte_index);
-    return (byte >> bit_index) & 1;
+    std::lock_guard<std::mutex> lock(this->shards[this->shard_of_(index)]->mutex);
+    return this->get_(index);
 }
 
-void BwtFS::System::Bitmap::wear_balance() {
-    LOG_DEBUG << "Wear balance...";
-    uint8_t min_wear = 255;
-    for (size_t i = 0; i < this->bitmap_wear.size(); i++) {
+uint8_t BwtFS::System::Bitmap::wear_(const size_t index) const {
+    auto wear = (uint8_t)this->bitmap_wear.get(index);
+    if (wear >= 254) {
+        return wear;
+    }
+    auto lag = this->wear_epoch - this->page_epoch[index / BwtFS::BLOCK_SIZE];
+    return wear > lag ? (uint8_t)(wear - lag) : 0;
+}
+
+void BwtFS::System::Bitmap::set_wear_(const size_t index, uint8_t wear) {
+    this->normalize_page_(index / BwtFS::BLOCK_SIZE);
+    this->bitmap_wear.set(index, std::byte(wear));
+    mark_(this->dirty_wear, index);
+}
+
+void BwtFS::System::Bitmap::normalize_page_(size_t page) {
+    auto lag = this->wear_epoch - this->page_epoch[page];
+    if (lag == 0) {
+        return;
+    }
+    auto begin = page * BwtFS::BLOCK_SIZE;
+    auto end = std::min(begin + BwtFS::BLOCK_SIZE, this->bitmap_wear.size());
+    for (size_t i = begin; i < end; i++) {
         auto wear = (uint8_t)this->bitmap_wear.get(i);
-        if (wear < min_wear) {
-            min_wear = wear;
+        if (wear < 254) {
+            this->bitmap_wear.set(i, std::byte(wear > lag ? (uint8_t)(wear - lag) : 0));
         }
     }
-    if (min_wear == 0) {
-        LOG_DEBUG << "Wear balance finished, no need to balance.";
+    this->page_epoch[page] = this->wear_epoch;
+    this->dirty_wear[page] = true;
+}
+
+int BwtFS::System::Bitmap::min_free_wear_(const Shard& shard) const {
+    for (int w = 0; w < 254; w++) {
+        if (shard.free_by_wear[w] > 0) {
+            return w;
+        }
+    }
+    return -1;
+}
+
+void BwtFS::System::Bitmap::rebase_() {
+    // 所有非系统块的磨损值减去空闲块的最小磨损值，相对大小不变
+    // 只增加全局偏移，各页在下次修改或写回时再实际改写
+    int base = -1;
+    for (const auto& shard : this->shards) {
+        auto wear = min_free_wear_(*shard);
+        if (wear >= 0 && (base < 0 || wear < base)) {
+            base = wear;
+        }
+    }
+    if (base <= 0) {
+        LOG_DEBUG << "Wear rebase skipped, minimum free wear is " << base << ".";
         return;
     }
-    for (size_t i = 0; i < this->bitmap_wear.size(); i++) {
-        if ((uint8_t)this->bitmap_wear.get(i) < 254) {
-            LOG_DEBUG << "Wear balance: " << i << " " << (int)this->bitmap_wear.get(i) << " -> " << (int)(min_wear-1);
-            this->bitmap_wear.set(i, std::byte(min_wear-1));
+    this->wear_epoch += base;
+    for (auto& shard : this->shards) {
+        for (int w = 0; w < 254; w++) {
+            shard->free_by_wear[w] = w + base < 254 ? shard->free_by_wear[w + base] : 0;
         }
     }
+    for (auto& wear : this->region_min_wear) {
+        if (wear < 254) {
+            wear = wear > base ? (uint8_t)(wear - base) : 0;
+        }
+    }
+    LOG_DEBUG << "Wear rebased by " << base << ", epoch " << this->wear_epoch << ".";
 }
 
 void BwtFS::System::Bitmap::save_bitmap() {
@@ -121,31 +274,163 @@ void BwtFS::System::Bitmap::save_bitmap_wear() {
 void BwtFS::System::Bitmap::save() {
     this->save_bitmap();
     this->save_bitmap_wear();
+    this->dirty_bitmap.assign(regionBlocks(this->size), false);
+    this->dirty_wear.assign(regionBlocks(this->size_wear), false);
+    this->changes.clear();
+}
+
+std::vector<BwtFS::System::JournalEntry> BwtFS::System::Bitmap::takeChanges() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    std::vector<JournalEntry> changes;
+    changes.swap(this->changes);
+    return changes;
+}
+
+void BwtFS::System::Bitmap::replay(const std::vector<JournalEntry>& entries) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto locks = this->lock_all_();
+    for (const auto& entry : entries) {
+        if (entry.index >= this->bitmap_count || this->wear_(entry.index) >= 254) {
+            continue;
+        }
+        if (entry.type == JournalEntry::SET) {
+            this->set_(entry.index);
+            this->set_wear_(entry.index, std::min<uint8_t>(entry.wear, 253));
+        } else if (entry.type == JournalEntry::CLEAR) {
+            this->clear_(entry.index);
+        } else {
+            continue;
+        }
+        mark_(this->dirty_bitmap, entry.index / 8);
+    }
+    this->count_free_();
+}
+
+void BwtFS::System::Bitmap::mark_(std::vector<bool>& dirty, size_t byte) {
+    dirty[byte / BwtFS::BLOCK_SIZE] = true;
 }
 
-void BwtFS::System::Bitmap::init(unsigned last_index) {
+void BwtFS::System::Bitmap::collect_(std::vector<BlockWrite>& writes, size_t start,
+                                     const BwtFS::Node::Binary& region, std::vector<bool>& dirty) {
+    size_t page = 0;
+    while (page < dirty.size()) {
+        if (!dirty[page]) {
+            page++;
+            continue;
+        }
+        size_t end = page;
+        while (end < dirty.size() && dirty[end]) {
+            dirty[end] = false;
+            end++;
+        }
+        writes.push_back({(start + page) * BwtFS::BLOCK_SIZE,
+                          BwtFS::Node::Binary(region.data() + page * BwtFS::BLOCK_SIZE, (end - page) * BwtFS::BLOCK_SIZE)});
+        page = end;
+    }
+}
+
+void BwtFS::System::Bitmap::flush() {
+    std::vector<BlockWrite> writes;
+    std::lock_guard<std::mutex> lock(this->mutex);
+    // 磁盘上不记录偏移，下移后尚未改写的页在写回前改写，磨损页与区域一一对应，只锁所在分片
+    for (size_t page = 0; page < this->page_epoch.size(); page++) {
+        if (this->page_epoch[page] != this->wear_epoch) {
+            std::lock_guard<std::mutex> shard_lock(this->shards[this->shard_of_(page * BwtFS::BLOCK_SIZE)]->mutex);
+            this->normalize_page_(page);
+        }
+    }
+    // 位图和磨损值只在提交锁下修改，持有提交锁即可拷贝，写入期间分片可以继续分配
+    collect_(writes, this->bitmap_start, this->bitmap, this->dirty_bitmap);
+    collect_(writes, this->bitmap_wear_start, this->bitmap_wear, this->dirty_wear);
+    this->changes.clear();
+    // 持锁写入，避免旧的页覆盖新的页
+    if (!writes.empty()) {
+        this->file->writeBatch(writes);
+    }
+}
+
+void BwtFS::System::Bitmap::init(unsigned last_index, const std::vector<BwtFS::System::Region>& regions) {
     LOG_INFO << "Initializing bitmap...";
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto locks = this->lock_all_();
     for (size_t i = 0; i < this->size; i++) {
         this->bitmap.set(i, std::byte(0));
     }
     for (size_t i = 0; i < this->size_wear; i++) {
         this->bitmap_wear.set(i, std::byte(0));
     }
-    for (size_t i = this->bitmap_start; i < this->bitmap_start + this->size / BwtFS::BLOCK_SIZE; i++) {
-        this->bitmap_wear.set(i, std::byte(0));
-        this->set_(i);
+    this->page_epoch.assign(regionBlocks(this->size_wear), this->wear_epoch);
+    // 保存位图时会写入整个区域（含最后一个不满的块），因此整个区域都要保留
+    this->reserve_region_(this->bitmap_start, this->size);
+    this->reserve_region_(this->bitmap_wear_start, this->size_wear);
+    for (const auto& region : regions) {
+        this->reserve_region_(region.start, region.bytes);
     }
-    for (size_t i = this->bitmap_wear_start; i < this->bitmap_wear_start + this->size_wear / BwtFS::BLOCK_SIZE; i++) {
-        this->bitmap_wear.set(i, std::byte(0));
-        this->set_(i);
-    }
-    this->set_(0);
-    this->set_(last_index);
-    this->set_(last_index-1);
-    this->bitmap_wear.set(0, std::byte(255));
-    this->bitmap_wear.set(last_index, std::byte(255));
-    this->bitmap_wear.set(last_index-1, std::byte(255));
+    this->reserve_(0, 255);
+    this->reserve_(last_index, 255);
+    this->reserve_(last_index-1, 255);
     this->save();
+    this->count_free_();
+}
+
+void BwtFS::System::Bitmap::grow(size_t bitmap_count, size_t bitmap_start, size_t bitmap_wear_start,
+                                 const std::vector<BwtFS::System::Region>& released, const std::vector<BwtFS::System::Region>& reserved) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto locks = this->lock_all_();
+    if (bitmap_count <= this->bitmap_count) {
+        LOG_ERROR << "New block count must be larger than the current one: " << bitmap_count;
+        throw std::invalid_argument(std::string("New block count must be larger than the current one") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    auto old_count = this->bitmap_count;
+    auto old_start = this->bitmap_start;
+    auto old_wear_start = this->bitmap_wear_start;
+    auto old_size = this->size;
+    auto old_size_wear = this->size_wear;
+    for (size_t page = 0; page < this->page_epoch.size(); page++) {
+        this->normalize_page_(page);
+    }
+
+    // 新的位图和磨损位图，新增块的位和磨损值都为0
+    auto size = bitmap_count / 8 + 1;
+    BwtFS::Node::Binary bitmap(regionBlocks(size) * BwtFS::BLOCK_SIZE);
+    BwtFS::Node::Binary bitmap_wear(regionBlocks(size * 8) * BwtFS::BLOCK_SIZE);
+    bitmap.write(0, old_size, this->bitmap.data());
+    bitmap_wear.write(0, old_size_wear, this->bitmap_wear.data());
+    this->bitmap = bitmap;
+    this->bitmap_wear = bitmap_wear;
+    this->size = size;
+    this->size_wear = size * 8;
+    this->bitmap_count = bitmap_count;
+    this->bitmap_start = bitmap_start;
+    this->bitmap_wear_start = bitmap_wear_start;
+    this->page_epoch.assign(regionBlocks(this->size_wear), this->wear_epoch);
+
+    // 原来的认证块、预留块和位图区域变为普通的空闲块
+    for (auto index : {old_count - 1, old_count - 2}) {
+        this->clear_(index);
+        this->bitmap_wear.set(index, std::byte(0));
+    }
+    for (size_t i = old_start; i < old_start + regionBlocks(old_size); i++) {
+        this->clear_(i);
+    }
+    for (size_t i = old_wear_start; i < old_wear_start + regionBlocks(old_size_wear); i++) {
+        this->clear_(i);
+    }
+    for (const auto& region : released) {
+        for (size_t i = region.start; i < region.start + regionBlocks(region.bytes); i++) {
+            this->clear_(i);
+        }
+    }
+    this->reserve_region_(bitmap_start, this->size);
+    this->reserve_region_(bitmap_wear_start, this->size_wear);
+    for (const auto& region : reserved) {
+        this->reserve_region_(region.start, region.bytes);
+    }
+    this->reserve_(bitmap_count - 1, 255);
+    this->reserve_(bitmap_count - 2, 255);
+    this->save();
+    this->count_free_();
+    LOG_INFO << "Bitmap grown: " << old_count << " -> " << bitmap_count << " blocks.";
 }
 
 uint8_t BwtFS::System::Bitmap::getWearBlock(const size_t index) const {
@@ -153,75 +438,156 @@ uint8_t BwtFS::System::Bitmap::getWearBlock(const size_t index) const {
         LOG_ERROR << "Index out of range: " << index;
         throw std::out_of_range(std::string("Index out of range") + __FILE__ + ":" + std::to_string(__LINE__));
     }
-    return (uint8_t)this->bitmap_wear.get(index);
+    std::lock_guard<std::mutex> lock(this->shards[this->shard_of_(index)]->mutex);
+    return this->wear_(index);
 }
 
 size_t BwtFS::System::Bitmap::getSystemUsedSize() const {
-    size_t used_size = 0, count = 0;
-    for (size_t i = 0; i < this->bitmap.size(); i++) {
-        auto byte = (uint8_t)this->bitmap.get(i);
-        for (size_t j = 0; j < 8; j++) {
-            if ((byte >> j) & 1) {
-                used_size++;
-            }
-            count++;
-            if (count >= this->bitmap_count) {
-                return used_size*BwtFS::BLOCK_SIZE;
-            }
-        }
+    return this->used_blocks.load()*BwtFS::BLOCK_SIZE;
+}
+
+size_t BwtFS::System::Bitmap::words_() const {
+    return (this->bitmap_count + 63) / 64;
+}
+
+uint64_t BwtFS::System::Bitmap::free_word_(size_t word) const {
+    // 位图字节数不一定是8的整数倍，末尾不足8字节的部分按已用处理
+    uint64_t used = ~0ULL;
+    auto offset = word * 8;
+    std::memcpy(&used, this->bitmap.data() + offset, std::min<size_t>(8, this->size - offset));
+    uint64_t free = ~used & ~this->pending[word];
+    auto valid = this->bitmap_count - word * 64;
+    if (valid < 64) {
+        free &= (1ULL << valid) - 1;
     }
-    return used_size*BwtFS::BLOCK_SIZE;
+    return free;
 }
 
-void BwtFS::System::Bitmap::init_bpm(){
-    // LOG_DEBUG << "Initializing bpm...";
-    for (size_t i = 0; i < this->size-1; i++) {
-        auto byte = (uint8_t)this->bitmap.get(i);
-        for (size_t j = 0; j < 8; j++) {
-            if ((byte >> j) & 1) {
-                this->bpm.push_back({i*8+j, {true, (uint8_t)this->bitmap_wear.get(i*8+j)}});
-            }else{
-                this->bpm.push_back({i*8+j, {false, (uint8_t)this->bitmap_wear.get(i*8+j)}});
-            }
-        }
+void BwtFS::System::Bitmap::count_free_() {
+    auto regions = (words_() + REGION_WORDS - 1) / REGION_WORDS;
+    this->regions_per_shard = std::max<size_t>(1, (regions + this->shards.size() - 1) / this->shards.size());
+    this->pending.resize(words_(), 0);
+    for (auto& shard : this->shards) {
+        shard->free_by_wear.fill(0);
     }
-    std::shuffle(this->bpm.begin(), this->bpm.end(), std::mt19937(std::random_device()()));
-    std::sort(this->bpm.begin(), this->bpm.end(), [](const auto& a, const auto& b) {
-        if (a.second.first == true && b.second.first == false) {
-            return false;
-        }else if (a.second.first == false && b.second.first == true) {
-            return true;
-        }else {
-            return a.second.second < b.second.second;
+    this->region_free.assign(regions, 0);
+    this->region_min_wear.assign(regions, 254);
+    size_t used = 0;
+    for (size_t word = 0; word < words_(); word++) {
+        auto free = free_word_(word);
+        // 块数量范围内既不空闲也不在pending中的块为已用块
+        auto valid = std::min<size_t>(64, this->bitmap_count - word * 64);
+        used += valid - std::popcount(free) - std::popcount(this->pending[word]);
+        this->region_free[word / REGION_WORDS] += std::popcount(free);
+        auto& free_by_wear = this->shards[this->shard_of_(word * 64)]->free_by_wear;
+        auto& min_wear = this->region_min_wear[word / REGION_WORDS];
+        while (free) {
+            auto index = word * 64 + std::countr_zero(free);
+            free &= free - 1;
+            auto wear = this->wear_(index);
+            free_by_wear[wear]++;
+            min_wear = std::min(min_wear, wear);
         }
-    });
-    this->bpm_ptr = 0;
+    }
+    this->used_blocks = used;
+}
+
+size_t BwtFS::System::Bitmap::shard_of_(size_t index) const {
+    return std::min(index / (REGION_WORDS * 64) / this->regions_per_shard, this->shards.size() - 1);
+}
+
+std::vector<std::unique_lock<std::mutex>> BwtFS::System::Bitmap::lock_shards_(std::span<const size_t> indices) const {
+    std::vector<size_t> used;
+    for (auto index : indices) {
+        used.push_back(this->shard_of_(index));
+    }
+    std::sort(used.begin(), used.end());
+    used.erase(std::unique(used.begin(), used.end()), used.end());
+    std::vector<std::unique_lock<std::mutex>> locks;
+    for (auto shard : used) {
+        locks.emplace_back(this->shards[shard]->mutex);
+    }
+    return locks;
+}
+
+std::vector<std::unique_lock<std::mutex>> BwtFS::System::Bitmap::lock_all_() const {
+    std::vector<std::unique_lock<std::mutex>> locks;
+    for (const auto& shard : this->shards) {
+        locks.emplace_back(shard->mutex);
+    }
+    return locks;
 }
 
 size_t BwtFS::System::Bitmap::getFreeBlock() {
-    if (this->bpm_ptr >= this->bpm.size()) {
-        this->init_bpm();
-        if (this->bpm_ptr >= this->bpm.size()) {
-            LOG_ERROR << "No free block available, system memory may used up or has some system error.";
-            throw std::out_of_range(std::string("No free block available") + __FILE__ + ":" + std::to_string(__LINE__));
-        }
-    }
-    auto block = this->bpm[this->bpm_ptr].first;
-    this->bpm_ptr += 1;
-    // for (size_t i = 0; i < this->bpm.size(); i++) {
-    //     if(bpm[i].second.first == true){
-    //         LOG_DEBUG << "bpm[" << i << "]: " << this->bpm[i].first << " " << (int)this->bpm[i].second.first << " " << (int)this->bpm[i].second.second;
-    //     }
-    // }
-    if (this->get(block) == true){
-        this->init_bpm();
-        auto block = this->bpm[this->bpm_ptr].first;
-        this->bpm_ptr += 1;
-        if (this->get(block) == true){
-            LOG_ERROR << "Block " << block << " is already used, system memory may used up.";
-            return 0;
-        }  
-    }
-    return block;
+    // 每个线程固定优先使用一个分片，分片用完后依次尝试其它分片
+    static std::atomic<size_t> threads{0};
+    thread_local size_t ticket = threads++;
+    auto count = this->shards.size();
+    for (size_t i = 0; i < count; i++) {
+        auto block = this->allocate_((ticket + i) % count);
+        if (block != 0) {
+            return block;
+        }
+    }
+    LOG_ERROR << "No free block available, system memory may used up or has some system error.";
+    throw std::out_of_range(std::string("No free block available") + __FILE__ + ":" + std::to_string(__LINE__));
 }
 
+size_t BwtFS::System::Bitmap::allocate_(size_t index) {
+    auto& shard = *this->shards[index];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    // 分片内磨损值最小的空闲块优先，磨损值254、255为系统块
+    auto wear = min_free_wear_(shard);
+    if (wear < 0) {
+        return 0;
+    }
+    // 从分片内随机的区域开始循环查找，跳过没有可分配块的区域，区域内从随机的字开始，字内从随机的位开始
+    auto words = words_();
+    auto first_region = std::min(index * this->regions_per_shard, this->region_free.size());
+    auto last_region = index + 1 == this->shards.size() ? this->region_free.size()
+                     : std::min(first_region + this->regions_per_shard, this->region_free.size());
+    auto regions = last_region - first_region;
+    if (regions == 0) {
+        return 0;
+    }
+    auto start = shard.rng() % regions;
+    for (size_t i = 0; i < regions; i++) {
+        auto region = first_region + (start + i) % regions;
+        if (this->region_free[region] == 0 || this->region_min_wear[region] > wear) {
+            continue;
+        }
+        // 区域内可分配块的实际最小磨损值，没有找到时用来收紧下界
+        uint8_t lowest = 254;
+        auto first = region * REGION_WORDS;
+        auto count = std::min(REGION_WORDS, words - first);
+        auto offset = shard.rng() % count;
+        for (size_t j = 0; j < count; j++) {
+            auto word = first + (offset + j) % count;
+            auto free = free_word_(word);
+            if (free == 0) {
+                continue;
+            }
+            auto rotate = (int)(shard.rng() & 63);
+            auto candidates = std::rotr(free, rotate);
+            while (candidates) {
+                auto bit = (std::countr_zero(candidates) + rotate) & 63;
+                candidates &= candidates - 1;
+                auto block = word * 64 + bit;
+                auto block_wear = this->wear_(block);
+                if (block_wear != wear) {
+                    lowest = std::min(lowest, block_wear);
+                    continue;
+                }
+                this->pending[word] |= 1ULL << bit;
+                shard.free_by_wear[wear]--;
+                this->region_free[region]--;
+                // 精简文件中先把块所在区段的空洞填充为随机数据
+                this->file->materialize(block*BwtFS::BLOCK_SIZE);
+                return block;
+            }
+        }
+        this->region_min_wear[region] = lowest;
+    }
+    LOG_ERROR << "No free block with wear " << wear << " found in shard " << index << ", free block counters may be damaged.";
+    return 0;
+}
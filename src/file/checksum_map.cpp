@@ -0,0 +1,129 @@
+#include "file/checksum_map.h"
+#include "file/bitmap.h"
+#include "config.h"
+#include "util/crc32c.h"
+#include "util/log.h"
+#include <algorithm>
+#include <cstring>
+
+using BwtFS::Util::Logger;
+
+namespace{
+    // 每页（一个块）存放的校验和个数
+    constexpr size_t SUMS_PER_PAGE = BwtFS::BLOCK_SIZE / sizeof(uint32_t);
+}
+
+BwtFS::System::ChecksumMap::ChecksumMap(size_t start, size_t block_count, std::shared_ptr<BwtFS::System::File> file) {
+    this->start = start;
+    this->block_count = block_count;
+    this->file = file;
+    auto blocks = BwtFS::System::Bitmap::regionBlocks(regionBytes(block_count));
+    auto region = file->read(start*BwtFS::BLOCK_SIZE, blocks);
+    this->sums.resize(blocks * SUMS_PER_PAGE);
+    std::memcpy(this->sums.data(), region.data(), blocks * BwtFS::BLOCK_SIZE);
+    this->dirty.assign(blocks, false);
+}
+
+size_t BwtFS::System::ChecksumMap::regionBytes(size_t block_count) {
+    return block_count * sizeof(uint32_t);
+}
+
+uint32_t BwtFS::System::ChecksumMap::checksum(const BwtFS::Node::BinaryView& data) {
+    auto crc = BwtFS::Util::crc32c(data.data(), data.size());
+    return crc == 0 ? 1 : crc;
+}
+
+void BwtFS::System::ChecksumMap::update(size_t index, const BwtFS::Node::BinaryView& data) {
+    // 校验和在锁外计算，锁内只更新表项
+    uint32_t sum = data.size() == BwtFS::BLOCK_SIZE ? checksum(data) : 0;
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (index >= this->block_count) {
+        LOG_ERROR << "Index out of range: " << index;
+        throw std::out_of_range(std::string("Index out of range") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    this->sums[index] = sum;
+    this->dirty[index / SUMS_PER_PAGE] = true;
+    this->changes.push_back({index, sum, JournalEntry::CHECKSUM, 0, {}});
+}
+
+std::vector<BwtFS::System::JournalEntry> BwtFS::System::ChecksumMap::takeChanges() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    std::vector<JournalEntry> changes;
+    changes.swap(this->changes);
+    return changes;
+}
+
+void BwtFS::System::ChecksumMap::replay(const std::vector<JournalEntry>& entries) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    for (const auto& entry : entries) {
+        if (entry.type != JournalEntry::CHECKSUM || entry.index >= this->block_count) {
+            continue;
+        }
+        this->sums[entry.index] = entry.checksum;
+        this->dirty[entry.index / SUMS_PER_PAGE] = true;
+    }
+}
+
+void BwtFS::System::ChecksumMap::verify(size_t index, const BwtFS::Node::Binary& data) const {
+    uint32_t expected;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (index >= this->block_count) {
+            LOG_ERROR << "Index out of range: " << index;
+            throw std::out_of_range(std::string("Index out of range") + __FILE__ + ":" + std::to_string(__LINE__));
+        }
+        expected = this->sums[index];
+    }
+    if (expected == 0) {
+        return;
+    }
+    auto actual = checksum(data);
+    if (actual != expected) {
+        LOG_ERROR << "Checksum mismatch at block " << index << ": expected " << expected << ", got " << actual;
+        throw std::runtime_error(std::string("Checksum mismatch at block ") + std::to_string(index) + ": "
+            + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+}
+
+void BwtFS::System::ChecksumMap::flush() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    std::vector<BwtFS::System::BlockWrite> writes;
+    for (size_t page = 0; page < this->dirty.size(); page++) {
+        if (!this->dirty[page]) {
+            continue;
+        }
+        auto begin = reinterpret_cast<const std::byte*>(this->sums.data() + page * SUMS_PER_PAGE);
+        writes.push_back({(this->start + page) * BwtFS::BLOCK_SIZE, BwtFS::Node::Binary(begin, BwtFS::BLOCK_SIZE)});
+        this->dirty[page] = false;
+    }
+    this->changes.clear();
+    // 持锁写入，避免旧的页覆盖新的页
+    if (!writes.empty()) {
+        this->file->writeBatch(writes);
+    }
+}
+
+void BwtFS::System::ChecksumMap::save() {
+    auto region = BwtFS::Node::Binary(reinterpret_cast<const std::byte*>(this->sums.data()),
+        this->sums.size() * sizeof(uint32_t));
+    this->file->write(this->start * BwtFS::BLOCK_SIZE, region);
+    std::fill(this->dirty.begin(), this->dirty.end(), false);
+    this->changes.clear();
+}
+
+void BwtFS::System::ChecksumMap::init() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    std::fill(this->sums.begin(), this->sums.end(), 0);
+    this->save();
+}
+
+void BwtFS::System::ChecksumMap::grow(size_t block_count, size_t start) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto blocks = BwtFS::System::Bitmap::regionBlocks(regionBytes(block_count));
+    this->sums.resize(blocks * SUMS_PER_PAGE, 0);
+    this->dirty.assign(blocks, false);
+    this->block_count = block_count;
+    this->start = start;
+    this->save();
+    LOG_INFO << "Checksum map moved to block " << start << ".";
+}
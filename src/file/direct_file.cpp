@@ -0,0 +1,225 @@
+#ifndef _WIN32
+#include "file/direct_file.h"
+#include "util/log.h"
+#include "config.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+using BwtFS::Util::Logger;
+
+namespace{
+    constexpr size_t ALIGNMENT = BwtFS::System::DirectFile::DIRECT_ALIGNMENT;
+
+    // 中转缓冲区池，覆盖一个未对齐的块最多需要两页
+    AlignedBufferPool& direct_buffer_pool(){
+        static AlignedBufferPool pool(2 * BwtFS::BLOCK_SIZE, ALIGNMENT);
+        return pool;
+    }
+
+    /*
+    * 对齐的中转缓冲区
+    * 不超过池中缓冲区大小时从池中取，否则单独按对齐分配
+    */
+    class AlignedBuffer{
+        public:
+            AlignedBuffer(size_t size) : size(size){
+                auto& pool = direct_buffer_pool();
+                if (size <= pool.bufferSize()){
+                    data = static_cast<std::byte*>(pool.acquire());
+                    pooled = true;
+                }else{
+                    data = static_cast<std::byte*>(::operator new(size, std::align_val_t(ALIGNMENT)));
+                }
+            }
+            AlignedBuffer(const AlignedBuffer&) = delete;
+            AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+            ~AlignedBuffer(){
+                if (pooled){
+                    direct_buffer_pool().release(data);
+                }else{
+                    ::operator delete(data, std::align_val_t(ALIGNMENT));
+                }
+            }
+            std::byte* data;
+            size_t size;
+        private:
+            bool pooled = false;
+    };
+
+    unsigned long long align_down(unsigned long long v){
+        return v / ALIGNMENT * ALIGNMENT;
+    }
+
+    unsigned long long align_up(unsigned long long v){
+        return (v + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    }
+}
+
+BwtFS::System::DirectFile::DirectFile(const std::string& path) : File(path){
+#ifdef O_DIRECT
+    this->direct_fd = ::open(path.c_str(), O_RDWR | O_DIRECT | O_CLOEXEC);
+    if (this->direct_fd < 0){
+        LOG_WARNING << "O_DIRECT is not supported for " << path << " (" << std::strerror(errno) << "), fall back to buffered I/O.";
+        return;
+    }
+    this->direct_limit = align_down(this->file_size);
+    if (this->prefix_size % ALIGNMENT != 0){
+        LOG_WARNING << "Prefix size " << this->prefix_size << " is not aligned to " << ALIGNMENT
+                    << ", block I/O goes through bounce buffers.";
+    }
+    LOG_INFO << "File opened with O_DIRECT: " << path;
+#else
+    LOG_WARNING << "O_DIRECT is not supported on this platform, fall back to buffered I/O.";
+#endif
+}
+
+BwtFS::System::DirectFile::~DirectFile(){
+    this->close();
+}
+
+BwtFS::Node::Binary BwtFS::System::DirectFile::read(unsigned long long index_){
+    if (this->direct_fd < 0){
+        return File::read(index_);
+    }
+    auto index = index_ + this->prefix_size;
+    if (index >= this->file_size){
+        LOG_ERROR << "Index out of range: " << index;
+        throw std::out_of_range(std::string("Index out of range") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    std::vector<std::byte> data(BwtFS::BLOCK_SIZE);
+    this->read_span(index, data.data(), BwtFS::BLOCK_SIZE);
+    return BwtFS::Node::Binary(data);
+}
+
+BwtFS::Node::Binary BwtFS::System::DirectFile::read(unsigned long long index_, size_t size){
+    if (this->direct_fd < 0){
+        return File::read(index_, size);
+    }
+    auto index = index_ + this->prefix_size;
+    if (index + size >= this->file_size){
+        LOG_ERROR << "Index out of range: " << index;
+        throw std::out_of_range(std::string("Index out of range") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    std::vector<std::byte> data(size*BwtFS::BLOCK_SIZE);
+    this->read_span(index, data.data(), size*BwtFS::BLOCK_SIZE);
+    return BwtFS::Node::Binary(data);
+}
+
+void BwtFS::System::DirectFile::write(unsigned long long index_, const BwtFS::Node::Binary& data){
+    if (this->direct_fd < 0){
+        File::write(index_, data);
+        return;
+    }
+    this->write_view(index_, data);
+}
+
+void BwtFS::System::DirectFile::write_view(unsigned long long index_, const BwtFS::Node::BinaryView& data){
+    auto index = index_ + this->prefix_size;
+    if (index + data.size() >= this->file_size){
+        LOG_ERROR << "Index out of range: " << index;
+        throw std::out_of_range(std::string("Index out of range") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    this->write_span(index, data.data(), data.size());
+}
+
+void BwtFS::System::DirectFile::writeBatch(const std::vector<BlockWrite>& writes){
+    if (this->direct_fd < 0){
+        File::writeBatch(writes);
+        return;
+    }
+    for (const auto& w : writes){
+        this->write_view(w.offset, w.data);
+    }
+}
+
+void BwtFS::System::DirectFile::read_span(unsigned long long offset, std::byte* out, size_t size){
+    auto begin = align_down(offset);
+    auto end = align_up(offset + size);
+    if (end > this->direct_limit){
+        // 末尾不足一页的部分走普通读取
+        pread_fd(this->fd, offset, out, size);
+        return;
+    }
+    AlignedBuffer buffer(end - begin);
+    pread_fd(this->direct_fd, begin, buffer.data, buffer.size);
+    std::memcpy(out, buffer.data + (offset - begin), size);
+}
+
+void BwtFS::System::DirectFile::read_contiguous(unsigned long long offset, const std::vector<std::byte*>& blocks){
+    auto size = blocks.size() * BwtFS::BLOCK_SIZE;
+    auto begin = align_down(offset);
+    auto end = align_up(offset + size);
+    if (this->direct_fd < 0 || end > this->direct_limit){
+        File::read_contiguous(offset, blocks);
+        return;
+    }
+    AlignedBuffer buffer(end - begin);
+    pread_fd(this->direct_fd, begin, buffer.data, buffer.size);
+    for (size_t i = 0; i < blocks.size(); i++){
+        std::memcpy(blocks[i], buffer.data + (offset - begin) + i * BwtFS::BLOCK_SIZE, BwtFS::BLOCK_SIZE);
+    }
+}
+
+void BwtFS::System::DirectFile::write_span(unsigned long long offset, const std::byte* in, size_t size){
+    auto begin = align_down(offset);
+    auto end = align_up(offset + size);
+    // 按分段编号从小到大加锁，避免死锁
+    std::vector<size_t> stripe_ids;
+    for (auto page = begin / ALIGNMENT; page < end / ALIGNMENT; page++){
+        stripe_ids.push_back(page % this->stripes.size());
+    }
+    std::sort(stripe_ids.begin(), stripe_ids.end());
+    stripe_ids.erase(std::unique(stripe_ids.begin(), stripe_ids.end()), stripe_ids.end());
+    std::vector<std::unique_lock<std::mutex>> locks;
+    for (auto id : stripe_ids){
+        locks.emplace_back(this->stripes[id]);
+    }
+    if (end > this->direct_limit){
+        // 末尾不足一页的部分走普通写入，避免O_DIRECT写整页时扩展文件
+        pwrite_fd(this->fd, offset, in, size);
+        return;
+    }
+    // 整页对齐的数据（如BlockBuffer）直接写入，不经过中转缓冲区
+    if (offset == begin && offset + size == end && reinterpret_cast<uintptr_t>(in) % ALIGNMENT == 0){
+        pwrite_fd(this->direct_fd, offset, in, size);
+        return;
+    }
+    AlignedBuffer buffer(end - begin);
+    // 首尾页未被完全覆盖时先读出原内容
+    if (offset != begin){
+        pread_fd(this->direct_fd, begin, buffer.data, ALIGNMENT);
+    }
+    if (offset + size != end && (end - ALIGNMENT != begin || offset == begin)){
+        pread_fd(this->direct_fd, end - ALIGNMENT, buffer.data + (end - ALIGNMENT - begin), ALIGNMENT);
+    }
+    std::memcpy(buffer.data + (offset - begin), in, size);
+    pwrite_fd(this->direct_fd, begin, buffer.data, buffer.size);
+}
+
+void BwtFS::System::DirectFile::sync(){
+    if (this->direct_fd >= 0 && ::fdatasync(this->direct_fd) != 0){
+        LOG_ERROR << "Failed to sync file: " << std::strerror(errno);
+        throw std::runtime_error(std::string("Failed to sync file: ") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    File::sync();
+}
+
+void BwtFS::System::DirectFile::grow(size_t size, const BwtFS::Node::Binary& tail){
+    File::grow(size, tail);
+    if (this->direct_fd >= 0){
+        this->direct_limit = align_down(this->file_size);
+    }
+}
+
+void BwtFS::System::DirectFile::close(){
+    if (this->direct_fd >= 0){
+        ::close(this->direct_fd);
+        this->direct_fd = -1;
+    }
+    File::close();
+}
+#endif
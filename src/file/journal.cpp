@@ -0,0 +1,136 @@
+#include "file/journal.h"
+#include "config.h"
+#include "util/crc32c.h"
+#include "util/log.h"
+#include <cstddef>
+#include <cstring>
+
+using BwtFS::Util::Logger;
+
+namespace{
+    // 日志头和记录的标识
+    constexpr uint32_t HEADER_MAGIC = 0x4A545742;   // "BWTJ"
+    constexpr uint32_t RECORD_MAGIC = 0x52545742;   // "BWTR"
+
+    struct JournalHeader{
+        uint32_t magic;
+        uint32_t crc;
+        uint64_t generation;
+    };
+
+    struct RecordHeader{
+        uint32_t magic;
+        // 整条记录（含填充）的CRC32C，计算时该字段为0
+        uint32_t crc;
+        uint64_t generation;
+        uint64_t sequence;
+        unsigned long long modify_time;
+        // 日志项个数
+        uint32_t count;
+        // 记录占用的块数
+        uint32_t blocks;
+    };
+
+    // crc字段按0计算，不修改数据，回放时可以直接校验只读视图
+    uint32_t checksum(const BwtFS::Node::BinaryView& data, size_t crc_offset){
+        uint32_t zero = 0;
+        auto crc = BwtFS::Util::crc32c(data.data(), crc_offset);
+        crc = BwtFS::Util::crc32c(reinterpret_cast<const std::byte*>(&zero), sizeof(zero), crc);
+        auto rest = crc_offset + sizeof(zero);
+        return BwtFS::Util::crc32c(data.data() + rest, data.size() - rest, crc);
+    }
+}
+
+BwtFS::System::Journal::Journal(size_t start, size_t blocks, std::shared_ptr<BwtFS::System::File> file) {
+    this->start = start;
+    this->blocks = blocks;
+    this->file = file;
+}
+
+size_t BwtFS::System::Journal::regionBytes(size_t blocks) {
+    return blocks * BwtFS::BLOCK_SIZE;
+}
+
+void BwtFS::System::Journal::write_header_() {
+    BwtFS::Node::Binary data(BwtFS::BLOCK_SIZE);
+    JournalHeader header{HEADER_MAGIC, 0, this->generation};
+    std::memcpy(data.data(), &header, sizeof(header));
+    header.crc = checksum(data, offsetof(JournalHeader, crc));
+    std::memcpy(data.data(), &header, sizeof(header));
+    this->file->write(this->start * BwtFS::BLOCK_SIZE, data);
+    this->sequence = 0;
+    this->head = 1;
+}
+
+void BwtFS::System::Journal::init() {
+    this->generation = 1;
+    this->write_header_();
+}
+
+void BwtFS::System::Journal::reset() {
+    this->generation++;
+    this->write_header_();
+}
+
+bool BwtFS::System::Journal::append(const std::vector<JournalEntry>& entries, unsigned long long modify_time) {
+    auto bytes = sizeof(RecordHeader) + entries.size() * sizeof(JournalEntry);
+    auto count = (bytes + BwtFS::BLOCK_SIZE - 1) / BwtFS::BLOCK_SIZE;
+    if (this->head + count > this->blocks) {
+        return false;
+    }
+    BwtFS::Node::Binary data(count * BwtFS::BLOCK_SIZE);
+    RecordHeader header{RECORD_MAGIC, 0, this->generation, this->sequence, modify_time,
+                        (uint32_t)entries.size(), (uint32_t)count};
+    std::memcpy(data.data(), &header, sizeof(header));
+    std::memcpy(data.data() + sizeof(header), entries.data(), entries.size() * sizeof(JournalEntry));
+    header.crc = checksum(data, offsetof(RecordHeader, crc));
+    std::memcpy(data.data(), &header, sizeof(header));
+    this->file->write((this->start + this->head) * BwtFS::BLOCK_SIZE, data);
+    this->head += count;
+    this->sequence++;
+    return true;
+}
+
+std::vector<BwtFS::System::JournalEntry> BwtFS::System::Journal::replay(unsigned long long& modify_time) {
+    std::vector<JournalEntry> entries;
+    // 只读取和校验，使用视图，映射文件不再拷贝
+    auto block = this->file->view(this->start * BwtFS::BLOCK_SIZE);
+    JournalHeader header;
+    std::memcpy(&header, block.data(), sizeof(header));
+    auto crc = header.crc;
+    if (header.magic != HEADER_MAGIC || checksum(block, offsetof(JournalHeader, crc)) != crc) {
+        // 日志头损坏时无法判断哪些记录有效，丢弃整个日志
+        LOG_WARNING << "Journal header is damaged, journal discarded.";
+        this->generation = header.generation + 1;
+        this->write_header_();
+        return entries;
+    }
+    this->generation = header.generation;
+    this->sequence = 0;
+    this->head = 1;
+    while (this->head < this->blocks) {
+        block = this->file->view((this->start + this->head) * BwtFS::BLOCK_SIZE);
+        RecordHeader record;
+        std::memcpy(&record, block.data(), sizeof(record));
+        if (record.magic != RECORD_MAGIC || record.generation != this->generation || record.sequence != this->sequence
+            || record.blocks == 0 || this->head + record.blocks > this->blocks
+            || sizeof(RecordHeader) + (size_t)record.count * sizeof(JournalEntry) > (size_t)record.blocks * BwtFS::BLOCK_SIZE) {
+            break;
+        }
+        auto data = record.blocks == 1 ? block : this->file->view((this->start + this->head) * BwtFS::BLOCK_SIZE, record.blocks);
+        if (checksum(data, offsetof(RecordHeader, crc)) != record.crc) {
+            LOG_WARNING << "Journal record " << record.sequence << " is incomplete, replay stopped.";
+            break;
+        }
+        auto first = entries.size();
+        entries.resize(first + record.count);
+        std::memcpy(entries.data() + first, data.data() + sizeof(RecordHeader), record.count * sizeof(JournalEntry));
+        modify_time = record.modify_time;
+        this->head += record.blocks;
+        this->sequence++;
+    }
+    if (this->sequence > 0) {
+        LOG_INFO << "Journal replayed: " << this->sequence << " records, " << entries.size() << " entries.";
+    }
+    return entries;
+}
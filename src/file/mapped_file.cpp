@@ -0,0 +1,178 @@
+#ifndef _WIN32
+#include "file/mapped_file.h"
+#include "util/ini_parser.h"
+#include "util/log.h"
+#include "config.h"
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using BwtFS::Util::Logger;
+
+BwtFS::System::MappedFile::MappedFile(const std::string& path) : File(path){
+    auto& config = BwtFS::Config::getInstance();
+    bool populate = config.get("system", "mmap_populate",
+        BwtFS::DefaultConfig::SYSTEM_FILE_MMAP_POPULATE ? "true" : "false") == "true";
+    auto advice = config.get("system", "mmap_advice", BwtFS::DefaultConfig::SYSTEM_FILE_MMAP_ADVICE);
+    int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+    if (populate){
+        flags |= MAP_POPULATE;
+    }
+#endif
+    this->map_size = this->file_size;
+    void* p = ::mmap(nullptr, this->map_size, PROT_READ | PROT_WRITE, flags, this->fd, 0);
+    if (p == MAP_FAILED){
+        LOG_ERROR << "Failed to map file: " << path << ", " << std::strerror(errno);
+        File::close();
+        throw std::runtime_error(std::string("Failed to map file: ") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    this->map_base = static_cast<std::byte*>(p);
+    int adv = MADV_RANDOM;
+    if (advice == "normal"){
+        adv = MADV_NORMAL;
+    }else if (advice == "sequential"){
+        adv = MADV_SEQUENTIAL;
+    }else if (advice == "willneed"){
+        adv = MADV_WILLNEED;
+    }else if (advice != "random"){
+        LOG_WARNING << "Unknown mmap_advice: " << advice << ", use random.";
+    }
+    this->map_advice = adv;
+    if (::madvise(this->map_base, this->map_size, adv) != 0){
+        LOG_WARNING << "madvise failed: " << std::strerror(errno);
+    }
+    LOG_INFO << "File mapped: " << path << ", size: " << this->map_size;
+}
+
+BwtFS::System::MappedFile::~MappedFile(){
+    try{
+        this->close();
+    }catch(const std::exception& e){
+        LOG_ERROR << e.what();
+    }
+}
+
+BwtFS::Node::Binary BwtFS::System::MappedFile::read(unsigned long long index_){
+    auto index = index_ + this->prefix_size;
+    if (index >= this->file_size){
+        LOG_ERROR << "Index out of range: " << index;
+        throw std::out_of_range(std::string("Index out of range") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    // 块数据在上层会被原地解密，因此需要拷贝出映射区
+    std::vector<std::byte> data(BwtFS::BLOCK_SIZE);
+    auto size = std::min<size_t>(BwtFS::BLOCK_SIZE, this->file_size - index);
+    std::memcpy(data.data(), this->map_base + index, size);
+    return BwtFS::Node::Binary(data);
+}
+
+BwtFS::Node::Binary BwtFS::System::MappedFile::read(unsigned long long index_, size_t size){
+    auto index = index_ + this->prefix_size;
+    if (index + size >= this->file_size){
+        LOG_ERROR << "Index out of range: " << index;
+        throw std::out_of_range(std::string("Index out of range") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    std::vector<std::byte> data(size*BwtFS::BLOCK_SIZE);
+    auto length = std::min<size_t>(size*BwtFS::BLOCK_SIZE, this->file_size - index);
+    std::memcpy(data.data(), this->map_base + index, length);
+    return BwtFS::Node::Binary(data);
+}
+
+BwtFS::Node::BinaryView BwtFS::System::MappedFile::view(unsigned long long index_, size_t size){
+    auto index = index_ + this->prefix_size;
+    if (index + size >= this->file_size){
+        LOG_ERROR << "Index out of range: " << index;
+        throw std::out_of_range(std::string("Index out of range") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    auto length = std::min<size_t>(size*BwtFS::BLOCK_SIZE, this->file_size - index);
+    return BwtFS::Node::BinaryView(this->map_base + index, length);
+}
+
+void BwtFS::System::MappedFile::read_contiguous(unsigned long long offset, const std::vector<std::byte*>& blocks){
+    for (size_t i = 0; i < blocks.size(); i++){
+        auto index = offset + i * BwtFS::BLOCK_SIZE;
+        auto size = std::min<size_t>(BwtFS::BLOCK_SIZE, this->file_size - index);
+        std::memcpy(blocks[i], this->map_base + index, size);
+    }
+}
+
+void BwtFS::System::MappedFile::write(unsigned long long index, const BwtFS::Node::Binary& data){
+    this->write_view(index, data);
+}
+
+void BwtFS::System::MappedFile::write_view(unsigned long long index_, const BwtFS::Node::BinaryView& data){
+    auto index = index_ + this->prefix_size;
+    if (index + data.size() >= this->file_size){
+        LOG_ERROR << "Index out of range: " << index;
+        throw std::out_of_range(std::string("Index out of range") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    std::memcpy(this->map_base + index, data.data(), data.size());
+    std::lock_guard<std::mutex> lock(this->dirty_mutex);
+    if (this->dirty_begin == this->dirty_end){
+        this->dirty_begin = index;
+        this->dirty_end = index + data.size();
+    }else{
+        this->dirty_begin = std::min<size_t>(this->dirty_begin, index);
+        this->dirty_end = std::max<size_t>(this->dirty_end, index + data.size());
+    }
+}
+
+void BwtFS::System::MappedFile::writeBatch(const std::vector<BlockWrite>& writes){
+    for (const auto& w : writes){
+        this->write_view(w.offset, w.data);
+    }
+}
+
+void BwtFS::System::MappedFile::sync(){
+    size_t begin, end;
+    {
+        std::lock_guard<std::mutex> lock(this->dirty_mutex);
+        begin = this->dirty_begin;
+        end = this->dirty_end;
+        this->dirty_begin = this->dirty_end = 0;
+    }
+    if (begin == end || this->map_base == nullptr){
+        return;
+    }
+    // msync要求起始地址按页对齐
+    static const size_t page_size = ::sysconf(_SC_PAGESIZE);
+    begin = begin / page_size * page_size;
+    if (::msync(this->map_base + begin, end - begin, MS_SYNC) != 0){
+        LOG_ERROR << "Failed to sync mapped file: " << std::strerror(errno);
+        throw std::runtime_error(std::string("Failed to sync mapped file: ") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+}
+
+void BwtFS::System::MappedFile::grow(size_t size, const BwtFS::Node::Binary& tail){
+    // 先把旧映射区的脏数据刷回，新映射区与旧映射区共享同一份页缓存
+    this->sync();
+    File::grow(size, tail);
+    void* p = ::mmap(nullptr, this->file_size, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, 0);
+    if (p == MAP_FAILED){
+        LOG_ERROR << "Failed to remap file: " << std::strerror(errno);
+        throw std::runtime_error(std::string("Failed to remap file: ") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    if (::madvise(p, this->file_size, this->map_advice) != 0){
+        LOG_WARNING << "madvise failed: " << std::strerror(errno);
+    }
+    this->retired_maps.emplace_back(this->map_base, this->map_size);
+    this->map_size = this->file_size;
+    this->map_base = static_cast<std::byte*>(p);
+    LOG_INFO << "File remapped, size: " << this->map_size;
+}
+
+void BwtFS::System::MappedFile::close(){
+    if (this->map_base != nullptr){
+        this->sync();
+        ::munmap(this->map_base, this->map_size);
+        this->map_base = nullptr;
+        this->map_size = 0;
+    }
+    for (auto& [base, size] : this->retired_maps){
+        ::munmap(base, size);
+    }
+    this->retired_maps.clear();
+    File::close();
+}
+#endif
@@ -0,0 +1,165 @@
+#include "file/scrub_queue.h"
+#include "file/bitmap.h"
+#include "config.h"
+#include "util/log.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+using BwtFS::Util::Logger;
+
+namespace{
+    // 每页（一个块）存放的字数
+    constexpr size_t WORDS_PER_PAGE = BwtFS::BLOCK_SIZE / sizeof(uint64_t);
+}
+
+BwtFS::System::ScrubQueue::ScrubQueue(size_t start, size_t block_count, std::shared_ptr<BwtFS::System::File> file) {
+    this->start = start;
+    this->block_count = block_count;
+    this->file = file;
+    auto blocks = BwtFS::System::Bitmap::regionBlocks(regionBytes(block_count));
+    auto region = file->read(start*BwtFS::BLOCK_SIZE, blocks);
+    this->words.resize(blocks * WORDS_PER_PAGE);
+    std::memcpy(this->words.data(), region.data(), blocks * BwtFS::BLOCK_SIZE);
+    this->dirty.assign(blocks, false);
+    // 块数量范围之外的位没有意义
+    for (size_t index = block_count; index < this->words.size() * 64; index++) {
+        this->words[index / 64] &= ~(1ULL << (index % 64));
+    }
+    for (auto word : this->words) {
+        this->queued += std::popcount(word);
+    }
+}
+
+size_t BwtFS::System::ScrubQueue::regionBytes(size_t block_count) {
+    return block_count / 8 + 1;
+}
+
+bool BwtFS::System::ScrubQueue::assign_(size_t index, bool value) {
+    auto& word = this->words[index / 64];
+    auto bit = 1ULL << (index % 64);
+    if (((word & bit) != 0) == value) {
+        return false;
+    }
+    word ^= bit;
+    if (value) {
+        this->queued++;
+    } else {
+        this->queued--;
+    }
+    this->dirty[index / 64 / WORDS_PER_PAGE] = true;
+    return true;
+}
+
+void BwtFS::System::ScrubQueue::enqueue(std::span<const size_t> indices) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    for (auto index : indices) {
+        if (index >= this->block_count) {
+            LOG_ERROR << "Index out of range: " << index;
+            throw std::out_of_range(std::string("Index out of range") + __FILE__ + ":" + std::to_string(__LINE__));
+        }
+        if (this->assign_(index, true)) {
+            this->changes.push_back({index, 0, JournalEntry::SCRUB, 0, {}});
+        }
+    }
+}
+
+void BwtFS::System::ScrubQueue::remove(std::span<const size_t> indices) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    for (auto index : indices) {
+        if (index < this->block_count && this->assign_(index, false)) {
+            this->changes.push_back({index, 0, JournalEntry::SCRUBBED, 0, {}});
+        }
+    }
+}
+
+std::vector<size_t> BwtFS::System::ScrubQueue::next(size_t count) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    std::vector<size_t> indices;
+    if (this->queued == 0) {
+        return indices;
+    }
+    // 从上次的位置继续扫描，每一批内按块号顺序排列
+    auto total = this->words.size();
+    for (size_t i = 0; i < total && indices.size() < count; i++) {
+        auto word = (this->cursor + i) % total;
+        auto bits = this->words[word];
+        while (bits && indices.size() < count) {
+            indices.push_back(word * 64 + std::countr_zero(bits));
+            bits &= bits - 1;
+        }
+        this->cursor = bits ? word : word + 1;
+    }
+    std::sort(indices.begin(), indices.end());
+    return indices;
+}
+
+size_t BwtFS::System::ScrubQueue::size() const {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->queued;
+}
+
+std::vector<BwtFS::System::JournalEntry> BwtFS::System::ScrubQueue::takeChanges() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    std::vector<JournalEntry> changes;
+    changes.swap(this->changes);
+    return changes;
+}
+
+void BwtFS::System::ScrubQueue::replay(const std::vector<JournalEntry>& entries) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    for (const auto& entry : entries) {
+        if (entry.index >= this->block_count) {
+            continue;
+        }
+        if (entry.type == JournalEntry::SCRUB) {
+            this->assign_(entry.index, true);
+        } else if (entry.type == JournalEntry::SCRUBBED) {
+            this->assign_(entry.index, false);
+        }
+    }
+}
+
+void BwtFS::System::ScrubQueue::flush() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    std::vector<BwtFS::System::BlockWrite> writes;
+    for (size_t page = 0; page < this->dirty.size(); page++) {
+        if (!this->dirty[page]) {
+            continue;
+        }
+        auto begin = reinterpret_cast<const std::byte*>(this->words.data() + page * WORDS_PER_PAGE);
+        writes.push_back({(this->start + page) * BwtFS::BLOCK_SIZE, BwtFS::Node::Binary(begin, BwtFS::BLOCK_SIZE)});
+        this->dirty[page] = false;
+    }
+    this->changes.clear();
+    // 持锁写入，避免旧的页覆盖新的页
+    if (!writes.empty()) {
+        this->file->writeBatch(writes);
+    }
+}
+
+void BwtFS::System::ScrubQueue::save() {
+    auto region = BwtFS::Node::Binary(reinterpret_cast<const std::byte*>(this->words.data()),
+        this->words.size() * sizeof(uint64_t));
+    this->file->write(this->start * BwtFS::BLOCK_SIZE, region);
+    std::fill(this->dirty.begin(), this->dirty.end(), false);
+    this->changes.clear();
+}
+
+void BwtFS::System::ScrubQueue::init() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    std::fill(this->words.begin(), this->words.end(), 0);
+    this->queued = 0;
+    this->save();
+}
+
+void BwtFS::System::ScrubQueue::grow(size_t block_count, size_t start) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto blocks = BwtFS::System::Bitmap::regionBlocks(regionBytes(block_count));
+    this->words.resize(blocks * WORDS_PER_PAGE, 0);
+    this->dirty.assign(blocks, false);
+    this->block_count = block_count;
+    this->start = start;
+    this->save();
+    LOG_INFO << "Scrub queue moved to block " << start << ".";
+}
@@ -0,0 +1,417 @@
+#include "file/striped_file.h"
+#include "util/log.h"
+#include "config.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <sstream>
+
+using BwtFS::Util::Logger;
+namespace fs = std::filesystem;
+
+BwtFS::System::StripedFile::StripedFile(const std::string& manifest) : File(){
+    auto paths = read_manifest(manifest);
+    if (paths.empty()){
+        LOG_ERROR << "Striped volume has no member: " << manifest;
+        throw std::runtime_error(std::string("Striped volume has no member: ") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    for (const auto& path : paths){
+        if (!fs::exists(path)){
+            LOG_ERROR << "Stripe member does not exist: " << path;
+            throw std::runtime_error(std::string("Stripe member does not exist: ") + __FILE__ + ":" + std::to_string(__LINE__));
+        }
+        Member member;
+        member.file = File::open(path);
+        member.worker = std::make_unique<ThreadPool>(1);
+        this->members.push_back(std::move(member));
+    }
+    this->update_size();
+    LOG_INFO << "Striped volume opened: " << manifest << ", " << this->members.size()
+             << " members, size: " << this->file_size - sizeof(unsigned);
+}
+
+BwtFS::System::StripedFile::~StripedFile(){
+    try{
+        this->close();
+    }catch(const std::exception& e){
+        LOG_ERROR << e.what();
+    }
+}
+
+bool BwtFS::System::StripedFile::isManifest(const std::string& path){
+    return fs::path(path).extension() == MANIFEST_EXTENSION;
+}
+
+std::vector<std::string> BwtFS::System::StripedFile::parseMembers(const std::string& members){
+    std::vector<std::string> result;
+    std::stringstream ss(members);
+    std::string item;
+    while (std::getline(ss, item, ',')){
+        item.erase(0, item.find_first_not_of(" \t"));
+        item.erase(item.find_last_not_of(" \t") + 1);
+        if (!item.empty()){
+            result.push_back(item);
+        }
+    }
+    return result;
+}
+
+void BwtFS::System::StripedFile::create(const std::string& manifest, const std::vector<std::string>& members, size_t size){
+    if (members.empty()){
+        LOG_ERROR << "No stripe member is configured: " << manifest;
+        throw std::invalid_argument(std::string("No stripe member is configured: ") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    if (fs::exists(manifest)){
+        LOG_ERROR << "File already exists: " << manifest;
+        throw std::runtime_error(std::string("File already exists: ") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    // 每个成员的块数相同，逻辑块数向上取整
+    size_t blocks = (size + BwtFS::BLOCK_SIZE - 1) / BwtFS::BLOCK_SIZE;
+    size_t member_size = (blocks + members.size() - 1) / members.size() * BwtFS::BLOCK_SIZE;
+    LOG_INFO << "Creating striped volume: " << manifest << ", " << members.size()
+             << " members, " << member_size << " bytes each";
+    // 最小大小按整个卷检查，成员文件不再单独检查
+    if (size < BwtFS::DefaultConfig::SYSTEM_FILE_MIN_SIZE){
+        LOG_ERROR << "File size is too small: " << size << ". Minimum size is " << BwtFS::DefaultConfig::SYSTEM_FILE_MIN_SIZE;
+        throw std::runtime_error(std::string("File size is too small: ") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    // 各成员位于不同磁盘，并行创建
+    // 已经存在的成员文件不会被覆盖，失败时只删除本次创建的
+    std::vector<char> existed(members.size());
+    for (size_t m = 0; m < members.size(); m++){
+        existed[m] = fs::exists(members[m]);
+    }
+    std::vector<std::future<void>> tasks;
+    for (const auto& member : members){
+        tasks.push_back(std::async(std::launch::async, [member, member_size]{
+            File::create_file_(member, member_size, "", nullptr);
+        }));
+    }
+    std::exception_ptr error;
+    for (auto& task : tasks){
+        try{
+            task.get();
+        }catch(...){
+            if (!error){
+                error = std::current_exception();
+            }
+        }
+    }
+    if (error){
+        // 删除已经创建（包括创建到一半）的成员，失败的卷不留下文件
+        for (size_t m = 0; m < members.size(); m++){
+            if (!existed[m]){
+                std::error_code ec;
+                fs::remove(members[m], ec);
+            }
+        }
+        std::rethrow_exception(error);
+    }
+    auto parent = fs::path(manifest).parent_path();
+    if (!parent.empty()){
+        fs::create_directories(parent);
+    }
+    std::ofstream out(manifest);
+    if (!out.is_open()){
+        LOG_ERROR << "Failed to create manifest: " << manifest;
+        throw std::runtime_error(std::string("Failed to create manifest: ") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    out << "# BwtFS stripe manifest, one member per line\n";
+    for (const auto& member : members){
+        out << fs::absolute(member).string() << "\n";
+    }
+    LOG_INFO << "Striped volume created: " << manifest;
+}
+
+std::vector<std::string> BwtFS::System::StripedFile::read_manifest(const std::string& manifest){
+    std::ifstream in(manifest);
+    if (!in.is_open()){
+        LOG_ERROR << "Failed to open manifest: " << manifest;
+        throw std::runtime_error(std::string("Failed to open manifest: ") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    auto base = fs::path(manifest).parent_path();
+    std::vector<std::string> paths;
+    std::string line;
+    while (std::getline(in, line)){
+        line.erase(0, line.find_first_not_of(" \t\r"));
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if (line.empty() || line[0] == '#'){
+            continue;
+        }
+        auto path = fs::path(line);
+        if (path.is_relative()){
+            path = base / path;
+        }
+        paths.push_back(path.make_preferred().string());
+    }
+    return paths;
+}
+
+size_t BwtFS::System::StripedFile::memberCount() const{
+    return this->members.size();
+}
+
+void BwtFS::System::StripedFile::update_size(){
+    size_t min_blocks = SIZE_MAX;
+    for (const auto& member : this->members){
+        auto data_size = member.file->getFileSize() - sizeof(unsigned) - member.file->getPrefixSize();
+        min_blocks = std::min(min_blocks, data_size / BwtFS::BLOCK_SIZE);
+    }
+    // 逻辑卷没有prefix，末尾的prefix大小字段只是占位，使块数的计算与单文件卷一致
+    this->prefix_size = 0;
+    this->has_prefix = false;
+    this->file_size = min_blocks * this->members.size() * BwtFS::BLOCK_SIZE + sizeof(unsigned);
+}
+
+std::pair<size_t, unsigned long long> BwtFS::System::StripedFile::locate(unsigned long long offset) const{
+    auto block = offset / BwtFS::BLOCK_SIZE;
+    auto n = this->members.size();
+    return {block % n, (block / n) * BwtFS::BLOCK_SIZE + offset % BwtFS::BLOCK_SIZE};
+}
+
+template<typename F>
+void BwtFS::System::StripedFile::for_members(const std::vector<size_t>& used, F&& task){
+    if (used.size() == 1){
+        task(used[0]);
+        return;
+    }
+    std::vector<std::future<void>> futures;
+    futures.reserve(used.size());
+    for (auto m : used){
+        futures.push_back(this->members[m].worker->submit([&task, m]{
+            task(m);
+        }));
+    }
+    // 等待全部完成后再抛出第一个异常，避免任务引用已经失效的局部变量
+    std::exception_ptr error;
+    for (auto& f : futures){
+        try{
+            f.get();
+        }catch(...){
+            if (!error){
+                error = std::current_exception();
+            }
+        }
+    }
+    if (error){
+        std::rethrow_exception(error);
+    }
+}
+
+void BwtFS::System::StripedFile::read_range(unsigned long long offset, std::byte* out, size_t size){
+    size_t done = 0;
+    while (done < size){
+        auto [m, member_offset] = this->locate(offset + done);
+        auto n = std::min<size_t>(size - done, BwtFS::BLOCK_SIZE - (offset + done) % BwtFS::BLOCK_SIZE);
+        auto block = this->members[m].file->read(member_offset);
+        std::memcpy(out + done, block.data(), n);
+        done += n;
+    }
+}
+
+BwtFS::Node::BinaryView BwtFS::System::StripedFile::view(unsigned long long index, size_t size){
+    if (size == 1 && index % BwtFS::BLOCK_SIZE == 0 && index < this->file_size){
+        auto [m, member_offset] = this->locate(index);
+        return this->members[m].file->view(member_offset);
+    }
+    return File::view(index, size);
+}
+
+BwtFS::Node::Binary BwtFS::System::StripedFile::read(unsigned long long index){
+    if (index >= this->file_size){
+        LOG_ERROR << "Index out of range: " << index;
+        throw std::out_of_range(std::string("Index out of range") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    if (index % BwtFS::BLOCK_SIZE == 0){
+        auto [m, member_offset] = this->locate(index);
+        return this->members[m].file->read(member_offset);
+    }
+    BwtFS::Node::Binary data(BwtFS::BLOCK_SIZE);
+    this->read_range(index, data.data(), BwtFS::BLOCK_SIZE);
+    return data;
+}
+
+BwtFS::Node::Binary BwtFS::System::StripedFile::read(unsigned long long index, size_t size){
+    if (index + size >= this->file_size){
+        LOG_ERROR << "Index out of range: " << index;
+        throw std::out_of_range(std::string("Index out of range") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    BwtFS::Node::Binary data(size * BwtFS::BLOCK_SIZE);
+    if (index % BwtFS::BLOCK_SIZE != 0){
+        this->read_range(index, data.data(), data.size());
+        return data;
+    }
+    std::vector<unsigned long long> offsets(size);
+    for (size_t i = 0; i < size; i++){
+        offsets[i] = index + i * BwtFS::BLOCK_SIZE;
+    }
+    auto blocks = this->readBatch(offsets);
+    for (size_t i = 0; i < size; i++){
+        std::memcpy(data.data() + i * BwtFS::BLOCK_SIZE, blocks[i].data(), BwtFS::BLOCK_SIZE);
+    }
+    return data;
+}
+
+std::vector<BwtFS::Node::Binary> BwtFS::System::StripedFile::readBatch(const std::vector<unsigned long long>& offsets){
+    std::vector<BwtFS::Node::Binary> result(offsets.size());
+    // 各成员要读取的偏移以及结果对应的位置
+    std::vector<std::vector<unsigned long long>> member_offsets(this->members.size());
+    std::vector<std::vector<size_t>> member_slots(this->members.size());
+    std::vector<size_t> unaligned;
+    for (size_t i = 0; i < offsets.size(); i++){
+        if (offsets[i] >= this->file_size){
+            LOG_ERROR << "Index out of range: " << offsets[i];
+            throw std::out_of_range(std::string("Index out of range") + __FILE__ + ":" + std::to_string(__LINE__));
+        }
+        if (offsets[i] % BwtFS::BLOCK_SIZE != 0){
+            unaligned.push_back(i);
+            continue;
+        }
+        auto [m, member_offset] = this->locate(offsets[i]);
+        member_offsets[m].push_back(member_offset);
+        member_slots[m].push_back(i);
+    }
+    std::vector<size_t> used;
+    for (size_t m = 0; m < this->members.size(); m++){
+        if (!member_offsets[m].empty()){
+            used.push_back(m);
+        }
+    }
+    if (!used.empty()){
+        this->for_members(used, [&](size_t m){
+            auto blocks = this->members[m].file->readBatch(member_offsets[m]);
+            for (size_t j = 0; j < blocks.size(); j++){
+                result[member_slots[m][j]] = std::move(blocks[j]);
+            }
+        });
+    }
+    for (auto i : unaligned){
+        result[i] = this->read(offsets[i]);
+    }
+    return result;
+}
+
+void BwtFS::System::StripedFile::write(unsigned long long index, const BwtFS::Node::Binary& data){
+    if (index + data.size() >= this->file_size){
+        LOG_ERROR << "Index out of range: " << index;
+        throw std::out_of_range(std::string("Index out of range") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    // 不跨块的写入直接写到成员
+    if (index % BwtFS::BLOCK_SIZE + data.size() <= BwtFS::BLOCK_SIZE){
+        auto [m, member_offset] = this->locate(index);
+        this->members[m].file->write(member_offset, data);
+        return;
+    }
+    // 跨块的写入（如位图）由批量写入按块拆分
+    this->writeBatch({{index, data}});
+}
+
+void BwtFS::System::StripedFile::writeBatch(const std::vector<BlockWrite>& writes){
+    std::vector<std::vector<BlockWrite>> member_writes(this->members.size());
+    for (const auto& w : writes){
+        if (w.offset + w.data.size() >= this->file_size){
+            LOG_ERROR << "Index out of range: " << w.offset;
+            throw std::out_of_range(std::string("Index out of range") + __FILE__ + ":" + std::to_string(__LINE__));
+        }
+        // 跨块的写入（如合并后的连续位图页）按块拆分到各成员
+        size_t done = 0;
+        while (done < w.data.size()){
+            auto n = std::min<size_t>(w.data.size() - done, BwtFS::BLOCK_SIZE - (w.offset + done) % BwtFS::BLOCK_SIZE);
+            auto [m, member_offset] = this->locate(w.offset + done);
+            if (n == w.data.size()){
+                member_writes[m].push_back({member_offset, w.data});
+            }else{
+                member_writes[m].push_back({member_offset, w.data.slice(done, n)});
+            }
+            done += n;
+        }
+    }
+    std::vector<size_t> used;
+    for (size_t m = 0; m < this->members.size(); m++){
+        if (!member_writes[m].empty()){
+            used.push_back(m);
+        }
+    }
+    if (used.empty()){
+        return;
+    }
+    this->for_members(used, [&](size_t m){
+        this->members[m].file->writeBatch(member_writes[m]);
+    });
+}
+
+void BwtFS::System::StripedFile::sync(){
+    std::vector<size_t> used(this->members.size());
+    for (size_t m = 0; m < used.size(); m++){
+        used[m] = m;
+    }
+    this->for_members(used, [this](size_t m){
+        this->members[m].file->sync();
+    });
+}
+
+void BwtFS::System::StripedFile::grow(size_t size, const BwtFS::Node::Binary& tail){
+    size_t blocks = size / BwtFS::BLOCK_SIZE;
+    size_t member_size = (blocks + this->members.size() - 1) / this->members.size() * BwtFS::BLOCK_SIZE;
+    std::vector<size_t> used;
+    for (size_t m = 0; m < this->members.size(); m++){
+        auto& file = this->members[m].file;
+        if (file->getFileSize() - sizeof(unsigned) - file->getPrefixSize() < member_size){
+            used.push_back(m);
+        }
+    }
+    if (used.empty()){
+        LOG_ERROR << "New size must be larger than the current size: " << size;
+        throw std::invalid_argument(std::string("New size must be larger than the current size: ") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    // 逻辑上的最后一个块是最后一个成员的最后一个块，tail交给它写入
+    // 所有成员都扩大后逻辑块数才改变，此时最后一个块中已经是tail
+    if (tail.size() > 0 && used.back() + 1 != this->members.size()){
+        // 上次扩大中断时最后一个成员可能已经扩大，直接写入它的最后一个块
+        auto& last = this->members.back().file;
+        last->write(member_size - BwtFS::BLOCK_SIZE, tail);
+        last->sync();
+    }
+    this->for_members(used, [this, member_size, &tail](size_t m){
+        if (m + 1 == this->members.size()){
+            this->members[m].file->grow(member_size, tail);
+        }else{
+            this->members[m].file->grow(member_size);
+        }
+    });
+    this->update_size();
+}
+
+void BwtFS::System::StripedFile::materialize(unsigned long long index){
+    auto [m, member_offset] = this->locate(index);
+    this->members[m].file->materialize(member_offset);
+}
+
+void BwtFS::System::StripedFile::startBackgroundFill(){
+    for (auto& member : this->members){
+        member.file->startBackgroundFill();
+    }
+}
+
+bool BwtFS::System::StripedFile::isThin() const{
+    return std::any_of(this->members.begin(), this->members.end(), [](const Member& member){
+        return member.file->isThin();
+    });
+}
+
+void BwtFS::System::StripedFile::close(){
+    for (auto& member : this->members){
+        if (member.worker != nullptr){
+            member.worker->shutdown();
+            member.worker.reset();
+        }
+        if (member.file != nullptr){
+            member.file->close();
+        }
+    }
+    this->members.clear();
+    File::close();
+}
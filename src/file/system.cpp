@@ -2,15 +2,60 @@
 #include "config.h"
 #include "util/ini_parser.h"
 #include "util/cell.h"
+#include "util/crypto_engine.h"
 #include "util/log.h"
 #include "util/date.h"
+#include "util/random.h"
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
 #include <random>
 #include <ctime>
+#include <climits>
 #include <filesystem>
+#include <chrono>
+#ifdef __linux__
+#include <sys/resource.h>
+#endif
 
 using BwtFS::Util::Logger;
 
+namespace{
+    // 认证块（修改时间、超级块哈希、种子）占用最后一个块，由位图保留
+    unsigned long long auth_offset(size_t block_count){
+        return (unsigned long long)(block_count - 1) * BwtFS::BLOCK_SIZE;
+    }
+    // 旧版本按字节偏移block_count-1写入认证块，落在可分配的数据块中，打开时迁移
+    unsigned long long legacy_auth_offset(size_t block_count){
+        return block_count - 1;
+    }
+    // 扩容时新的认证块先写入预留块（倒数第二个块），重写超级块后再写到最后一个块
+    unsigned long long grow_auth_offset(size_t block_count){
+        return (unsigned long long)(block_count - 2) * BwtFS::BLOCK_SIZE;
+    }
+    // 按文件大小计算的块数，认证块总在它的最后一个块中
+    // 扩容在重写超级块之前中断时大于超级块中的块数，多出的块不使用
+    unsigned file_block_count(const std::shared_ptr<BwtFS::System::File>& file){
+        return (file->getFileSize() - sizeof(unsigned) - file->getPrefixSize()) / BwtFS::BLOCK_SIZE;
+    }
+    // 用认证块中的种子解密超级块并校验哈希
+    bool verify_auth(const std::shared_ptr<BwtFS::System::File>& file, BwtFS::Node::Binary& auth_block){
+        auto hash_value = auth_block.read(sizeof(unsigned long long), sizeof(size_t));
+        auto seed_of_cell = auth_block.read(sizeof(unsigned long long) + sizeof(size_t), sizeof(unsigned));
+        auto system_info = file->read(0);
+        BwtFS::Util::RCA cell(reinterpret_cast<unsigned&>(seed_of_cell[0]), system_info);
+        cell.backward();
+        std::hash<std::string> hash_fn;
+        return hash_fn(system_info.to_hex_string()) == reinterpret_cast<size_t&>(hash_value[0]);
+    }
+    // 后台擦除每批的块数
+    constexpr size_t SCRUB_BATCH = 256;
+    // 后台擦除连续失败时的重试次数和退避时间（每次加倍，不超过上限）
+    constexpr size_t SCRUB_RETRIES = 8;
+    constexpr std::chrono::microseconds SCRUB_BACKOFF{100000};
+    constexpr std::chrono::microseconds SCRUB_BACKOFF_MAX{30000000};
+}
+
 bool BwtFS::System::createBwtFS(){
     auto config = BwtFS::Config::getInstance();
     return BwtFS::System::createBwtFS(config["system_file"]["path"], std::stoull(config["system_file"]["size"]), config["system_file"]["prefix"]);
@@ -38,9 +83,9 @@ bool BwtFS::System::initBwtFS(const std::string& path){
         LOG_ERROR << "File does not exist: " << path_;
         return false;
     }
-    BwtFS::System::File file(path_);
+    auto file = BwtFS::System::File::open(path_);
     uint8_t version = BwtFS::VERSION;
-    size_t file_size = file.getFileSize() - sizeof(unsigned) - file.getPrefixSize();
+    size_t file_size = file->getFileSize() - sizeof(unsigned) - file->getPrefixSize();
     unsigned block_size = BwtFS::BLOCK_SIZE;
     unsigned block_count = file_size / block_size;
     unsigned long long create_time = std::time(nullptr);
@@ -51,12 +96,39 @@ bool BwtFS::System::initBwtFS(const std::string& path){
     std::uniform_int_distribution<int> distribution_bitmap_wear((int)(0.5*block_count), (int)(0.8*block_count));
     size_t bitmap = distribution_bitmap(generator);
     size_t bitmap_wear = distribution_bitmap_wear(generator);
+    // 校验和区域放在磨损位图之后、认证块之前
+    std::uniform_int_distribution<size_t> distribution_checksum((size_t)(0.82*block_count), (size_t)(0.9*block_count));
+    size_t checksum = distribution_checksum(generator);
+    // 日志区域放在校验和区域之后，最多占块数量的1/64
+    size_t journal_blocks = std::stoull(BwtFS::Config::getInstance().get("system", "journal_blocks",
+        std::to_string(BwtFS::DefaultConfig::SYSTEM_FILE_JOURNAL_BLOCKS)));
+    journal_blocks = std::clamp<size_t>(journal_blocks, 2, std::max<size_t>(2, block_count / 64));
+    std::uniform_int_distribution<size_t> distribution_journal((size_t)(0.91*block_count), (size_t)(0.95*block_count));
+    size_t journal = distribution_journal(generator);
+    // 擦除队列区域放在日志区域之后
+    std::uniform_int_distribution<size_t> distribution_scrub((size_t)(0.97*block_count), (size_t)(0.98*block_count));
+    size_t scrub = distribution_scrub(generator);
+    // 节点加密算法，ChaCha20的密钥与卷一起随机生成
+    size_t cipher;
+    try{
+        cipher = static_cast<size_t>(BwtFS::Util::CryptoEngine::parseCipher(BwtFS::Config::getInstance().get("system", "cipher",
+            BwtFS::DefaultConfig::SYSTEM_FILE_CIPHER)));
+    }catch(const std::exception& e){
+        LOG_ERROR << "Failed to initialize BwtFS system file: " << e.what();
+        return false;
+    }
+    BwtFS::Util::ChaCha20Key cipher_key;
+    std::random_device random_device;
+    for (auto& b : cipher_key){
+        b = static_cast<uint8_t>(random_device());
+    }
 
     LOG_DEBUG << "Version: " << (int)version;
     LOG_DEBUG << "File size: " << file_size;
     LOG_DEBUG << "Block size: " << block_size;
     LOG_DEBUG << "Block count: " << block_count;
     LOG_DEBUG << "Create time: " << create_time;
+    LOG_DEBUG << "Cipher: " << BwtFS::Util::CryptoEngine::cipherName(static_cast<BwtFS::Util::Cipher>(cipher));
     // LOG_DEBUG << "Modify time: " << modify_time;
     // LOG_DEBUG << "Bitmap size: " << bitmap_size;
     // LOG_DEBUG << "Bitmap start: " << bitmap;
@@ -71,24 +143,39 @@ bool BwtFS::System::initBwtFS(const std::string& path){
     binary.append(sizeof(bitmap), reinterpret_cast<std::byte*>(&bitmap));
     binary.append(sizeof(bitmap_wear), reinterpret_cast<std::byte*>(&bitmap_wear));
     binary.append(sizeof(bitmap_size), reinterpret_cast<std::byte*>(&bitmap_size));
-    file.write(0, binary);
-    auto data = file.read(0);
+    binary.append(sizeof(checksum), reinterpret_cast<std::byte*>(&checksum));
+    binary.append(sizeof(journal), reinterpret_cast<std::byte*>(&journal));
+    binary.append(sizeof(journal_blocks), reinterpret_cast<std::byte*>(&journal_blocks));
+    binary.append(sizeof(scrub), reinterpret_cast<std::byte*>(&scrub));
+    binary.append(sizeof(cipher), reinterpret_cast<std::byte*>(&cipher));
+    binary.append(cipher_key.size(), reinterpret_cast<std::byte*>(cipher_key.data()));
+    file->write(0, binary);
+    auto data = file->read(0);
     std::hash<std::string> hash_fn;
     size_t string_hash_value = hash_fn(data.to_hex_string());
     std::uniform_int_distribution<unsigned> random_distribution(0, std::numeric_limits<unsigned>::max());
     unsigned seed_of_cell = random_distribution(generator);
     BwtFS::Util::RCA cell(seed_of_cell, data);
     cell.forward();
-    file.write(0, data);
+    file->write(0, data);
     BwtFS::Node::Binary auth(0);
     auth.append(sizeof(modify_time), reinterpret_cast<std::byte*>(&modify_time));
     auth.append(sizeof(string_hash_value), reinterpret_cast<std::byte*>(&string_hash_value));
     auth.append(sizeof(unsigned), reinterpret_cast<std::byte*>(&seed_of_cell));
-    file.write(block_count-1, auth);
-    file.close();
+    file->write(auth_offset(block_count), auth);
     // bitmap初始化
-    BwtFS::System::Bitmap bitmap_obj(bitmap, bitmap_wear, bitmap_size, block_count, std::make_shared<BwtFS::System::File>(path_));
-    bitmap_obj.init(block_count-1);
+    BwtFS::System::Bitmap bitmap_obj(bitmap, bitmap_wear, bitmap_size, block_count, file);
+    bitmap_obj.init(block_count-1, {{checksum, BwtFS::System::ChecksumMap::regionBytes(block_count)},
+                                    {journal, BwtFS::System::Journal::regionBytes(journal_blocks)},
+                                    {scrub, BwtFS::System::ScrubQueue::regionBytes(block_count)}});
+    BwtFS::System::ChecksumMap checksum_obj(checksum, block_count, file);
+    checksum_obj.init();
+    BwtFS::System::Journal journal_obj(journal, journal_blocks, file);
+    journal_obj.init();
+    BwtFS::System::ScrubQueue scrub_obj(scrub, block_count, file);
+    scrub_obj.init();
+    file->sync();
+    file->close();
     LOG_DEBUG << "BwtFS system file initialized: " << path_;
     return true;
 }
@@ -99,9 +186,27 @@ std::shared_ptr<BwtFS::System::FileSystem> BwtFS::System::openBwtFS(const std::s
         LOG_ERROR << "File does not exist: " << path_;
         throw std::runtime_error(std::string("File does not exist: ") + __FILE__ + ":" + std::to_string(__LINE__));
     }
-    auto file = std::make_shared<BwtFS::System::File>(path_);
-    unsigned block_count_ = (file->getFileSize() - sizeof(unsigned) - file->getPrefixSize()) / BwtFS::BLOCK_SIZE;
-    auto auth_block = file->read(block_count_ - 1);
+    auto file = BwtFS::System::File::open(path_);
+    unsigned block_count_ = file_block_count(file);
+    auto auth_block = file->read(auth_offset(block_count_));
+    if (!verify_auth(file, auth_block)){
+        auto legacy_block = file->read(legacy_auth_offset(block_count_));
+        if (verify_auth(file, legacy_block)){
+            LOG_WARNING << "Authentication block found at the legacy offset, moved to the last block: " << path_;
+            file->write(auth_offset(block_count_), legacy_block.read(0, sizeof(unsigned long long) + sizeof(size_t) + sizeof(unsigned)));
+            file->sync();
+            auth_block = file->read(auth_offset(block_count_));
+        }
+    }
+    if (!verify_auth(file, auth_block)){
+        auto grow_block = file->read(grow_auth_offset(block_count_));
+        if (verify_auth(file, grow_block)){
+            LOG_WARNING << "File system grow was interrupted after the superblock was rewritten, authentication block restored: " << path_;
+            file->write(auth_offset(block_count_), grow_block.read(0, sizeof(unsigned long long) + sizeof(size_t) + sizeof(unsigned)));
+            file->sync();
+            auth_block = file->read(auth_offset(block_count_));
+        }
+    }
     auto modify_time = auth_block.read(0, sizeof(unsigned long long));
     auto hash_value = auth_block.read(sizeof(unsigned long long), sizeof(size_t));
     auto seed_of_cell = auth_block.read(sizeof(unsigned long long) + sizeof(size_t), sizeof(unsigned));
@@ -150,10 +255,9 @@ std::shared_ptr<BwtFS::System::FileSystem> BwtFS::System::openBwtFS(const std::s
     }
     LOG_INFO << "System verification passed: " << path_;
     LOG_INFO << "Last Modified: " << BwtFS::Util::timeToString(reinterpret_cast<unsigned long long&>(modify_time[0]));
-    auto fs = BwtFS::System::FileSystem(file);
-    fs.setHashValue(string_hash_value);
-    fs.setSeedOfCell(reinterpret_cast<unsigned&>(seed_of_cell[0]));
     BwtFS::System::FS = std::make_shared<BwtFS::System::FileSystem>(file);
+    BwtFS::System::FS->setHashValue(string_hash_value);
+    BwtFS::System::FS->setSeedOfCell(reinterpret_cast<unsigned&>(seed_of_cell[0]));
     return BwtFS::System::FS;
 }
 
@@ -167,8 +271,8 @@ std::shared_ptr<BwtFS::System::FileSystem> BwtFS::System::getBwtFS(){
 
 BwtFS::System::FileSystem::FileSystem(std::shared_ptr<BwtFS::System::File> file){
     this->file = file;
-    unsigned block_count_ = (file->getFileSize() - sizeof(unsigned) - file->getPrefixSize()) / BwtFS::BLOCK_SIZE;
-    auto auth_block = file->read(block_count_ - 1);
+    unsigned block_count_ = file_block_count(file);
+    auto auth_block = file->read(auth_offset(block_count_));
     auto modify_time = auth_block.read(0, sizeof(unsigned long long));
     auto hash_value = auth_block.read(sizeof(unsigned long long), sizeof(size_t));
     auto seed_of_cell = auth_block.read(sizeof(unsigned long long) + sizeof(size_t), sizeof(unsigned));
@@ -183,15 +287,223 @@ BwtFS::System::FileSystem::FileSystem(std::shared_ptr<BwtFS::System::File> file)
     this->BITMAP_START = reinterpret_cast<unsigned long long&>(system_info.read(sizeof(uint8_t) + sizeof(size_t) + sizeof(unsigned) * 2 + sizeof(unsigned long long), sizeof(size_t))[0]);
     this->BITMAP_WEAR_START = reinterpret_cast<unsigned long long&>(system_info.read(sizeof(uint8_t) + sizeof(size_t) + sizeof(unsigned) * 2 + sizeof(unsigned long long) * 2, sizeof(size_t))[0]);
     this->BITMAP_SIZE = reinterpret_cast<unsigned long long&>(system_info.read(sizeof(uint8_t) + sizeof(size_t) + sizeof(unsigned) * 2 + sizeof(unsigned long long) * 3, sizeof(size_t))[0]);
+    if (block_count_ > this->BLOCK_COUNT){
+        LOG_WARNING << "File system grow was interrupted before the superblock was rewritten, "
+                    << block_count_ - this->BLOCK_COUNT << " blocks at the end are unused until the next grow.";
+    }
     this->is_open = true;
     this->MODIFY_TIME = reinterpret_cast<unsigned long long&>(modify_time[0]);
+    this->STRING_HASH_VALUE = reinterpret_cast<size_t&>(hash_value[0]);
+    this->SEED_OF_CELL = reinterpret_cast<unsigned&>(seed_of_cell[0]);
     this->bitmap = std::make_shared<BwtFS::System::Bitmap>(this->BITMAP_START, this->BITMAP_WEAR_START, this->BITMAP_SIZE, this->BLOCK_COUNT, file);
+    if (this->VERSION >= 1){
+        this->CHECKSUM_START = reinterpret_cast<unsigned long long&>(system_info.read(sizeof(uint8_t) + sizeof(size_t) + sizeof(unsigned) * 2 + sizeof(unsigned long long) * 4, sizeof(size_t))[0]);
+        this->checksums = std::make_shared<BwtFS::System::ChecksumMap>(this->CHECKSUM_START, this->BLOCK_COUNT, file);
+    }else{
+        this->CHECKSUM_START = 0;
+        LOG_WARNING << "File system version " << (int)this->VERSION << " has no block checksums, reads are not verified.";
+    }
+    if (this->VERSION >= 3){
+        this->SCRUB_START = reinterpret_cast<unsigned long long&>(system_info.read(sizeof(uint8_t) + sizeof(size_t) + sizeof(unsigned) * 2 + sizeof(unsigned long long) * 7, sizeof(size_t))[0]);
+        this->scrubs = std::make_shared<BwtFS::System::ScrubQueue>(this->SCRUB_START, this->BLOCK_COUNT, file);
+    }else{
+        this->SCRUB_START = 0;
+    }
+    if (this->VERSION >= 4){
+        this->CIPHER = static_cast<uint8_t>(reinterpret_cast<size_t&>(system_info.read(sizeof(uint8_t) + sizeof(size_t) + sizeof(unsigned) * 2 + sizeof(unsigned long long) * 8, sizeof(size_t))[0]));
+        auto key_data = system_info.read(sizeof(uint8_t) + sizeof(size_t) + sizeof(unsigned) * 2 + sizeof(unsigned long long) * 9, sizeof(BwtFS::Util::ChaCha20Key));
+        if (this->CIPHER > static_cast<uint8_t>(BwtFS::Util::Cipher::CHACHA20)){
+            LOG_ERROR << "Unknown cipher: " << (int)this->CIPHER;
+            throw std::runtime_error(std::string("Unknown cipher: ") + __FILE__ + ":" + std::to_string(__LINE__));
+        }
+        BwtFS::Util::ChaCha20Key key;
+        std::memcpy(key.data(), key_data.data(), key.size());
+        // 版本5起ChaCha20的nonce按写入分配并保存在块末尾，版本4由块位置和seed、level生成
+        bool legacy_nonce = this->VERSION < 5;
+        if (legacy_nonce && this->CIPHER == static_cast<uint8_t>(BwtFS::Util::Cipher::CHACHA20)){
+            LOG_WARNING << "File system version " << (int)this->VERSION << " derives ChaCha20 nonces from the block position, "
+                        << "a reused block repeats the nonce with probability about 1/65536.";
+        }
+        BwtFS::Util::CryptoEngine::getInstance().setCipher(static_cast<BwtFS::Util::Cipher>(this->CIPHER), key, legacy_nonce);
+    }else{
+        // 版本4之前的文件系统只使用RCA
+        this->CIPHER = static_cast<uint8_t>(BwtFS::Util::Cipher::RCA);
+        BwtFS::Util::CryptoEngine::getInstance().setCipher(BwtFS::Util::Cipher::RCA);
+    }
+    LOG_INFO << "Node cipher: " << BwtFS::Util::CryptoEngine::cipherName(static_cast<BwtFS::Util::Cipher>(this->CIPHER));
+    if (this->VERSION >= 2){
+        this->JOURNAL_START = reinterpret_cast<unsigned long long&>(system_info.read(sizeof(uint8_t) + sizeof(size_t) + sizeof(unsigned) * 2 + sizeof(unsigned long long) * 5, sizeof(size_t))[0]);
+        this->JOURNAL_BLOCKS = reinterpret_cast<unsigned long long&>(system_info.read(sizeof(uint8_t) + sizeof(size_t) + sizeof(unsigned) * 2 + sizeof(unsigned long long) * 6, sizeof(size_t))[0]);
+        this->journal = std::make_shared<BwtFS::System::Journal>(this->JOURNAL_START, this->JOURNAL_BLOCKS, file);
+        // 重放上次关闭前提交的修改，写回后清空日志
+        auto replay_time = this->MODIFY_TIME;
+        auto entries = this->journal->replay(replay_time);
+        if (!entries.empty()){
+            this->bitmap->replay(entries);
+            if (this->checksums){
+                this->checksums->replay(entries);
+            }
+            if (this->scrubs){
+                this->scrubs->replay(entries);
+            }
+            this->bitmap->flush();
+            if (this->checksums){
+                this->checksums->flush();
+            }
+            if (this->scrubs){
+                this->scrubs->flush();
+            }
+            this->updateModifyTime(replay_time);
+            file->sync();
+            this->journal->reset();
+            file->sync();
+        }
+    }else{
+        this->JOURNAL_START = 0;
+        this->JOURNAL_BLOCKS = 0;
+    }
+    // 精简文件在后台逐步填满剩余空洞
+    file->startBackgroundFill();
+    this->start_scrub_();
+}
+
+BwtFS::System::FileSystem::~FileSystem(){
+    this->stop_scrub_();
+}
+
+void BwtFS::System::FileSystem::freeBlocks(std::span<const size_t> indices){
+    // 擦除线程退出时在同一把锁下清除标记后释放队列，这里入队的块不会被遗漏
+    bool queued = false;
+    {
+        std::lock_guard<std::mutex> lock(this->scrubber_mutex);
+        if (this->scrubber_running){
+            this->scrubs->enqueue(indices);
+            queued = true;
+        }
+    }
+    if (!queued){
+        this->bitmap->clearMany(indices);
+        return;
+    }
+    this->scrubber_cv.notify_all();
+}
+
+void BwtFS::System::FileSystem::start_scrub_(){
+    if (!this->scrubs){
+        return;
+    }
+    auto& config = BwtFS::Config::getInstance();
+    size_t rate = std::stoull(config.get("system", "scrub_rate",
+                                std::to_string(BwtFS::DefaultConfig::SYSTEM_FILE_SCRUB_RATE)));
+    if (rate == 0){
+        // 不擦除时，之前留在队列中的块直接释放
+        auto queued = this->scrubs->next(this->scrubs->size());
+        if (!queued.empty()){
+            this->bitmap->clearMany(queued);
+            this->scrubs->remove(queued);
+            this->sync();
+            LOG_INFO << "Scrub is disabled, " << queued.size() << " queued blocks released.";
+        }
+        return;
+    }
+    if (this->scrubs->size() > 0){
+        LOG_INFO << this->scrubs->size() << " blocks waiting to be scrubbed.";
+    }
+    this->scrubber_stop = false;
+    this->scrubber_running = true;
+    this->scrubber = std::thread([this, rate]{
+        this->scrub_(rate * BwtFS::MB);
+    });
+}
+
+void BwtFS::System::FileSystem::stop_scrub_(){
+    if (!this->scrubber.joinable()){
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(this->scrubber_mutex);
+        this->scrubber_stop = true;
+    }
+    this->scrubber_cv.notify_all();
+    this->scrubber.join();
+}
+
+void BwtFS::System::FileSystem::scrub_(size_t rate){
+#ifdef __linux__
+    // Linux下nice值按线程生效，只降低擦除线程的优先级
+    ::setpriority(PRIO_PROCESS, 0, 19);
+#endif
+    BwtFS::Util::FastRandom rng(std::random_device{}());
+    std::vector<std::byte> buffer;
+    std::vector<std::pair<unsigned long long, BwtFS::Node::BinaryView>> writes;
+    size_t failures = 0;
+    while (!this->scrubber_stop){
+        std::chrono::microseconds wait;
+        try{
+            auto batch = this->scrubs->next(SCRUB_BATCH);
+            if (batch.empty()){
+                std::unique_lock<std::mutex> lock(this->scrubber_mutex);
+                this->scrubber_cv.wait(lock, [this]{ return this->scrubber_stop.load() || this->scrubs->size() > 0; });
+                continue;
+            }
+            buffer.resize(batch.size() * BwtFS::BLOCK_SIZE);
+            rng.fill(buffer.data(), buffer.size());
+            writes.clear();
+            for (size_t i = 0; i < batch.size(); i++){
+                writes.push_back({batch[i], BwtFS::Node::BinaryView(buffer.data() + i * BwtFS::BLOCK_SIZE, BwtFS::BLOCK_SIZE)});
+            }
+            // 经过writeBlocks写入，校验和随随机数据一起更新
+            this->writeBlocks(writes);
+            // 随机数据写入后才释放，释放和出队在同一次提交中落盘
+            this->bitmap->clearMany(batch);
+            this->scrubs->remove(batch);
+            this->sync();
+            failures = 0;
+            // 按限速等待
+            wait = std::chrono::microseconds(batch.size() * BwtFS::BLOCK_SIZE * 1000000 / rate);
+        }catch(const std::exception& e){
+            // 这一批留在队列中，退避后重试；连续失败过多时不再擦除
+            failures++;
+            if (failures > SCRUB_RETRIES){
+                LOG_ERROR << "Background scrub failed " << failures << " times, scrub stopped: " << e.what();
+                break;
+            }
+            wait = std::min<std::chrono::microseconds>(SCRUB_BACKOFF * (1ULL << (failures - 1)), SCRUB_BACKOFF_MAX);
+            LOG_WARNING << "Background scrub failed, retry in " << wait.count() / 1000 << " ms: " << e.what();
+        }
+        // 关闭文件系统时立即退出
+        std::unique_lock<std::mutex> lock(this->scrubber_mutex);
+        this->scrubber_cv.wait_for(lock, wait, [this]{ return this->scrubber_stop.load(); });
+    }
+    if (this->scrubber_stop){
+        return;
+    }
+    // 擦除线程退出后，队列中的块和之后删除的块都直接释放
+    {
+        std::lock_guard<std::mutex> lock(this->scrubber_mutex);
+        this->scrubber_running = false;
+    }
+    try{
+        auto queued = this->scrubs->next(this->scrubs->size());
+        if (!queued.empty()){
+            this->bitmap->clearMany(queued);
+            this->scrubs->remove(queued);
+            this->sync();
+            LOG_WARNING << queued.size() << " queued blocks released without scrubbing.";
+        }
+    }catch(const std::exception& e){
+        LOG_ERROR << "Failed to release queued blocks: " << e.what();
+    }
 }
 
 uint8_t BwtFS::System::FileSystem::getVersion() const{
     return this->VERSION;
 }
 
+uint8_t BwtFS::System::FileSystem::getCipher() const{
+    return this->CIPHER;
+}
+
 size_t BwtFS::System::FileSystem::getFileSize() const{
     return this->FILE_SIZE;
 }
@@ -221,8 +533,8 @@ size_t BwtFS::System::FileSystem::getBitmapSize() const{
 }
 
 bool BwtFS::System::FileSystem::check() const{
-    unsigned block_count_ = (file->getFileSize() - sizeof(unsigned) - file->getPrefixSize()) / BwtFS::BLOCK_SIZE;
-    auto auth_block = file->read(block_count_ - 1);
+    unsigned block_count_ = file_block_count(file);
+    auto auth_block = file->read(auth_offset(block_count_));
     auto modify_time = auth_block.read(0, sizeof(unsigned long long));
     auto hash_value = auth_block.read(sizeof(unsigned long long), sizeof(size_t));
     auto seed_of_cell = auth_block.read(sizeof(unsigned long long) + sizeof(size_t), sizeof(unsigned));
@@ -245,13 +557,147 @@ size_t BwtFS::System::FileSystem::getFilesSize() const{
     return this->bitmap->getSystemUsedSize();
 }
 
-void BwtFS::System::FileSystem::updateModifyTime(){
-    this->MODIFY_TIME = std::time(nullptr);
+void BwtFS::System::FileSystem::updateModifyTime(unsigned long long modify_time){
+    // 读写锁仅用于保护元数据
+    std::unique_lock<std::shared_mutex> lock(this->rw_lock);
+    this->MODIFY_TIME = modify_time;
     BwtFS::Node::Binary binary(0);
     binary.append(sizeof(this->MODIFY_TIME), reinterpret_cast<std::byte*>(&this->MODIFY_TIME));
     binary.append(sizeof(this->STRING_HASH_VALUE), reinterpret_cast<std::byte*>(&STRING_HASH_VALUE));
     binary.append(sizeof(unsigned), reinterpret_cast<std::byte*>(&SEED_OF_CELL));
-    this->file->write(this->BLOCK_COUNT - 1, binary);
+    this->file->write(auth_offset(file_block_count(this->file)), binary);
+}
+
+void BwtFS::System::FileSystem::grow(size_t new_size){
+    // 先写回并清空日志，扩容后日志中不会有旧位置的记录
+    std::lock_guard<std::mutex> commit_lock(this->commit_mutex);
+    this->commit_(true);
+    std::unique_lock<std::shared_mutex> lock(this->rw_lock);
+    size_t new_count = new_size / BwtFS::BLOCK_SIZE;
+    if (new_count <= this->BLOCK_COUNT){
+        LOG_ERROR << "New size must be larger than the current size: " << new_size << " <= " << this->FILE_SIZE;
+        throw std::invalid_argument(std::string("New size must be larger than the current size: ") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    if (new_count > UINT_MAX){
+        LOG_ERROR << "Too many blocks: " << new_count;
+        throw std::invalid_argument(std::string("Too many blocks: ") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    // 新的位图和磨损位图放在新增的块中（去掉末尾的认证块和预留块），新增的块全部空闲
+    size_t bitmap_size = new_count / 8 + 1;
+    size_t bitmap_blocks = BwtFS::System::Bitmap::regionBlocks(bitmap_size);
+    size_t wear_blocks = BwtFS::System::Bitmap::regionBlocks(bitmap_size * 8);
+    size_t checksum_blocks = this->checksums ? BwtFS::System::Bitmap::regionBlocks(BwtFS::System::ChecksumMap::regionBytes(new_count)) : 0;
+    size_t scrub_blocks = this->scrubs ? BwtFS::System::Bitmap::regionBlocks(BwtFS::System::ScrubQueue::regionBytes(new_count)) : 0;
+    size_t added = new_count - this->BLOCK_COUNT - 2;
+    if (new_count - this->BLOCK_COUNT < 2 || added < bitmap_blocks + wear_blocks + checksum_blocks + scrub_blocks){
+        LOG_ERROR << "Grow size is too small to hold the new bitmap: " << new_size;
+        throw std::invalid_argument(std::string("Grow size is too small to hold the new bitmap: ") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    // 扩容分步写入，每一步之后刷盘，任何一步中断后卷都能打开：
+    // 1. 扩大系统文件，新的最后一个块中先写入当前超级块的认证块，其余新增空间为随机数据
+    //    中断后按新的文件大小打开，仍使用原来的超级块和位图，新增的块不使用
+    // 2. 位图、校验和表和擦除队列写到新增的块中，原来的超级块不引用这些块
+    // 3. 新的认证块写入新的预留块，再重写超级块
+    //    重写后中断时最后一个块中的认证块校验失败，打开时从预留块恢复
+    // 4. 新的认证块写入最后一个块，预留块重新填充随机数据
+    // 条带卷会把大小向上取整到成员数的整数倍，块数以扩大后的文件为准
+    BwtFS::Node::Binary old_auth(0);
+    old_auth.append(sizeof(this->MODIFY_TIME), reinterpret_cast<std::byte*>(&this->MODIFY_TIME));
+    old_auth.append(sizeof(this->STRING_HASH_VALUE), reinterpret_cast<std::byte*>(&this->STRING_HASH_VALUE));
+    old_auth.append(sizeof(unsigned), reinterpret_cast<std::byte*>(&this->SEED_OF_CELL));
+    this->file->grow(new_size, old_auth);
+    this->file->sync();
+    new_size = this->file->getFileSize() - sizeof(unsigned) - this->file->getPrefixSize();
+    new_count = new_size / BwtFS::BLOCK_SIZE;
+    bitmap_size = new_count / 8 + 1;
+    bitmap_blocks = BwtFS::System::Bitmap::regionBlocks(bitmap_size);
+    wear_blocks = BwtFS::System::Bitmap::regionBlocks(bitmap_size * 8);
+    checksum_blocks = this->checksums ? BwtFS::System::Bitmap::regionBlocks(BwtFS::System::ChecksumMap::regionBytes(new_count)) : 0;
+    scrub_blocks = this->scrubs ? BwtFS::System::Bitmap::regionBlocks(BwtFS::System::ScrubQueue::regionBytes(new_count)) : 0;
+    added = new_count - this->BLOCK_COUNT - 2;
+    std::default_random_engine generator(std::random_device{}());
+    size_t slack = added - bitmap_blocks - wear_blocks - checksum_blocks - scrub_blocks;
+    size_t bitmap_gap = std::uniform_int_distribution<size_t>(0, slack)(generator);
+    size_t wear_gap = std::uniform_int_distribution<size_t>(0, slack - bitmap_gap)(generator);
+    size_t checksum_gap = std::uniform_int_distribution<size_t>(0, slack - bitmap_gap - wear_gap)(generator);
+    size_t scrub_gap = std::uniform_int_distribution<size_t>(0, slack - bitmap_gap - wear_gap - checksum_gap)(generator);
+    size_t bitmap_start = this->BLOCK_COUNT + bitmap_gap;
+    size_t bitmap_wear_start = bitmap_start + bitmap_blocks + wear_gap;
+    size_t checksum_start = this->checksums ? bitmap_wear_start + wear_blocks + checksum_gap : 0;
+    size_t scrub_start = this->scrubs ? bitmap_wear_start + wear_blocks + checksum_blocks + checksum_gap + scrub_gap : 0;
+    LOG_INFO << "Growing file system: " << this->BLOCK_COUNT << " -> " << new_count << " blocks.";
+
+    // 2. 位图和校验和表迁移到新位置
+    // 校验和表先迁移，原区域释放后不会再被写入
+    std::vector<BwtFS::System::Region> released, reserved;
+    if (this->checksums){
+        this->checksums->grow(new_count, checksum_start);
+        released.push_back({this->CHECKSUM_START, BwtFS::System::ChecksumMap::regionBytes(this->BLOCK_COUNT)});
+        reserved.push_back({checksum_start, BwtFS::System::ChecksumMap::regionBytes(new_count)});
+    }
+    if (this->scrubs){
+        this->scrubs->grow(new_count, scrub_start);
+        released.push_back({this->SCRUB_START, BwtFS::System::ScrubQueue::regionBytes(this->BLOCK_COUNT)});
+        reserved.push_back({scrub_start, BwtFS::System::ScrubQueue::regionBytes(new_count)});
+    }
+    this->bitmap->grow(new_count, bitmap_start, bitmap_wear_start, released, reserved);
+    this->file->sync();
+    // 3. 重写超级块，字段位置与initBwtFS一致，其余随机字节保持不变
+    auto system_info = this->file->read(0);
+    BwtFS::Util::RCA decoder(this->SEED_OF_CELL, system_info);
+    decoder.backward();
+    unsigned block_size = BwtFS::BLOCK_SIZE;
+    unsigned block_count = new_count;
+    size_t offset = sizeof(this->VERSION);
+    system_info.write(offset, sizeof(new_size), reinterpret_cast<std::byte*>(&new_size));
+    offset += sizeof(new_size);
+    system_info.write(offset, sizeof(block_size), reinterpret_cast<std::byte*>(&block_size));
+    offset += sizeof(block_size);
+    system_info.write(offset, sizeof(block_count), reinterpret_cast<std::byte*>(&block_count));
+    offset += sizeof(block_count) + sizeof(this->CREATE_TIME);
+    system_info.write(offset, sizeof(bitmap_start), reinterpret_cast<std::byte*>(&bitmap_start));
+    offset += sizeof(bitmap_start);
+    system_info.write(offset, sizeof(bitmap_wear_start), reinterpret_cast<std::byte*>(&bitmap_wear_start));
+    offset += sizeof(bitmap_wear_start);
+    system_info.write(offset, sizeof(bitmap_size), reinterpret_cast<std::byte*>(&bitmap_size));
+    offset += sizeof(bitmap_size);
+    if (this->checksums){
+        system_info.write(offset, sizeof(checksum_start), reinterpret_cast<std::byte*>(&checksum_start));
+    }
+    // 日志区域位置不变，擦除队列区域在日志起始位置和块数之后，加密算法和密钥不变
+    offset += sizeof(checksum_start) + sizeof(this->JOURNAL_START) + sizeof(this->JOURNAL_BLOCKS);
+    if (this->scrubs){
+        system_info.write(offset, sizeof(scrub_start), reinterpret_cast<std::byte*>(&scrub_start));
+    }
+    std::hash<std::string> hash_fn;
+    this->STRING_HASH_VALUE = hash_fn(system_info.to_hex_string());
+    BwtFS::Util::RCA encoder(this->SEED_OF_CELL, system_info);
+    encoder.forward();
+    this->MODIFY_TIME = std::time(nullptr);
+    BwtFS::Node::Binary auth(0);
+    auth.append(sizeof(this->MODIFY_TIME), reinterpret_cast<std::byte*>(&this->MODIFY_TIME));
+    auth.append(sizeof(this->STRING_HASH_VALUE), reinterpret_cast<std::byte*>(&this->STRING_HASH_VALUE));
+    auth.append(sizeof(unsigned), reinterpret_cast<std::byte*>(&this->SEED_OF_CELL));
+    this->file->write(grow_auth_offset(new_count), auth);
+    this->file->sync();
+    this->file->write(0, system_info);
+    this->file->sync();
+    // 4. 认证块写到新的末尾
+    this->FILE_SIZE = new_size;
+    this->BLOCK_COUNT = new_count;
+    this->BITMAP_START = bitmap_start;
+    this->BITMAP_WEAR_START = bitmap_wear_start;
+    this->BITMAP_SIZE = bitmap_size;
+    this->CHECKSUM_START = checksum_start;
+    this->SCRUB_START = scrub_start;
+    this->file->write(auth_offset(this->BLOCK_COUNT), auth);
+    this->file->sync();
+    std::random_device rd;
+    BwtFS::Node::Binary filler(BwtFS::BLOCK_SIZE);
+    BwtFS::Util::FastRandom((static_cast<uint64_t>(rd()) << 32) ^ rd()).fill(filler.data(), filler.size());
+    this->file->write(grow_auth_offset(this->BLOCK_COUNT), filler);
+    this->file->sync();
+    LOG_INFO << "File system grown to " << new_size << " bytes.";
 }
 
 void BwtFS::System::FileSystem::setHashValue(const size_t& hash_value){
@@ -262,14 +708,141 @@ void BwtFS::System::FileSystem::setSeedOfCell(unsigned seed_of_cell){
     this->SEED_OF_CELL = seed_of_cell;
 }
 
+void BwtFS::System::FileSystem::writeBlocks(const std::vector<std::pair<unsigned long long, BwtFS::Node::BinaryView>>& blocks){
+    std::vector<BwtFS::System::BlockWrite> writes;
+    writes.reserve(blocks.size());
+    for (const auto& [index, data] : blocks){
+        if (index > this->BLOCK_COUNT || index <= 0){
+            LOG_ERROR <<  "Index out of range: " << index;
+            throw std::out_of_range(std::string("Index out of range") 
+            + __FILE__ + ":" + std::to_string(__LINE__));
+        }
+        if (data.size() > this->BLOCK_SIZE){
+            LOG_ERROR << "Data size is greater than block size: " 
+            << data.size() << " > " << this->BLOCK_SIZE;
+            throw std::out_of_range(std::string("Data size is greater than block size")
+            + __FILE__ + ":" + std::to_string(__LINE__));
+        }
+        writes.push_back({index*BwtFS::BLOCK_SIZE, data});
+    }
+    // 写入失败时抛出，由事务放弃提交，不能把没有写入的块标记为已用
+    this->file->writeBatch(writes);
+    if (this->checksums){
+        for (const auto& [index, data] : blocks){
+            this->checksums->update(index, data);
+        }
+    }
+}
+
+void BwtFS::System::FileSystem::sync(){
+    // 组提交：同一时间只有一个线程刷盘，刷盘期间到达的请求由下一次刷盘一并完成
+    std::unique_lock<std::mutex> lock(this->sync_mutex);
+    auto ticket = ++this->sync_requested;
+    while (this->sync_completed < ticket){
+        if (this->syncing){
+            this->sync_cv.wait(lock);
+            continue;
+        }
+        this->syncing = true;
+        auto covered = this->sync_requested;
+        lock.unlock();
+        try{
+            std::lock_guard<std::mutex> commit_lock(this->commit_mutex);
+            this->commit_(false);
+        }
+        catch(...){
+            lock.lock();
+            this->syncing = false;
+            this->sync_cv.notify_all();
+            throw;
+        }
+        lock.lock();
+        this->syncing = false;
+        this->sync_completed = covered;
+        this->sync_cv.notify_all();
+    }
+}
+
+void BwtFS::System::FileSystem::commit_(bool checkpoint){
+    if (!this->journal){
+        this->bitmap->flush();
+        if (this->checksums){
+            this->checksums->flush();
+        }
+        if (this->scrubs){
+            this->scrubs->flush();
+        }
+        this->file->sync();
+        return;
+    }
+    // 先取出变化再刷盘，之后的修改留给下一次提交
+    auto entries = this->bitmap->takeChanges();
+    if (this->checksums){
+        auto sums = this->checksums->takeChanges();
+        entries.insert(entries.end(), sums.begin(), sums.end());
+    }
+    if (this->scrubs){
+        auto scrubbed = this->scrubs->takeChanges();
+        entries.insert(entries.end(), scrubbed.begin(), scrubbed.end());
+    }
+    // 数据块先落盘，日志记录描述的数据一定已经写入
+    this->file->sync();
+    if (entries.empty() && !checkpoint){
+        return;
+    }
+    auto modify_time = (unsigned long long)std::time(nullptr);
+    if (!checkpoint && this->journal->append(entries, modify_time)){
+        this->MODIFY_TIME = modify_time;
+        this->file->sync();
+        return;
+    }
+    // 检查点：写回位图、校验和和修改时间，刷盘后才能清空日志
+    this->bitmap->flush();
+    if (this->checksums){
+        this->checksums->flush();
+    }
+    if (this->scrubs){
+        this->scrubs->flush();
+    }
+    this->updateModifyTime(modify_time);
+    this->file->sync();
+    this->journal->reset();
+    this->file->sync();
+    LOG_DEBUG << "Journal checkpoint completed.";
+}
+
 BwtFS::Node::Binary BwtFS::System::FileSystem::read(const unsigned long long index){
     if (index > this->BLOCK_COUNT || index <= 0){
         LOG_ERROR <<  "Index out of range: " << index;
         throw std::out_of_range(std::string("Index out of range") 
         + __FILE__ + ":" + std::to_string(__LINE__));
     }
-    std::shared_lock<std::shared_mutex> lock(rw_lock); // 共享锁，允许多个读取
-    return this->file->read(index*BwtFS::BLOCK_SIZE);
+    // 数据块采用按位置读取，不需要加锁，多个线程可以并行读取不同的块
+    auto data = this->file->read(index*BwtFS::BLOCK_SIZE);
+    if (this->checksums){
+        this->checksums->verify(index, data);
+    }
+    return data;
+}
+
+std::vector<BwtFS::Node::Binary> BwtFS::System::FileSystem::readBlocks(std::span<const size_t> indices){
+    std::vector<unsigned long long> offsets;
+    offsets.reserve(indices.size());
+    for (auto index : indices){
+        if (index > this->BLOCK_COUNT || index <= 0){
+            LOG_ERROR <<  "Index out of range: " << index;
+            throw std::out_of_range(std::string("Index out of range") 
+            + __FILE__ + ":" + std::to_string(__LINE__));
+        }
+        offsets.push_back(index*BwtFS::BLOCK_SIZE);
+    }
+    auto blocks = this->file->readBatch(offsets);
+    if (this->checksums){
+        for (size_t i = 0; i < indices.size(); i++){
+            this->checksums->verify(indices[i], blocks[i]);
+        }
+    }
+    return blocks;
 }
 
 void BwtFS::System::FileSystem::write(const unsigned long long index, const BwtFS::Node::Binary& data){
@@ -289,9 +862,11 @@ void BwtFS::System::FileSystem::write(const unsigned long long index, const BwtF
         + __FILE__ + ":" + std::to_string(__LINE__));
     }
     try{
-        // 独占锁，只允许一个写入
-        std::unique_lock<std::shared_mutex> lock(this->rw_lock);
+        // 数据块由位图分配，不同事务不会写同一个块，不需要加锁
         this->file->write(index*BwtFS::BLOCK_SIZE, data);
+        if (this->checksums){
+            this->checksums->update(index, data);
+        }
     }
     catch(const std::exception& e){
         LOG_ERROR << e.what();
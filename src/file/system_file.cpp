@@ -1,15 +1,46 @@
 #include "file/system_file.h"
+#include "file/mapped_file.h"
+#include "file/async_io.h"
+#include "file/direct_file.h"
+#include "file/striped_file.h"
 #include "util/ini_parser.h"
 #include "util/log.h"
 #include "config.h"
 #include "util/prefix.h"
+#include "util/random.h"
 #include <filesystem>
+#include <algorithm>
+#include <numeric>
 #include <random>
-#include <ctime>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include <exception>
+#include <cerrno>
+#include <cstring>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <climits>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#endif
 
 using BwtFS::Util::Logger;
 namespace fs = std::filesystem;
 
+namespace{
+    // 一次合并读取的最大块数（1MB），避免单次读取过大
+    constexpr size_t MAX_READ_RUN = 256;
+    // 创建文件时单次写入的大小
+    constexpr size_t CREATE_CHUNK_SIZE = 1 * BwtFS::MB;
+    // 精简文件按区段填充空洞，分配一个块时填充其所在的整个区段
+    // 块是随机分配的，区段过大会使少量写入就填满整个文件
+    constexpr size_t SPARSE_EXTENT_SIZE = 64 * BwtFS::KB;
+}
+
 BwtFS::System::File::File(const std::string &path){
     auto path_ = fs::path(path).make_preferred().string();
     // 判断文件是否存在
@@ -21,45 +52,97 @@ BwtFS::System::File::File(const std::string &path){
         LOG_INFO << "File created: " << path_;
     }
     // LOG_DEBUG << "Opening file: " << path_;
+#ifdef _WIN32
     this->file = std::make_shared<std::fstream>();
     file->open(path_, std::ios::in | std::ios::out | std::ios::binary);
     if (!file->is_open()){
         LOG_ERROR << "Failed to open file: " << path_;
         throw std::runtime_error(std::string("Failed to open file: ") + __FILE__ + ":" + std::to_string(__LINE__));
     }
-    // LOG_DEBUG << "File opened: " << path_;
     fb = file->rdbuf();
     if (fb == nullptr){
         LOG_ERROR << "Failed to open file: " << path_;
         throw std::runtime_error(std::string("Failed to open file: ") + __FILE__ + ":" + std::to_string(__LINE__));
     }
-    // LOG_DEBUG << "File buffer opened: " << path_;
+#else
+    this->fd = ::open(path_.c_str(), O_RDWR | O_CLOEXEC);
+    if (this->fd < 0){
+        LOG_ERROR << "Failed to open file: " << path_ << ", " << std::strerror(errno);
+        throw std::runtime_error(std::string("Failed to open file: ") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+#endif
+    // LOG_DEBUG << "File opened: " << path_;
     this->file_size = fs::file_size(path_);
     // LOG_DEBUG << "File size: " << this->file_size;
-    fb->pubseekpos(this->file_size - sizeof(unsigned));
-    fb->sgetn(reinterpret_cast<char*>(&this->prefix_size), sizeof(unsigned));
+    this->prefix_size = 0;
+    this->pread_at(this->file_size - sizeof(unsigned), &this->prefix_size, sizeof(unsigned));
     // LOG_DEBUG << "Prefix size: " << this->prefix_size;
     if (this->prefix_size == 0){
         this->has_prefix = false;
     }else{
         this->has_prefix = true;
     }
+#ifndef _WIN32
+    // 实际占用的磁盘空间小于文件大小，说明数据区还有空洞
+    struct stat st;
+    if (::fstat(this->fd, &st) == 0 && static_cast<unsigned long long>(st.st_blocks) * 512 < this->file_size){
+        this->thin = true;
+        auto data_size = this->file_size - sizeof(unsigned) - this->prefix_size;
+        this->extent_count = (data_size + SPARSE_EXTENT_SIZE - 1) / SPARSE_EXTENT_SIZE;
+        this->extent_filled = std::make_unique<std::atomic<bool>[]>(this->extent_count);
+    }
+#endif
+}
+
+BwtFS::System::File::File(){
 }
 
 BwtFS::System::File::~File(){
-    if (this->fb != nullptr){
-        this->fb->close();
+    this->close();
+}
+
+std::shared_ptr<BwtFS::System::File> BwtFS::System::File::open(const std::string& path){
+    if (BwtFS::System::StripedFile::isManifest(path)){
+        return std::make_shared<BwtFS::System::StripedFile>(path);
     }
-    if (this->file != nullptr){
-        this->file->close();
+    auto& config = BwtFS::Config::getInstance();
+    auto io_mode = config.get("system", "io_mode", BwtFS::DefaultConfig::SYSTEM_FILE_IO_MODE);
+    if (io_mode == "mmap"){
+#ifndef _WIN32
+        return std::make_shared<BwtFS::System::MappedFile>(path);
+#else
+        LOG_WARNING << "io_mode=mmap is not supported on Windows, fall back to pread.";
+#endif
+    }else if (io_mode == "direct"){
+#ifndef _WIN32
+        return std::make_shared<BwtFS::System::DirectFile>(path);
+#else
+        LOG_WARNING << "io_mode=direct is not supported on Windows, fall back to pread.";
+#endif
+    }else if (io_mode != "pread"){
+        LOG_WARNING << "Unknown io_mode: " << io_mode << ", fall back to pread.";
     }
+    return std::make_shared<BwtFS::System::File>(path);
 }
 
-unsigned BwtFS::System::File::createFile(const std::string& path, size_t size, std::string prefix){
+unsigned BwtFS::System::File::createFile(const std::string& path, size_t size, std::string prefix, CreateProgress progress){
     if (size < BwtFS::DefaultConfig::SYSTEM_FILE_MIN_SIZE){
         LOG_ERROR << "File size is too small: " << size << ". Minimum size is " << BwtFS::DefaultConfig::SYSTEM_FILE_MIN_SIZE;
         throw std::runtime_error(std::string("File size is too small: ") + __FILE__ + ":" + std::to_string(__LINE__));
     }
+    if (BwtFS::System::StripedFile::isManifest(path)){
+        auto& config = BwtFS::Config::getInstance();
+        auto members = BwtFS::System::StripedFile::parseMembers(config.get("system", "stripe_members", ""));
+        if (prefix != ""){
+            LOG_WARNING << "Prefix is not supported for striped volumes, ignore it.";
+        }
+        BwtFS::System::StripedFile::create(path, members, size);
+        return 0;
+    }
+    return create_file_(path, size, prefix, progress);
+}
+
+unsigned BwtFS::System::File::create_file_(const std::string& path, size_t size, std::string prefix, CreateProgress progress){
     auto path_ = fs::path(path).make_preferred().string();
     auto parentPath = fs::path(path_).parent_path();
     if (!parentPath.empty()) {
@@ -84,11 +167,6 @@ unsigned BwtFS::System::File::createFile(const std::string& path, size_t size, s
         LOG_ERROR << "File already exists: " << path_;
         throw std::runtime_error(std::string("File already exists: ") + __FILE__ + ":" + std::to_string(__LINE__));
     }
-    std::ofstream file(path_, std::ios::binary);
-    if (!file.is_open()){
-        LOG_ERROR << "Failed to create file: " << path_;
-        return 0;
-    }
     unsigned prefix_size = 0;
     if (prefix != ""){
         if (!fs::exists(prefix)){
@@ -96,39 +174,203 @@ unsigned BwtFS::System::File::createFile(const std::string& path, size_t size, s
             LOG_WARNING << "Do not use prefix file.";
             prefix = "";
         }else{
-            auto p = BwtFS::Util::Prefix(prefix);
-            prefix_size = p.size();
-            if (file.is_open()){
-                file.write(reinterpret_cast<const char*>(p.read(0, prefix_size).get()->data()), prefix_size);
-            }else{
-                LOG_ERROR << "Failed to open prefix file: " << prefix;
-            }
+            prefix_size = fs::file_size(prefix);
         }
     }
-    std::mt19937 rng(std::time(nullptr)); 
-    std::uniform_int_distribution<std::uint8_t> dist(0, 255);
-    const size_t bufferSize = 4096;
-    std::vector<std::uint8_t> buffer(bufferSize);
+    // prefix之后补齐随机字节到块大小的整数倍，使数据块在文件中按块对齐（O_DIRECT要求）
+    unsigned long long data_start = prefix_size;
+    if (prefix_size % BwtFS::BLOCK_SIZE != 0){
+        data_start += BwtFS::BLOCK_SIZE - prefix_size % BwtFS::BLOCK_SIZE;
+    }
+    unsigned long long random_end = data_start + size;
+    unsigned long long total_size = random_end + sizeof(unsigned);
+    auto& config = BwtFS::Config::getInstance();
+    bool sparse = config.get("system", "sparse", BwtFS::DefaultConfig::SYSTEM_FILE_SPARSE ? "true" : "false") == "true";
+#ifdef _WIN32
+    if (sparse){
+        LOG_WARNING << "sparse is not supported on Windows, fill the whole file.";
+        sparse = false;
+    }
+#endif
+    // 精简文件只填充prefix之后的补齐字节，数据区保留为空洞，在块分配时再填充
+    unsigned long long fill_end = sparse ? data_start : random_end;
 
-    size_t remaining = size;
-    while (remaining > 0) {
-        size_t chunkSize = std::min(bufferSize, remaining);
-        for (size_t i = 0; i < chunkSize; ++i) {
-            buffer[i] = dist(rng);
+    // 创建并预分配文件
+#ifdef _WIN32
+    {
+        std::ofstream file(path_, std::ios::binary);
+        if (!file.is_open()){
+            LOG_ERROR << "Failed to create file: " << path_;
+            return 0;
         }
-        file.write(reinterpret_cast<const char*>(buffer.data()), chunkSize);
-        remaining -= chunkSize;
     }
-    // 如果prefix不为空，则在文件末尾添加前缀大小
-    if (prefix != ""){
-        file.write(reinterpret_cast<const char*>(&prefix_size), sizeof(unsigned));
-    }else{
-        unsigned zero = 0;
-        file.write(reinterpret_cast<const char*>(&zero), sizeof(unsigned));
+    std::error_code resize_ec;
+    fs::resize_file(path_, total_size, resize_ec);
+    if (resize_ec){
+        LOG_WARNING << "Failed to preallocate file: " << resize_ec.message();
+    }
+    std::fstream file(path_, std::ios::in | std::ios::out | std::ios::binary);
+    if (!file.is_open()){
+        LOG_ERROR << "Failed to create file: " << path_;
+        return 0;
     }
+    auto write_at = [&file](unsigned long long offset, const void* data, size_t n){
+        file.seekp(offset);
+        file.write(reinterpret_cast<const char*>(data), n);
+    };
+#else
+    int fd = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0){
+        LOG_ERROR << "Failed to create file: " << path_ << ", " << std::strerror(errno);
+        return 0;
+    }
+    if (sparse){
+        if (::ftruncate(fd, total_size) != 0){
+            LOG_ERROR << "Failed to resize file: " << std::strerror(errno);
+            ::close(fd);
+            fs::remove(path_);
+            throw std::runtime_error(std::string("Failed to resize file: ") + __FILE__ + ":" + std::to_string(__LINE__));
+        }
+    }else if (int err = ::posix_fallocate(fd, 0, total_size); err != 0){
+        LOG_WARNING << "Failed to preallocate file: " << std::strerror(err) << ", fall back to ftruncate.";
+        if (::ftruncate(fd, total_size) != 0){
+            LOG_ERROR << "Failed to resize file: " << std::strerror(errno);
+            ::close(fd);
+            fs::remove(path_);
+            throw std::runtime_error(std::string("Failed to resize file: ") + __FILE__ + ":" + std::to_string(__LINE__));
+        }
+    }
+    auto write_at = [fd](unsigned long long offset, const void* data, size_t n){
+        pwrite_fd(fd, offset, data, n);
+    };
+#endif
+
+    try{
+        // prefix文件按块流式拷贝，不整体读入内存
+        if (prefix != ""){
+            std::ifstream in(prefix, std::ios::binary);
+            if (!in.is_open()){
+                LOG_ERROR << "Failed to open prefix file: " << prefix;
+                throw std::runtime_error(std::string("Failed to open prefix file: ") + __FILE__ + ":" + std::to_string(__LINE__));
+            }
+            std::vector<char> buffer(CREATE_CHUNK_SIZE);
+            unsigned long long offset = 0;
+            while (offset < prefix_size){
+                in.read(buffer.data(), std::min<unsigned long long>(buffer.size(), prefix_size - offset));
+                auto n = in.gcount();
+                if (n <= 0){
+                    break;
+                }
+                write_at(offset, buffer.data(), n);
+                offset += n;
+            }
+        }
+
+        // 随机填充区域（补齐字节和数据区）按线程切分为互不重叠的区间并行写入
+        const unsigned long long random_size = fill_end - prefix_size;
+        unsigned threads = std::stoul(config.get("system", "create_threads",
+                                        std::to_string(BwtFS::DefaultConfig::SYSTEM_FILE_CREATE_THREADS)));
+        if (threads == 0){
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        // 每个线程至少负责一个写入单元的整数倍，区间边界按CREATE_CHUNK_SIZE对齐
+        unsigned long long chunks = (random_size + CREATE_CHUNK_SIZE - 1) / CREATE_CHUNK_SIZE;
+        threads = static_cast<unsigned>(std::max<unsigned long long>(1, std::min<unsigned long long>(threads, chunks)));
+        unsigned long long chunks_per_thread = (chunks + threads - 1) / threads;
+
+        std::atomic<unsigned long long> written{0};
+        std::atomic<bool> failed{false};
+        std::exception_ptr error;
+        std::mutex progress_mutex;
+        std::condition_variable progress_cv;
+        unsigned finished = 0;
+        std::random_device rd;
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threads; t++){
+            unsigned long long begin = prefix_size + t * chunks_per_thread * CREATE_CHUNK_SIZE;
+            unsigned long long end = std::min(fill_end, begin + chunks_per_thread * CREATE_CHUNK_SIZE);
+            uint64_t seed = (static_cast<uint64_t>(rd()) << 32) ^ rd() ^ t;
+            workers.emplace_back([&, begin, end, seed]{
+                try{
+                    BwtFS::Util::FastRandom rng(seed);
+                    std::vector<std::byte> buffer(CREATE_CHUNK_SIZE);
+#ifdef _WIN32
+                    std::fstream out(path_, std::ios::in | std::ios::out | std::ios::binary);
+                    out.seekp(begin);
+#endif
+                    for (auto offset = begin; offset < end && !failed; offset += buffer.size()){
+                        auto n = std::min<unsigned long long>(buffer.size(), end - offset);
+                        rng.fill(buffer.data(), n);
+#ifdef _WIN32
+                        out.write(reinterpret_cast<const char*>(buffer.data()), n);
+#else
+                        write_at(offset, buffer.data(), n);
+#endif
+                        written += n;
+                    }
+                }catch(...){
+                    std::lock_guard<std::mutex> lock(progress_mutex);
+                    if (!error){
+                        error = std::current_exception();
+                    }
+                    failed = true;
+                }
+                {
+                    std::lock_guard<std::mutex> lock(progress_mutex);
+                    finished++;
+                }
+                progress_cv.notify_one();
+            });
+        }
+
+        // 主线程等待并汇报进度
+        unsigned reported = 0;
+        auto report = [&](unsigned long long done){
+            if (progress){
+                progress(done, random_size);
+                return;
+            }
+            unsigned percent = random_size == 0 ? 100 : static_cast<unsigned>(done * 100 / random_size);
+            if (percent / 10 > reported / 10){
+                reported = percent;
+                LOG_INFO << "Creating file: " << percent << "% (" << done << "/" << random_size << " bytes)";
+            }
+        };
+        {
+            std::unique_lock<std::mutex> lock(progress_mutex);
+            while (finished < threads){
+                progress_cv.wait_for(lock, std::chrono::milliseconds(500), [&]{ return finished >= threads; });
+                lock.unlock();
+                report(written);
+                lock.lock();
+            }
+        }
+        for (auto& w : workers){
+            w.join();
+        }
+        if (error){
+            std::rethrow_exception(error);
+        }
+
+        // 文件末尾写入前缀大小（含补齐部分）
+        unsigned stored_prefix_size = static_cast<unsigned>(data_start);
+        write_at(random_end, &stored_prefix_size, sizeof(unsigned));
+    }catch(...){
+#ifdef _WIN32
+        file.close();
+#else
+        ::close(fd);
+#endif
+        fs::remove(path_);
+        throw;
+    }
+#ifdef _WIN32
     file.close();
-    LOG_INFO << "File created: " << path_;
-    return prefix_size;
+#else
+    ::close(fd);
+#endif
+    LOG_INFO << "File created: " << path_ << (sparse ? " (sparse)" : "");
+    return static_cast<unsigned>(data_start);
 }
 
 BwtFS::Node::Binary BwtFS::System::File::read(unsigned long long index_){
@@ -137,9 +379,8 @@ BwtFS::Node::Binary BwtFS::System::File::read(unsigned long long index_){
         LOG_ERROR << "Index out of range: " << index;
         throw std::out_of_range(std::string("Index out of range") + __FILE__ + ":" + std::to_string(__LINE__));
     }
-    fb->pubseekpos(index);
     std::vector<std::byte> data(BwtFS::BLOCK_SIZE);
-    fb->sgetn(reinterpret_cast<char*>(data.data()), BwtFS::BLOCK_SIZE);
+    this->pread_at(index, data.data(), BwtFS::BLOCK_SIZE);
     return BwtFS::Node::Binary(data);
 }
 
@@ -149,20 +390,357 @@ BwtFS::Node::Binary BwtFS::System::File::read(unsigned long long index_, size_t
         LOG_ERROR << "Index out of range: " << index;
         throw std::out_of_range(std::string("Index out of range") + __FILE__ + ":" + std::to_string(__LINE__));
     }
-    fb->pubseekpos(index);
     std::vector<std::byte> data(size*BwtFS::BLOCK_SIZE);
-    fb->sgetn(reinterpret_cast<char*>(data.data()), size*BwtFS::BLOCK_SIZE);
+    this->pread_at(index, data.data(), size*BwtFS::BLOCK_SIZE);
     return BwtFS::Node::Binary(data);
 }
 
+BwtFS::Node::BinaryView BwtFS::System::File::view(unsigned long long index, size_t size){
+    return size == 1 ? this->read(index) : this->read(index, size);
+}
+
+std::vector<BwtFS::Node::Binary> BwtFS::System::File::readBatch(const std::vector<unsigned long long>& offsets){
+    std::vector<BwtFS::Node::Binary> result;
+    result.reserve(offsets.size());
+    for (auto offset : offsets){
+        if (offset + this->prefix_size >= this->file_size){
+            LOG_ERROR << "Index out of range: " << offset + this->prefix_size;
+            throw std::out_of_range(std::string("Index out of range") + __FILE__ + ":" + std::to_string(__LINE__));
+        }
+        result.emplace_back(BwtFS::BLOCK_SIZE);
+    }
+    // 按位置排序，位置相邻的块合并为一次读取
+    std::vector<size_t> order(offsets.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&offsets](size_t a, size_t b){
+        return offsets[a] < offsets[b];
+    });
+    std::vector<std::byte*> run;
+    // 重复请求的块只读取一次，读完后拷贝给其它请求
+    std::vector<std::pair<size_t, size_t>> duplicates;
+    unsigned long long run_start = 0;
+    for (size_t i = 0; i < order.size(); i++){
+        auto offset = offsets[order[i]];
+        if (i > 0 && offset == offsets[order[i - 1]]){
+            duplicates.emplace_back(order[i], order[i - 1]);
+            continue;
+        }
+        if (!run.empty() && (offset != run_start + run.size() * BwtFS::BLOCK_SIZE || run.size() >= MAX_READ_RUN)){
+            this->read_contiguous(run_start + this->prefix_size, run);
+            run.clear();
+        }
+        if (run.empty()){
+            run_start = offset;
+        }
+        run.push_back(result[order[i]].data());
+    }
+    if (!run.empty()){
+        this->read_contiguous(run_start + this->prefix_size, run);
+    }
+    for (const auto& [dest, src] : duplicates){
+        std::memcpy(result[dest].data(), result[src].data(), BwtFS::BLOCK_SIZE);
+    }
+    return result;
+}
+
+void BwtFS::System::File::read_contiguous(unsigned long long offset, const std::vector<std::byte*>& blocks){
+#ifdef _WIN32
+    for (size_t i = 0; i < blocks.size(); i++){
+        this->pread_at(offset + i * BwtFS::BLOCK_SIZE, blocks[i], BwtFS::BLOCK_SIZE);
+    }
+#else
+    std::vector<iovec> iov(blocks.size());
+    for (size_t i = 0; i < blocks.size(); i++){
+        iov[i].iov_base = blocks[i];
+        iov[i].iov_len = BwtFS::BLOCK_SIZE;
+    }
+    size_t idx = 0;
+    while (idx < iov.size()){
+        auto count = static_cast<int>(std::min<size_t>(iov.size() - idx, IOV_MAX));
+        auto n = ::preadv(this->fd, iov.data() + idx, count, offset);
+        if (n < 0){
+            if (errno == EINTR) continue;
+            LOG_ERROR << "Failed to read file at " << offset << ": " << std::strerror(errno);
+            throw std::runtime_error(std::string("Failed to read file: ") + __FILE__ + ":" + std::to_string(__LINE__));
+        }
+        if (n == 0) break; // 文件结束，剩余部分保持为0
+        offset += n;
+        // 跳过已读满的块，短读时调整当前块的起始位置
+        size_t left = n;
+        while (left > 0 && idx < iov.size()){
+            if (left >= iov[idx].iov_len){
+                left -= iov[idx].iov_len;
+                idx++;
+            }else{
+                iov[idx].iov_base = static_cast<char*>(iov[idx].iov_base) + left;
+                iov[idx].iov_len -= left;
+                left = 0;
+            }
+        }
+    }
+#endif
+}
+
 void BwtFS::System::File::write(unsigned long long index_, const BwtFS::Node::Binary& data){
     auto index = index_ + this->prefix_size;
     if (index + data.size() >= this->file_size){
         LOG_ERROR << "Index out of range: " << index;
         throw std::out_of_range(std::string("Index out of range") + __FILE__ + ":" + std::to_string(__LINE__));
     }
-    fb->pubseekpos(index);
-    fb->sputn(reinterpret_cast<const char*>(data.read().data()), data.size());
+    this->pwrite_at(index, data.data(), data.size());
+}
+
+void BwtFS::System::File::writeBatch(const std::vector<BlockWrite>& writes){
+    if (writes.empty()){
+        return;
+    }
+    std::vector<BlockWrite> blocks;
+    blocks.reserve(writes.size());
+    for (const auto& w : writes){
+        auto index = w.offset + this->prefix_size;
+        if (index + w.data.size() >= this->file_size){
+            LOG_ERROR << "Index out of range: " << index;
+            throw std::out_of_range(std::string("Index out of range") + __FILE__ + ":" + std::to_string(__LINE__));
+        }
+        blocks.push_back({index, w.data});
+    }
+#ifdef _WIN32
+    for (const auto& b : blocks){
+        this->pwrite_at(b.offset, b.data.data(), b.data.size());
+    }
+#else
+    std::call_once(this->engine_once, [this]{
+        this->engine = std::make_unique<BwtFS::System::AsyncBlockEngine>(this->fd);
+    });
+    this->engine->write(blocks);
+#endif
+}
+
+size_t BwtFS::System::File::pread_at(unsigned long long offset, void* buffer, size_t size){
+#ifdef _WIN32
+    std::lock_guard<std::mutex> lock(this->io_mutex);
+    fb->pubseekpos(offset);
+    return fb->sgetn(reinterpret_cast<char*>(buffer), size);
+#else
+    return pread_fd(this->fd, offset, buffer, size);
+#endif
+}
+
+void BwtFS::System::File::pwrite_at(unsigned long long offset, const void* buffer, size_t size){
+#ifdef _WIN32
+    std::lock_guard<std::mutex> lock(this->io_mutex);
+    fb->pubseekpos(offset);
+    fb->sputn(reinterpret_cast<const char*>(buffer), size);
+#else
+    pwrite_fd(this->fd, offset, buffer, size);
+#endif
+}
+
+#ifndef _WIN32
+size_t BwtFS::System::File::pread_fd(int fd, unsigned long long offset, void* buffer, size_t size){
+    size_t done = 0;
+    auto p = reinterpret_cast<char*>(buffer);
+    while (done < size){
+        auto n = ::pread(fd, p + done, size - done, offset + done);
+        if (n < 0){
+            if (errno == EINTR) continue;
+            LOG_ERROR << "Failed to read file at " << offset + done << ": " << std::strerror(errno);
+            throw std::runtime_error(std::string("Failed to read file: ") + __FILE__ + ":" + std::to_string(__LINE__));
+        }
+        if (n == 0) break; // 文件结束，剩余部分保持为0
+        done += n;
+    }
+    return done;
+}
+
+void BwtFS::System::File::pwrite_fd(int fd, unsigned long long offset, const void* buffer, size_t size){
+    size_t done = 0;
+    auto p = reinterpret_cast<const char*>(buffer);
+    while (done < size){
+        auto n = ::pwrite(fd, p + done, size - done, offset + done);
+        if (n < 0){
+            if (errno == EINTR) continue;
+            LOG_ERROR << "Failed to write file at " << offset + done << ": " << std::strerror(errno);
+            throw std::runtime_error(std::string("Failed to write file: ") + __FILE__ + ":" + std::to_string(__LINE__));
+        }
+        done += n;
+    }
+}
+#endif
+
+void BwtFS::System::File::materialize(unsigned long long index){
+#ifndef _WIN32
+    if (!this->thin){
+        return;
+    }
+    auto extent = index / SPARSE_EXTENT_SIZE;
+    if (extent >= this->extent_count || this->extent_filled[extent].load(std::memory_order_acquire)){
+        return;
+    }
+    this->fill_extent(extent);
+#endif
+}
+
+bool BwtFS::System::File::isThin() const{
+#ifndef _WIN32
+    return this->thin;
+#else
+    return false;
+#endif
+}
+
+void BwtFS::System::File::startBackgroundFill(){
+#ifndef _WIN32
+    if (!this->thin || this->filler.joinable()){
+        return;
+    }
+    auto& config = BwtFS::Config::getInstance();
+    size_t rate = std::stoull(config.get("system", "sparse_fill_rate",
+                                std::to_string(BwtFS::DefaultConfig::SYSTEM_FILE_SPARSE_FILL_RATE)));
+    if (rate == 0){
+        LOG_INFO << "Thin image, background fill is disabled.";
+        return;
+    }
+    this->filler_stop = false;
+    this->filler = std::thread([this, rate]{
+        this->background_fill(rate * BwtFS::MB);
+    });
+#endif
+}
+
+#ifndef _WIN32
+size_t BwtFS::System::File::fill_extent(size_t extent){
+    std::lock_guard<std::mutex> lock(this->fill_stripes[extent % this->fill_stripes.size()]);
+    if (this->extent_filled[extent].load(std::memory_order_acquire)){
+        return 0;
+    }
+    thread_local BwtFS::Util::FastRandom rng(std::random_device{}() ^ std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    unsigned long long begin = this->prefix_size + extent * SPARSE_EXTENT_SIZE;
+    unsigned long long end = std::min<unsigned long long>(begin + SPARSE_EXTENT_SIZE, this->file_size - sizeof(unsigned));
+    std::vector<std::byte> buffer;
+    size_t filled = 0;
+    auto offset = begin;
+    // 只填充区段中的空洞，已写入的块（含已分配的块）不会被覆盖
+    while (offset < end){
+        auto hole = ::lseek(this->fd, offset, SEEK_HOLE);
+        if (hole < 0 || static_cast<unsigned long long>(hole) >= end){
+            break;
+        }
+        auto data = ::lseek(this->fd, hole, SEEK_DATA);
+        unsigned long long hole_end = data < 0 ? end : std::min<unsigned long long>(data, end);
+        buffer.resize(hole_end - hole);
+        rng.fill(buffer.data(), buffer.size());
+        pwrite_fd(this->fd, hole, buffer.data(), buffer.size());
+        filled += buffer.size();
+        offset = hole_end;
+    }
+    this->extent_filled[extent].store(true, std::memory_order_release);
+    return filled;
+}
+
+void BwtFS::System::File::background_fill(size_t rate){
+#ifdef __linux__
+    // Linux下nice值按线程生效，只降低填充线程的优先级
+    ::setpriority(PRIO_PROCESS, 0, 19);
+#endif
+    LOG_INFO << "Thin image, background fill started: " << rate / BwtFS::MB << " MB/s";
+    size_t total = 0;
+    for (size_t extent = 0; extent < this->extent_count; extent++){
+        if (this->filler_stop){
+            return;
+        }
+        if (this->extent_filled[extent].load(std::memory_order_acquire)){
+            continue;
+        }
+        size_t filled = 0;
+        try{
+            filled = this->fill_extent(extent);
+        }catch(const std::exception& e){
+            LOG_ERROR << "Background fill failed: " << e.what();
+            return;
+        }
+        total += filled;
+        if (filled > 0){
+            // 按限速等待，关闭文件时立即退出
+            std::unique_lock<std::mutex> lock(this->filler_mutex);
+            this->filler_cv.wait_for(lock, std::chrono::microseconds(filled * 1000000 / rate),
+                                     [this]{ return this->filler_stop.load(); });
+        }
+    }
+    LOG_INFO << "Thin image fully randomized, " << total / BwtFS::MB << " MB filled in background.";
+}
+
+void BwtFS::System::File::stop_background_fill(){
+    if (!this->filler.joinable()){
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(this->filler_mutex);
+        this->filler_stop = true;
+    }
+    this->filler_cv.notify_all();
+    this->filler.join();
+}
+#endif
+
+void BwtFS::System::File::sync(){
+#ifdef _WIN32
+    std::lock_guard<std::mutex> lock(this->io_mutex);
+    if (fb != nullptr){
+        fb->pubsync();
+    }
+#else
+    if (this->fd >= 0 && ::fdatasync(this->fd) != 0){
+        LOG_ERROR << "Failed to sync file: " << std::strerror(errno);
+        throw std::runtime_error(std::string("Failed to sync file: ") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+#endif
+}
+
+void BwtFS::System::File::grow(size_t size, const BwtFS::Node::Binary& tail){
+    unsigned long long old_end = this->file_size - sizeof(unsigned);
+    unsigned long long new_end = this->prefix_size + size;
+    if (new_end <= old_end){
+        LOG_ERROR << "New size must be larger than the current size: " << size;
+        throw std::invalid_argument(std::string("New size must be larger than the current size: ") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    // 新的最后一个块及之后的部分
+    unsigned long long tail_start = this->prefix_size + (unsigned long long)(size / BwtFS::BLOCK_SIZE - 1) * BwtFS::BLOCK_SIZE;
+    if (tail.size() > BwtFS::BLOCK_SIZE || (tail.size() > 0 && (size < BwtFS::BLOCK_SIZE || tail_start < old_end))){
+        LOG_ERROR << "Tail data must fit in a newly added last block: " << tail.size();
+        throw std::invalid_argument(std::string("Tail data must fit in a newly added last block: ") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    tail_start = std::max(tail_start, old_end);
+    unsigned long long total_size = new_end + sizeof(unsigned);
+    std::random_device rd;
+    BwtFS::Util::FastRandom rng((static_cast<uint64_t>(rd()) << 32) ^ rd());
+    // 1. 先写末尾：最后一个块（开头为tail）和prefix大小字段，一次写入并刷盘
+    // 文件长度只在这一步改变，之后按新长度打开时最后一个块中已经是tail
+    std::vector<std::byte> end(total_size - tail_start);
+    rng.fill(end.data(), end.size());
+    if (tail.size() > 0){
+        std::memcpy(end.data(), tail.data(), tail.size());
+    }
+    unsigned stored_prefix_size = this->prefix_size;
+    std::memcpy(end.data() + end.size() - sizeof(unsigned), &stored_prefix_size, sizeof(unsigned));
+    this->pwrite_at(tail_start, end.data(), end.size());
+    File::sync();
+#ifndef _WIN32
+    if (tail_start > old_end){
+        if (int err = ::posix_fallocate(this->fd, old_end, tail_start - old_end); err != 0){
+            LOG_WARNING << "Failed to preallocate file: " << std::strerror(err);
+        }
+    }
+#endif
+    // 2. 中间新增的空间填充随机数据，原来的prefix大小字段也在其中，一并覆盖
+    std::vector<std::byte> buffer(CREATE_CHUNK_SIZE);
+    for (auto offset = old_end; offset < tail_start; offset += buffer.size()){
+        auto n = std::min<unsigned long long>(buffer.size(), tail_start - offset);
+        rng.fill(buffer.data(), n);
+        this->pwrite_at(offset, buffer.data(), n);
+    }
+    this->file_size = total_size;
+    LOG_INFO << "File grown to " << total_size << " bytes.";
 }
 
 size_t BwtFS::System::File::getFileSize() const{
@@ -178,14 +756,20 @@ bool BwtFS::System::File::hasPrefix() const{
 }
 
 void BwtFS::System::File::close(){
+#ifdef _WIN32
     if (this->fb != nullptr){
         this->fb->close();
+        this->fb = nullptr;
     }
     if (this->file != nullptr){
         this->file->close();
     }
+#else
+    this->stop_background_fill();
+    this->engine.reset();
+    if (this->fd >= 0){
+        ::close(this->fd);
+        this->fd = -1;
+    }
+#endif
 }
-
-
-
-
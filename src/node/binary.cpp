@@ -11,6 +11,8 @@
 #include <utility>
 #include <algorithm>
 #include <iterator>
+#include <functional>
+#include <cstring>
 #include "util/log.h"
 
 using BwtFS::Util::Logger;
@@ -281,7 +283,18 @@ BwtFS::Node::Binary& BwtFS::Node::Binary::append(const size_t size, const std::b
         LOG_ERROR << "BwtFS::Node::Binary::append: Binary array is null";
         throw std::runtime_error(std::string("BwtFS::Node::Binary::append: Binary array is null") + __FILE__ + ":" + std::to_string(__LINE__));
     }
-    this->binary_array->insert(this->binary_array->end(), data, data + size);
+    auto& array = *this->binary_array;
+    const std::byte* begin = array.data();
+    std::less<const std::byte*> less;
+    if (size > 0 && !less(data, begin) && less(data, begin + array.size())){
+        // 数据来自自身（如append(view())）时insert扩容会使源地址失效，先扩容再按偏移拷贝
+        size_t offset = data - begin;
+        size_t old_size = array.size();
+        array.resize(old_size + size);
+        std::memcpy(array.data() + old_size, array.data() + offset, size);
+        return *this;
+    }
+    array.insert(array.end(), data, data + size);
     return *this;
 }
 
@@ -294,6 +307,26 @@ BwtFS::Node::Binary& BwtFS::Node::Binary::append(const std::vector<std::byte>& d
     return *this;
 }
 
+BwtFS::Node::Binary& BwtFS::Node::Binary::append(const BinaryView& data){
+    if (this->binary_array == nullptr){
+        LOG_ERROR << "BwtFS::Node::Binary::append: Binary array is null";
+        throw std::runtime_error(std::string("BwtFS::Node::Binary::append: Binary array is null") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    return this->append(data.size(), data.data());
+}
+
+BwtFS::Node::BinaryView BwtFS::Node::Binary::slice(const size_t index, const size_t size) const{
+    if (this->binary_array == nullptr){
+        LOG_ERROR << "BwtFS::Node::Binary::slice: Binary array is null";
+        throw std::runtime_error(std::string("BwtFS::Node::Binary::slice: Binary array is null") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    return BinaryView(this->binary_array, index, size);
+}
+
+BwtFS::Node::BinaryView BwtFS::Node::Binary::view() const{
+    return this->slice(0, this->size());
+}
+
 BwtFS::Node::Binary& BwtFS::Node::Binary::clear(){
     if (this->binary_array == nullptr){
         LOG_WARNING << "BwtFS::Node::Binary::clear: Binary array is null";
@@ -356,6 +389,14 @@ BwtFS::Node::Binary& BwtFS::Node::Binary::resize(const size_t size){
     return *this;
 }
 
+BwtFS::Node::Binary& BwtFS::Node::Binary::reserve(const size_t size){
+    if (this->binary_array == nullptr){
+        this->binary_array = std::make_shared<std::vector<std::byte>>();
+    }
+    this->binary_array->reserve(size);
+    return *this;
+}
+
 const std::string BwtFS::Node::Binary::BINARY_TO_STRING(const std::vector<std::byte>& data, const size_t size){
     return byteArrayToHexString(data, size);
 }
@@ -578,4 +619,57 @@ std::byte* BwtFS::Node::Binary::data(){
         throw std::runtime_error(std::string("data: Binary array is null") + __FILE__ + ":" + std::to_string(__LINE__));
     }
     return this->binary_array->data();
-}
\ No newline at end of file
+}
+
+const std::byte* BwtFS::Node::Binary::data() const{
+    if (this->binary_array == nullptr){
+        throw std::runtime_error(std::string("data: Binary array is null") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    return this->binary_array->data();
+}
+
+BwtFS::Node::BinaryView::BinaryView(std::shared_ptr<std::vector<std::byte>> owner, const size_t index, const size_t size)
+ : owner(std::move(owner)){
+    size_t total = this->owner == nullptr ? 0 : this->owner->size();
+    if (index >= total){
+        return;
+    }
+    this->ptr = this->owner->data() + index;
+    this->length = std::min(size, total - index);
+}
+
+BwtFS::Node::BinaryView::BinaryView(const Binary& binary){
+    if (!binary.is_null()){
+        *this = binary.view();
+    }
+}
+
+BwtFS::Node::BinaryView::BinaryView(const std::byte* data, const size_t size)
+ : ptr(data), length(data == nullptr ? 0 : size){}
+
+std::byte BwtFS::Node::BinaryView::get(const size_t index) const{
+    if (index >= this->length){
+        LOG_ERROR << "BwtFS::Node::BinaryView::get: Index out of range";
+        throw std::runtime_error(std::string("BwtFS::Node::BinaryView::get: Index out of range") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    return this->ptr[index];
+}
+
+BwtFS::Node::BinaryView BwtFS::Node::BinaryView::slice(const size_t index, const size_t size) const{
+    BinaryView result;
+    if (index >= this->length){
+        return result;
+    }
+    result.owner = this->owner;
+    result.ptr = this->ptr + index;
+    result.length = std::min(size, this->length - index);
+    return result;
+}
+
+BwtFS::Node::Binary BwtFS::Node::BinaryView::to_binary() const{
+    return Binary(this->ptr, this->length);
+}
+
+std::vector<std::byte> BwtFS::Node::BinaryView::to_vector() const{
+    return std::vector<std::byte>(this->ptr, this->ptr + this->length);
+}
@@ -0,0 +1,204 @@
+#include "node/block_buffer.h"
+#include "util/log.h"
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+using BwtFS::Util::Logger;
+
+BwtFS::Node::BlockPool& BwtFS::Node::BlockPool::getInstance(){
+    static BlockPool instance;
+    return instance;
+}
+
+BwtFS::Node::BlockPool::~BlockPool(){
+    auto count = this->chunk_count.load();
+    for (uint32_t i = 0; i < count; i++){
+        auto chunk = this->chunks[i].load();
+        ::operator delete(chunk->memory, std::align_val_t(BwtFS::BLOCK_SIZE));
+        delete chunk;
+    }
+}
+
+uint32_t BwtFS::Node::BlockPool::acquire(){
+    while (true){
+        uint64_t old = this->head.load(std::memory_order_acquire);
+        uint32_t top = static_cast<uint32_t>(old);
+        if (top == 0){
+            this->expand();
+            if (static_cast<uint32_t>(this->head.load(std::memory_order_acquire)) == 0
+                && this->chunk_count.load(std::memory_order_acquire) == MAX_CHUNKS){
+                return NONE;
+            }
+            continue;
+        }
+        uint32_t id = top - 1;
+        auto chunk = this->chunks[id / BUFFERS_PER_CHUNK].load(std::memory_order_acquire);
+        uint32_t next = chunk->next[id % BUFFERS_PER_CHUNK].load(std::memory_order_relaxed);
+        uint64_t desired = (((old >> 32) + 1) << 32) | next;
+        if (this->head.compare_exchange_weak(old, desired, std::memory_order_acq_rel, std::memory_order_acquire)){
+            return id;
+        }
+    }
+}
+
+void BwtFS::Node::BlockPool::release(uint32_t id){
+    auto chunk = this->chunks[id / BUFFERS_PER_CHUNK].load(std::memory_order_acquire);
+    uint64_t old = this->head.load(std::memory_order_relaxed);
+    uint64_t desired;
+    do{
+        chunk->next[id % BUFFERS_PER_CHUNK].store(static_cast<uint32_t>(old), std::memory_order_relaxed);
+        desired = (((old >> 32) + 1) << 32) | (id + 1);
+    }while (!this->head.compare_exchange_weak(old, desired, std::memory_order_release, std::memory_order_relaxed));
+}
+
+std::byte* BwtFS::Node::BlockPool::buffer(uint32_t id) const{
+    auto chunk = this->chunks[id / BUFFERS_PER_CHUNK].load(std::memory_order_acquire);
+    return chunk->memory + static_cast<size_t>(id % BUFFERS_PER_CHUNK) * BwtFS::BLOCK_SIZE;
+}
+
+size_t BwtFS::Node::BlockPool::capacity() const{
+    return static_cast<size_t>(this->chunk_count.load()) * BUFFERS_PER_CHUNK;
+}
+
+std::byte* BwtFS::Node::BlockPool::acquireOverflow(){
+    auto buffer = static_cast<std::byte*>(::operator new(BwtFS::BLOCK_SIZE, std::align_val_t(BwtFS::BLOCK_SIZE)));
+    // 堆上缓冲区全部释放之前不再重复记录
+    if (this->overflow_count.fetch_add(1, std::memory_order_relaxed) == 0){
+        LOG_WARNING << "Block pool exhausted, falling back to heap buffers";
+    }
+    return buffer;
+}
+
+void BwtFS::Node::BlockPool::releaseOverflow(std::byte* buffer){
+    ::operator delete(buffer, std::align_val_t(BwtFS::BLOCK_SIZE));
+    this->overflow_count.fetch_sub(1, std::memory_order_relaxed);
+}
+
+size_t BwtFS::Node::BlockPool::overflow() const{
+    return this->overflow_count.load(std::memory_order_relaxed);
+}
+
+void BwtFS::Node::BlockPool::expand(){
+    std::lock_guard<std::mutex> lock(this->expand_mutex);
+    // 等锁期间其他线程已经扩充或归还了缓冲区
+    if (static_cast<uint32_t>(this->head.load(std::memory_order_acquire)) != 0){
+        return;
+    }
+    auto index = this->chunk_count.load(std::memory_order_relaxed);
+    if (index == MAX_CHUNKS){
+        return;
+    }
+    auto chunk = new Chunk;
+    chunk->memory = static_cast<std::byte*>(::operator new(BUFFERS_PER_CHUNK * BwtFS::BLOCK_SIZE, std::align_val_t(BwtFS::BLOCK_SIZE)));
+    uint32_t first = index * BUFFERS_PER_CHUNK;
+    for (uint32_t i = 0; i + 1 < BUFFERS_PER_CHUNK; i++){
+        chunk->next[i].store(first + i + 2, std::memory_order_relaxed);
+    }
+    this->chunks[index].store(chunk, std::memory_order_release);
+    this->chunk_count.store(index + 1, std::memory_order_release);
+    // 整组缓冲区作为一条链压入空闲栈
+    uint64_t old = this->head.load(std::memory_order_relaxed);
+    uint64_t desired;
+    do{
+        chunk->next[BUFFERS_PER_CHUNK - 1].store(static_cast<uint32_t>(old), std::memory_order_relaxed);
+        desired = (((old >> 32) + 1) << 32) | (first + 1);
+    }while (!this->head.compare_exchange_weak(old, desired, std::memory_order_release, std::memory_order_relaxed));
+}
+
+BwtFS::Node::BlockBuffer::BlockBuffer(const size_t size){
+    this->resize(size);
+}
+
+BwtFS::Node::BlockBuffer::BlockBuffer(BlockBuffer&& other) noexcept
+ : ptr(other.ptr), id(other.id), length(other.length){
+    other.ptr = nullptr;
+    other.id = BlockPool::NONE;
+    other.length = 0;
+}
+
+BwtFS::Node::BlockBuffer& BwtFS::Node::BlockBuffer::operator=(BlockBuffer&& other) noexcept{
+    if (this != &other){
+        this->release_();
+        this->ptr = other.ptr;
+        this->id = other.id;
+        this->length = other.length;
+        other.ptr = nullptr;
+        other.id = BlockPool::NONE;
+        other.length = 0;
+    }
+    return *this;
+}
+
+BwtFS::Node::BlockBuffer::~BlockBuffer(){
+    this->release_();
+}
+
+BwtFS::Node::BlockBuffer& BwtFS::Node::BlockBuffer::resize(const size_t size){
+    if (size > capacity()){
+        LOG_ERROR << "BlockBuffer::resize: size " << size << " exceeds block size";
+        throw std::runtime_error(std::string("BlockBuffer::resize: size exceeds block size: ") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    this->ensure_();
+    this->length = size;
+    return *this;
+}
+
+BwtFS::Node::BlockBuffer& BwtFS::Node::BlockBuffer::clear(){
+    this->length = 0;
+    return *this;
+}
+
+BwtFS::Node::BlockBuffer& BwtFS::Node::BlockBuffer::append(const std::byte* data, const size_t size){
+    if (size > 0){
+        std::memcpy(this->extend(size), data, size);
+    }
+    return *this;
+}
+
+BwtFS::Node::BlockBuffer& BwtFS::Node::BlockBuffer::append(const BinaryView& data){
+    return this->append(data.data(), data.size());
+}
+
+std::byte* BwtFS::Node::BlockBuffer::extend(const size_t size){
+    if (size > capacity() - this->length){
+        LOG_ERROR << "BlockBuffer::extend: " << this->length << " + " << size << " exceeds block size";
+        throw std::runtime_error(std::string("BlockBuffer::extend: size exceeds block size: ") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    this->ensure_();
+    auto begin = this->ptr + this->length;
+    this->length += size;
+    return begin;
+}
+
+BwtFS::Node::Binary BwtFS::Node::BlockBuffer::to_binary() const{
+    return Binary(this->ptr, this->length);
+}
+
+void BwtFS::Node::BlockBuffer::ensure_(){
+    if (this->ptr != nullptr){
+        return;
+    }
+    auto& pool = BlockPool::getInstance();
+    this->id = pool.acquire();
+    if (this->id == BlockPool::NONE){
+        this->ptr = pool.acquireOverflow();
+    }else{
+        this->ptr = pool.buffer(this->id);
+    }
+}
+
+void BwtFS::Node::BlockBuffer::release_(){
+    if (this->ptr == nullptr){
+        return;
+    }
+    if (this->id == BlockPool::NONE){
+        BlockPool::getInstance().releaseOverflow(this->ptr);
+    }else{
+        BlockPool::getInstance().release(this->id);
+    }
+    this->ptr = nullptr;
+    this->id = BlockPool::NONE;
+    this->length = 0;
+}
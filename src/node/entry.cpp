@@ -1,41 +1,41 @@
 #include "node/entry.h"
 #include "util/log.h"
+#include <cstring>
 
 
 BwtFS::Node::Binary BwtFS::Node::entry::to_binary() {
-    Binary binary_data;
-    bool tp = (type == NodeType::WHITE_NODE) ? 0 : 1;
-    binary_data.append(sizeof(size_t), reinterpret_cast<std::byte*>(&bitmap));
-    // LOG_INFO << "bitmap:  " << binary_data.to_hex_string();
-    binary_data.append(sizeof(bool), reinterpret_cast<std::byte*>(&tp));
-    // LOG_INFO << "type:   " << binary_data.to_hex_string();
-    binary_data.append(sizeof(uint16_t), reinterpret_cast<std::byte*>(&start));
-    // LOG_INFO << "start:  " << binary_data.to_hex_string();
-    binary_data.append(sizeof(uint16_t), reinterpret_cast<std::byte*>(&length));
-    // LOG_INFO << "length: " << binary_data.to_hex_string();
-    binary_data.append(sizeof(uint16_t), reinterpret_cast<std::byte*>(&seed));
-    // LOG_INFO << "seed:   " << binary_data.to_hex_string();
-    binary_data.append(sizeof(uint8_t), reinterpret_cast<std::byte*>(&level));
-    // LOG_INFO << "level:  " << binary_data.to_hex_string();
+    Binary binary_data(entry::size());
+    this->write(binary_data.data());
     return binary_data;
 }
 
+void BwtFS::Node::entry::write(std::byte* out) const {
+    uint8_t tp = (type == NodeType::WHITE_NODE) ? 0 : 1;
+    size_t offset = 0;
+    std::memcpy(out + offset, &bitmap, sizeof(size_t));
+    offset += sizeof(size_t);
+    std::memcpy(out + offset, &tp, sizeof(bool));
+    offset += sizeof(bool);
+    std::memcpy(out + offset, &start, sizeof(uint16_t));
+    offset += sizeof(uint16_t);
+    std::memcpy(out + offset, &length, sizeof(uint16_t));
+    offset += sizeof(uint16_t);
+    std::memcpy(out + offset, &seed, sizeof(uint16_t));
+    offset += sizeof(uint16_t);
+    std::memcpy(out + offset, &level, sizeof(uint8_t));
+}
+
 BwtFS::Node::entry BwtFS::Node::entry::from_binary(Binary& binary_data) {
-    // Store data in local variables to avoid dangling pointer
-    auto bitmap_data = binary_data.read(0, sizeof(size_t));
-    auto type_data = binary_data.read(sizeof(size_t), sizeof(bool));
-    auto start_data = binary_data.read(sizeof(size_t) + sizeof(bool), sizeof(uint16_t));
-    auto length_data = binary_data.read(sizeof(size_t) + sizeof(bool) + sizeof(uint16_t), sizeof(uint16_t));
-    auto seed_data = binary_data.read(sizeof(size_t) + sizeof(bool) + 2 * sizeof(uint16_t), sizeof(uint16_t));
-    auto level_data = binary_data.read(sizeof(size_t) + sizeof(bool) + 2 * sizeof(uint16_t) + sizeof(uint16_t), sizeof(uint8_t));
+    return from_binary(binary_data.view());
+}
 
-    // Now safely read the values
-    auto bitmap = *reinterpret_cast<size_t*>(bitmap_data.data());
-    auto type = *reinterpret_cast<bool*>(type_data.data());
-    auto start = *reinterpret_cast<uint16_t*>(start_data.data());
-    auto length = *reinterpret_cast<uint16_t*>(length_data.data());
-    auto seed = *reinterpret_cast<uint16_t*>(seed_data.data());
-    auto level = *reinterpret_cast<uint8_t*>(level_data.data());
+BwtFS::Node::entry BwtFS::Node::entry::from_binary(const BinaryView& binary_data) {
+    auto bitmap = binary_data.load<size_t>(0);
+    auto type = binary_data.load<uint8_t>(sizeof(size_t));
+    auto start = binary_data.load<uint16_t>(sizeof(size_t) + sizeof(bool));
+    auto length = binary_data.load<uint16_t>(sizeof(size_t) + sizeof(bool) + sizeof(uint16_t));
+    auto seed = binary_data.load<uint16_t>(sizeof(size_t) + sizeof(bool) + 2 * sizeof(uint16_t));
+    auto level = binary_data.load<uint8_t>(sizeof(size_t) + sizeof(bool) + 2 * sizeof(uint16_t) + sizeof(uint16_t));
 
     auto type_enum = (type == 0) ? NodeType::WHITE_NODE : NodeType::BLACK_NODE;
 
@@ -47,6 +47,10 @@ BwtFS::Node::entry BwtFS::Node::entry::from_binary(Binary& binary_data) {
 }
 
 BwtFS::Node::entry_list BwtFS::Node::entry_list::from_binary(Binary& binary_data, int num_entries) {
+    return from_binary(binary_data.view(), num_entries);
+}
+
+BwtFS::Node::entry_list BwtFS::Node::entry_list::from_binary(const BinaryView& binary_data, int num_entries) {
     entry_list list;
     size_t offset = 0;
 
@@ -73,24 +77,27 @@ BwtFS::Node::entry_list BwtFS::Node::entry_list::from_binary(Binary& binary_data
             //            << ", binary_data size: " << binary_data.size();
             break;  // Stop reading entries if we don't have enough data
         }
-        auto entry_data = binary_data.read(offset, entry::size());
-        Binary entry_binary(entry_data);
+        auto entry_binary = binary_data.slice(offset, entry::size());
         // LOG_DEBUG << "entry_binary size: " << entry_binary.size();
         if (entry_binary.size() == 0) {
             LOG_WARNING << "Entry binary size is 0, " << entry::size() << " bytes expected, current size: " << entry_binary.size();
             throw std::runtime_error("Entry binary size is 0");
             // continue;
         }
-        list.add_entry(std::move(entry::from_binary(entry_binary)));
+        list.add_entry(entry::from_binary(entry_binary));
         offset += entry::size();
     }
     return list;
 }
 
 BwtFS::Node::Binary BwtFS::Node::entry_list::to_binary() {
-    Binary binary_data;
-    for (auto& e : entries) {
-        binary_data += std::move(e.to_binary());
-    }
+    Binary binary_data(entries.size() * entry::size());
+    this->write(binary_data.data());
     return binary_data;
+}
+
+void BwtFS::Node::entry_list::write(std::byte* out) const {
+    for (size_t i = 0; i < entries.size(); i++) {
+        entries[i].write(out + i * entry::size());
+    }
 }
\ No newline at end of file
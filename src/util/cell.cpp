@@ -1,24 +1,389 @@
 #include "util/cell.h"
-#include "util/random.h"
+#include "config.h"
+#include <array>
+#include <atomic>
 #include <cstddef>
+#include <cstring>
+#include <span>
 #include "util/log.h"
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define BWTFS_RCA_X86 1
+#include <immintrin.h>
+#define BWTFS_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define BWTFS_TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(_M_X64) && defined(_MSC_VER)
+#define BWTFS_RCA_X86 1
+#include <intrin.h>
+#include <immintrin.h>
+#define BWTFS_TARGET_SSE41
+#define BWTFS_TARGET_AVX2
+#endif
+
+namespace{
+    using Table = std::array<std::array<uint8_t, 256>, 4>;
+
+    // table[op][b]为字节b经过操作op后的值
+    Table make_table(bool forward){
+        Table table{};
+        for (int op = 0; op < 4; op++){
+            for (int b = 0; b < 256; b++){
+                auto value = std::byte{(unsigned char)b};
+                switch (op){
+                    case 0:
+                        if (forward) BwtFS::Util::RCA::XOR(value);
+                        else BwtFS::Util::RCA::XOR_BACK(value);
+                        break;
+                    case 1:
+                        if (forward) BwtFS::Util::RCA::SHIFT(value);
+                        else BwtFS::Util::RCA::SHIFT_BACK(value);
+                        break;
+                    case 2:
+                        if (forward) BwtFS::Util::RCA::FD(value);
+                        else BwtFS::Util::RCA::FD_BACK(value);
+                        break;
+                    case 3:
+                        if (forward) BwtFS::Util::RCA::TD(value);
+                        else BwtFS::Util::RCA::TD_BACK(value);
+                        break;
+                }
+                table[op][b] = std::to_integer<uint8_t>(value);
+            }
+        }
+        return table;
+    }
+
+    const Table FORWARD_TABLE = make_table(true);
+    const Table BACKWARD_TABLE = make_table(false);
+
+    // 规则按2位压缩，第i个字节的操作在packed[i/4]的第2*(i%4)位起
+    inline uint8_t rule_at(const uint8_t* packed, size_t i){
+        return (packed[i / 4] >> (2 * (i % 4))) & 0b11;
+    }
+
+    // 由种子生成size个字节的压缩规则，写入out的前(size+3)/4个字节
+    // 序列与RandNumbers<int>(size, seed, 0, 3)一致，不生成中间数组
+    void pack_rule_into(unsigned seed, size_t size, uint8_t* out){
+        std::default_random_engine generator(seed);
+        std::uniform_int_distribution<int> distribution(0, 3);
+        std::memset(out, 0, (size + 3) / 4);
+        for (size_t i = 0; i < size; i++){
+            out[i / 4] |= distribution(generator) << (2 * (i % 4));
+        }
+    }
+
+    std::vector<uint8_t> pack_rule(unsigned seed, size_t size){
+        std::vector<uint8_t> packed((size + 3) / 4);
+        pack_rule_into(seed, size, packed.data());
+        return packed;
+    }
+
+    // rules为按顺序应用的各层压缩规则，每个字节依次经过所有层
+    void transform_table(std::byte* data, const uint8_t* const* rules, size_t levels, size_t size, bool forward){
+        auto& table = forward ? FORWARD_TABLE : BACKWARD_TABLE;
+        auto p = reinterpret_cast<uint8_t*>(data);
+        for (size_t i = 0; i < size; i++){
+            uint8_t b = p[i];
+            for (size_t l = 0; l < levels; l++){
+                b = table[rule_at(rules[l], i)][b];
+            }
+            p[i] = b;
+        }
+    }
+
+    // 每层一个规则指针，层数不超过level的取值范围时放在栈上，每个块不再分配
+    class RulePointers{
+        public:
+            explicit RulePointers(size_t levels){
+                if (levels > local.size()){
+                    heap.resize(levels);
+                }
+            }
+            const uint8_t** data(){
+                return heap.empty() ? local.data() : heap.data();
+            }
+        private:
+            std::array<const uint8_t*, 256> local;
+            std::vector<const uint8_t*> heap;
+    };
+
+    // 用查表实现变换[offset, size)的尾部，offset为4的倍数
+    [[maybe_unused]] void transform_tail(std::byte* data, const uint8_t* const* rules, size_t levels, size_t offset, size_t size, bool forward){
+        RulePointers tail(levels);
+        for (size_t l = 0; l < levels; l++){
+            tail.data()[l] = rules[l] + offset / 4;
+        }
+        transform_table(data + offset, tail.data(), levels, size - offset, forward);
+    }
+
+#ifdef BWTFS_RCA_X86
+    // FD和TD分别作用于高低两个半字节，且是自身的逆，用16项的半字节表
+    // XOR为低半字节异或高半字节，SHIFT为循环移位，直接用向量运算
+    std::array<uint8_t, 16> make_nibble(int op){
+        std::array<uint8_t, 16> nibble{};
+        for (int n = 0; n < 16; n++){
+            nibble[n] = FORWARD_TABLE[op][n] & 0x0F;
+        }
+        return nibble;
+    }
+
+    alignas(16) const std::array<uint8_t, 16> FD_NIBBLE = make_nibble(2);
+    alignas(16) const std::array<uint8_t, 16> TD_NIBBLE = make_nibble(3);
+    // 压缩规则展开：每个压缩字节复制到4个字节，再用掩码取出各自的2位
+    // 比较时不移位，直接与对应位置上的1、2、3比较
+    alignas(16) const uint8_t RULE_SPREAD[16] = {0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3};
+    alignas(16) const uint8_t RULE_MASK[16] = {0x03, 0x0C, 0x30, 0xC0, 0x03, 0x0C, 0x30, 0xC0,
+                                                0x03, 0x0C, 0x30, 0xC0, 0x03, 0x0C, 0x30, 0xC0};
+    alignas(16) const uint8_t RULE_ONE[16] = {0x01, 0x04, 0x10, 0x40, 0x01, 0x04, 0x10, 0x40,
+                                               0x01, 0x04, 0x10, 0x40, 0x01, 0x04, 0x10, 0x40};
+    alignas(16) const uint8_t RULE_TWO[16] = {0x02, 0x08, 0x20, 0x80, 0x02, 0x08, 0x20, 0x80,
+                                               0x02, 0x08, 0x20, 0x80, 0x02, 0x08, 0x20, 0x80};
+
+    BWTFS_TARGET_SSE41
+    void transform_sse41(std::byte* data, const uint8_t* const* rules, size_t levels, size_t size, bool forward){
+        const __m128i nibble = _mm_set1_epi8(0x0F);
+        const __m128i fd = _mm_load_si128(reinterpret_cast<const __m128i*>(FD_NIBBLE.data()));
+        const __m128i td = _mm_load_si128(reinterpret_cast<const __m128i*>(TD_NIBBLE.data()));
+        const __m128i spread = _mm_load_si128(reinterpret_cast<const __m128i*>(RULE_SPREAD));
+        const __m128i mask = _mm_load_si128(reinterpret_cast<const __m128i*>(RULE_MASK));
+        const __m128i one = _mm_load_si128(reinterpret_cast<const __m128i*>(RULE_ONE));
+        const __m128i two = _mm_load_si128(reinterpret_cast<const __m128i*>(RULE_TWO));
+        const __m128i rot_keep = _mm_set1_epi8(forward ? 0x7F : (char)0xFE);
+        const __m128i rot_carry = _mm_set1_epi8(forward ? (char)0x80 : 0x01);
+        size_t i = 0;
+        for (; i + 16 <= size; i += 16){
+            auto p = reinterpret_cast<__m128i*>(data + i);
+            __m128i v = _mm_loadu_si128(p);
+            for (size_t l = 0; l < levels; l++){
+                uint32_t packed;
+                std::memcpy(&packed, rules[l] + i / 4, sizeof(packed));
+                __m128i r = _mm_and_si128(_mm_shuffle_epi8(_mm_cvtsi32_si128((int)packed), spread), mask);
+                __m128i lo = _mm_and_si128(v, nibble);
+                __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), nibble);
+                __m128i x = _mm_xor_si128(v, hi);
+                __m128i s = forward
+                    ? _mm_or_si128(_mm_and_si128(_mm_srli_epi16(v, 1), rot_keep), _mm_and_si128(_mm_slli_epi16(v, 7), rot_carry))
+                    : _mm_or_si128(_mm_and_si128(_mm_slli_epi16(v, 1), rot_keep), _mm_and_si128(_mm_srli_epi16(v, 7), rot_carry));
+                __m128i f = _mm_or_si128(_mm_shuffle_epi8(fd, lo), _mm_slli_epi16(_mm_shuffle_epi8(fd, hi), 4));
+                __m128i t = _mm_or_si128(_mm_shuffle_epi8(td, lo), _mm_slli_epi16(_mm_shuffle_epi8(td, hi), 4));
+                v = _mm_blendv_epi8(x, s, _mm_cmpeq_epi8(r, one));
+                v = _mm_blendv_epi8(v, f, _mm_cmpeq_epi8(r, two));
+                v = _mm_blendv_epi8(v, t, _mm_cmpeq_epi8(r, mask));
+            }
+            _mm_storeu_si128(p, v);
+        }
+        if (i < size){
+            transform_tail(data, rules, levels, i, size, forward);
+        }
+    }
+
+    // AVX2常量，由transform_avx2初始化
+    struct Avx2Constants{
+        __m256i nibble, fd, td, spread, mask, one, two, rot_keep, rot_carry;
+    };
+
+    // 用一层压缩规则变换32个字节
+    BWTFS_TARGET_AVX2
+    inline __m256i step_avx2(__m256i v, const uint8_t* packed, const Avx2Constants& c, bool forward){
+        __m256i r = _mm256_and_si256(_mm256_shuffle_epi8(_mm256_broadcastsi128_si256(
+                        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(packed))), c.spread), c.mask);
+        __m256i lo = _mm256_and_si256(v, c.nibble);
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), c.nibble);
+        __m256i x = _mm256_xor_si256(v, hi);
+        __m256i s = forward
+            ? _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(v, 1), c.rot_keep), _mm256_and_si256(_mm256_slli_epi16(v, 7), c.rot_carry))
+            : _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi16(v, 1), c.rot_keep), _mm256_and_si256(_mm256_srli_epi16(v, 7), c.rot_carry));
+        __m256i f = _mm256_or_si256(_mm256_shuffle_epi8(c.fd, lo), _mm256_slli_epi16(_mm256_shuffle_epi8(c.fd, hi), 4));
+        __m256i t = _mm256_or_si256(_mm256_shuffle_epi8(c.td, lo), _mm256_slli_epi16(_mm256_shuffle_epi8(c.td, hi), 4));
+        v = _mm256_blendv_epi8(x, s, _mm256_cmpeq_epi8(r, c.one));
+        v = _mm256_blendv_epi8(v, f, _mm256_cmpeq_epi8(r, c.two));
+        return _mm256_blendv_epi8(v, t, _mm256_cmpeq_epi8(r, c.mask));
+    }
+
+    BWTFS_TARGET_AVX2
+    void transform_avx2(std::byte* data, const uint8_t* const* rules, size_t levels, size_t size, bool forward){
+        Avx2Constants c;
+        c.nibble = _mm256_set1_epi8(0x0F);
+        c.fd = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(FD_NIBBLE.data())));
+        c.td = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(TD_NIBBLE.data())));
+        // 高128位取第4~7个压缩字节
+        c.spread = _mm256_add_epi8(_mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(RULE_SPREAD))),
+                                   _mm256_setr_m128i(_mm_setzero_si128(), _mm_set1_epi8(4)));
+        c.mask = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(RULE_MASK)));
+        c.one = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(RULE_ONE)));
+        c.two = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(RULE_TWO)));
+        c.rot_keep = _mm256_set1_epi8(forward ? 0x7F : (char)0xFE);
+        c.rot_carry = _mm256_set1_epi8(forward ? (char)0x80 : 0x01);
+        size_t i = 0;
+        // 同时处理两组互不依赖的32字节，各层之间的依赖链可以交错执行
+        for (; i + 64 <= size; i += 64){
+            auto p = reinterpret_cast<__m256i*>(data + i);
+            __m256i v0 = _mm256_loadu_si256(p);
+            __m256i v1 = _mm256_loadu_si256(p + 1);
+            for (size_t l = 0; l < levels; l++){
+                v0 = step_avx2(v0, rules[l] + i / 4, c, forward);
+                v1 = step_avx2(v1, rules[l] + i / 4 + 8, c, forward);
+            }
+            _mm256_storeu_si256(p, v0);
+            _mm256_storeu_si256(p + 1, v1);
+        }
+        for (; i + 32 <= size; i += 32){
+            auto p = reinterpret_cast<__m256i*>(data + i);
+            __m256i v = _mm256_loadu_si256(p);
+            for (size_t l = 0; l < levels; l++){
+                v = step_avx2(v, rules[l] + i / 4, c, forward);
+            }
+            _mm256_storeu_si256(p, v);
+        }
+        if (i < size){
+            transform_tail(data, rules, levels, i, size, forward);
+        }
+    }
+
+    bool has_sse41(){
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 19)) != 0;
+#else
+        return __builtin_cpu_supports("sse4.1");
+#endif
+    }
+
+    bool has_avx2(){
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        // 操作系统需要保存YMM寄存器
+        if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 0x6) != 0x6){
+            return false;
+        }
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+#endif
+
+    using transform_fn = void(*)(std::byte*, const uint8_t* const*, size_t, size_t, bool);
+
+    transform_fn select(){
+#ifdef BWTFS_RCA_X86
+        if (has_avx2()){
+            return transform_avx2;
+        }
+        if (has_sse41()){
+            return transform_sse41;
+        }
+#endif
+        return transform_table;
+    }
+
+    const transform_fn IMPL = select();
+
+    // 节点各层的种子在[0, 2^15]之间，这些种子的规则按块大小生成一次后缓存
+    // 每个种子占BLOCK_SIZE/4字节，全部填满约32MB
+    // 同一种子较短数据的规则是较长规则的前缀，不超过块大小的数据都可以使用缓存
+    constexpr unsigned CACHED_SEEDS = (1u << 15) + 1;
+    constexpr size_t PACKED_SIZE = BwtFS::BLOCK_SIZE / 4;
+
+    // 首次使用时生成，之后无锁读取；进程退出前不释放
+    std::array<std::atomic<const uint8_t*>, CACHED_SEEDS> RULE_CACHE{};
+
+    const uint8_t* cached_rule(unsigned seed){
+        auto packed = RULE_CACHE[seed].load(std::memory_order_acquire);
+        if (packed != nullptr){
+            return packed;
+        }
+        auto buffer = new uint8_t[PACKED_SIZE];
+        pack_rule_into(seed, BwtFS::BLOCK_SIZE, buffer);
+        // 并发生成同一种子时只保留先写入的一份
+        const uint8_t* expected = nullptr;
+        if (!RULE_CACHE[seed].compare_exchange_strong(expected, buffer, std::memory_order_acq_rel)){
+            delete[] buffer;
+            return expected;
+        }
+        return buffer;
+    }
+
+    bool cacheable(unsigned seed, size_t size){
+        return seed < CACHED_SEEDS && size <= BwtFS::BLOCK_SIZE;
+    }
+
+    // 多层变换，forward为true时按seeds的顺序正向迭代，否则按相反顺序反向迭代
+    void transform_levels(std::span<std::byte> data, std::span<const uint16_t> seeds, bool forward){
+        size_t size = data.size();
+        if (size == 0 || seeds.empty()){
+            return;
+        }
+        RulePointers rules(seeds.size());
+        std::vector<std::vector<uint8_t>> owned;
+        for (size_t l = 0; l < seeds.size(); l++){
+            auto seed = forward ? seeds[l] : seeds[seeds.size() - 1 - l];
+            if (cacheable(seed, size)){
+                rules.data()[l] = cached_rule(seed);
+            }else{
+                owned.push_back(pack_rule(seed, size));
+                rules.data()[l] = owned.back().data();
+            }
+        }
+        IMPL(data.data(), rules.data(), seeds.size(), size, forward);
+    }
+}
+
 BwtFS::Util::RCA::RCA(unsigned seed, BwtFS::Node::Binary& binary){
     this->seed = seed;
     this->binary = binary;
-    this->rule = BwtFS::Util::RandNumbers<int>(binary.size(), seed, 0, 3);
+    this->make_rule_();
 }
 
-void BwtFS::Util::RCA::forward(){
-    for (size_t i = 0; i < this->binary.size(); i++){
-        apply(this->binary[i], this->rule[i], true);
+void BwtFS::Util::RCA::make_rule_(){
+    size_t size = this->binary.size();
+    if (!cacheable(this->seed, size)){
+        this->rule = pack_rule(this->seed, size);
+        return;
     }
+    auto packed = cached_rule(this->seed);
+    this->rule.assign(packed, packed + (size + 3) / 4);
+}
+
+void BwtFS::Util::RCA::forward(){
+    transform(this->binary.data(), this->rule.data(), this->binary.size(), true);
 }
 
 void BwtFS::Util::RCA::backward(){
-    for (size_t i = 0; i < this->binary.size(); i++){
-        apply(this->binary[i], this->rule[i], false);
+    transform(this->binary.data(), this->rule.data(), this->binary.size(), false);
+}
+
+void BwtFS::Util::RCA::forwardLevels(BwtFS::Node::Binary& binary, std::span<const uint16_t> seeds){
+    if (binary.size() == 0){
+        return;
     }
+    transform_levels({binary.data(), binary.size()}, seeds, true);
+}
+
+void BwtFS::Util::RCA::backwardLevels(BwtFS::Node::Binary& binary, std::span<const uint16_t> seeds){
+    if (binary.size() == 0){
+        return;
+    }
+    transform_levels({binary.data(), binary.size()}, seeds, false);
+}
+
+void BwtFS::Util::RCA::forwardLevels(std::span<std::byte> data, std::span<const uint16_t> seeds){
+    transform_levels(data, seeds, true);
+}
+
+void BwtFS::Util::RCA::backwardLevels(std::span<std::byte> data, std::span<const uint16_t> seeds){
+    transform_levels(data, seeds, false);
+}
+
+void BwtFS::Util::RCA::transform(std::byte* data, const uint8_t* rule, size_t size, bool forward){
+    IMPL(data, &rule, 1, size, forward);
+}
+
+bool BwtFS::Util::RCA::simd(){
+    return IMPL != transform_table;
 }
 
 void BwtFS::Util::RCA::XOR(std::byte& b){
@@ -80,24 +445,11 @@ void BwtFS::Util::RCA::TD_BACK(std::byte& b){
 }
 
 void BwtFS::Util::RCA::apply(std::byte& b, short operation, bool forward){
-    switch (operation){
-        case 0:
-            if (forward) XOR(b);
-            else XOR_BACK(b);
-            break;
-        case 1:
-            if (forward) SHIFT(b);
-            else SHIFT_BACK(b);
-            break;
-        case 2:
-            if (forward) FD(b);
-            else FD_BACK(b);
-            break;
-        case 3:
-            if (forward) TD(b);
-            else TD_BACK(b);
-            break;
+    if (operation < 0 || operation > 3){
+        return;
     }
+    auto& table = forward ? FORWARD_TABLE : BACKWARD_TABLE;
+    b = std::byte{table[operation][std::to_integer<uint8_t>(b)]};
 }
 
 void BwtFS::Util::RCA::setSeed(unsigned seed) { 
@@ -106,7 +458,7 @@ void BwtFS::Util::RCA::setSeed(unsigned seed) {
         LOG_WARNING << "Binary is empty, cannot set seed";
         throw std::runtime_error("Binary is empty");
     }
-    this->rule = BwtFS::Util::RandNumbers<int>(binary.size(), seed, 0, 3);
+    this->make_rule_();
 }
 
 void BwtFS::Util::RCA::setBinary(BwtFS::Node::Binary& binary) { 
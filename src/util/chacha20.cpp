@@ -0,0 +1,193 @@
+#include "util/chacha20.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define BWTFS_CHACHA_X86 1
+#include <immintrin.h>
+#define BWTFS_TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(_M_X64) && defined(_MSC_VER)
+#define BWTFS_CHACHA_X86 1
+#include <intrin.h>
+#include <immintrin.h>
+#define BWTFS_TARGET_AVX2
+#endif
+
+namespace BwtFS::Util{
+    namespace{
+        // 一个密钥流块的字节数
+        constexpr size_t CHACHA_BLOCK = 64;
+
+        inline uint32_t load32(const uint8_t* p){
+            uint32_t v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        inline uint32_t rotl(uint32_t v, int n){
+            return (v << n) | (v >> (32 - n));
+        }
+
+        // 初始状态：常量、密钥、计数器、nonce
+        void init_state(uint32_t state[16], const ChaCha20Key& key, const ChaCha20Nonce& nonce, uint32_t counter){
+            state[0] = 0x61707865;
+            state[1] = 0x3320646e;
+            state[2] = 0x79622d32;
+            state[3] = 0x6b206574;
+            for (int i = 0; i < 8; i++){
+                state[4 + i] = load32(key.data() + 4 * i);
+            }
+            state[12] = counter;
+            for (int i = 0; i < 3; i++){
+                state[13 + i] = load32(nonce.data() + 4 * i);
+            }
+        }
+
+        #define BWTFS_QR(a, b, c, d) \
+            a += b; d ^= a; d = rotl(d, 16); \
+            c += d; b ^= c; b = rotl(b, 12); \
+            a += b; d ^= a; d = rotl(d, 8); \
+            c += d; b ^= c; b = rotl(b, 7);
+
+        void block(const uint32_t state[16], uint8_t out[CHACHA_BLOCK]){
+            uint32_t x[16];
+            std::memcpy(x, state, sizeof(x));
+            for (int i = 0; i < 10; i++){
+                BWTFS_QR(x[0], x[4], x[8], x[12]);
+                BWTFS_QR(x[1], x[5], x[9], x[13]);
+                BWTFS_QR(x[2], x[6], x[10], x[14]);
+                BWTFS_QR(x[3], x[7], x[11], x[15]);
+                BWTFS_QR(x[0], x[5], x[10], x[15]);
+                BWTFS_QR(x[1], x[6], x[11], x[12]);
+                BWTFS_QR(x[2], x[7], x[8], x[13]);
+                BWTFS_QR(x[3], x[4], x[9], x[14]);
+            }
+            for (int i = 0; i < 16; i++){
+                x[i] += state[i];
+            }
+            std::memcpy(out, x, CHACHA_BLOCK);
+        }
+
+        #undef BWTFS_QR
+
+        // 用一个密钥流块异或最多64个字节，同时推进计数器
+        void xor_block(uint32_t state[16], std::byte* data, size_t size){
+            uint8_t stream[CHACHA_BLOCK];
+            block(state, stream);
+            state[12]++;
+            auto p = reinterpret_cast<uint8_t*>(data);
+            for (size_t i = 0; i < size; i++){
+                p[i] ^= stream[i];
+            }
+        }
+
+        void chacha20_soft(std::byte* data, size_t size, const ChaCha20Key& key, const ChaCha20Nonce& nonce, uint32_t counter){
+            uint32_t state[16];
+            init_state(state, key, nonce, counter);
+            for (size_t offset = 0; offset < size; offset += CHACHA_BLOCK){
+                xor_block(state, data + offset, std::min(CHACHA_BLOCK, size - offset));
+            }
+        }
+
+#ifdef BWTFS_CHACHA_X86
+        // 每个寄存器保存两个块状态中的同一行（低128位为第一个块，高128位为第二个块）
+        // 列轮之后把b、c、d行循环移位使对角线对齐，再按列计算
+        BWTFS_TARGET_AVX2
+        inline __m256i rotl_avx2(__m256i v, int n){
+            return _mm256_or_si256(_mm256_slli_epi32(v, n), _mm256_srli_epi32(v, 32 - n));
+        }
+
+        BWTFS_TARGET_AVX2
+        void chacha20_avx2(std::byte* data, size_t size, const ChaCha20Key& key, const ChaCha20Nonce& nonce, uint32_t counter){
+            uint32_t state[16];
+            init_state(state, key, nonce, counter);
+            // 16位和8位循环移位用字节重排完成
+            const __m256i rot16 = _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+                                                   2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+            const __m256i rot8 = _mm256_setr_epi8(3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14,
+                                                  3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14);
+            const __m256i row0 = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)));
+            const __m256i row1 = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state + 4)));
+            const __m256i row2 = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state + 8)));
+            __m256i row3 = _mm256_add_epi32(_mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state + 12))),
+                                            _mm256_setr_epi32(0, 0, 0, 0, 1, 0, 0, 0));
+            const __m256i two = _mm256_setr_epi32(2, 0, 0, 0, 2, 0, 0, 0);
+            size_t offset = 0;
+            for (; offset + 2 * CHACHA_BLOCK <= size; offset += 2 * CHACHA_BLOCK){
+                __m256i a = row0, b = row1, c = row2, d = row3;
+                for (int i = 0; i < 10; i++){
+                    a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot16);
+                    c = _mm256_add_epi32(c, d); b = rotl_avx2(_mm256_xor_si256(b, c), 12);
+                    a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot8);
+                    c = _mm256_add_epi32(c, d); b = rotl_avx2(_mm256_xor_si256(b, c), 7);
+                    b = _mm256_shuffle_epi32(b, 0x39);
+                    c = _mm256_shuffle_epi32(c, 0x4E);
+                    d = _mm256_shuffle_epi32(d, 0x93);
+                    a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot16);
+                    c = _mm256_add_epi32(c, d); b = rotl_avx2(_mm256_xor_si256(b, c), 12);
+                    a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot8);
+                    c = _mm256_add_epi32(c, d); b = rotl_avx2(_mm256_xor_si256(b, c), 7);
+                    b = _mm256_shuffle_epi32(b, 0x93);
+                    c = _mm256_shuffle_epi32(c, 0x4E);
+                    d = _mm256_shuffle_epi32(d, 0x39);
+                }
+                a = _mm256_add_epi32(a, row0);
+                b = _mm256_add_epi32(b, row1);
+                c = _mm256_add_epi32(c, row2);
+                d = _mm256_add_epi32(d, row3);
+                // 第一个块为各行的低128位，第二个块为高128位
+                auto p = reinterpret_cast<__m256i*>(data + offset);
+                __m256i first0 = _mm256_permute2x128_si256(a, b, 0x20);
+                __m256i first1 = _mm256_permute2x128_si256(c, d, 0x20);
+                __m256i second0 = _mm256_permute2x128_si256(a, b, 0x31);
+                __m256i second1 = _mm256_permute2x128_si256(c, d, 0x31);
+                _mm256_storeu_si256(p, _mm256_xor_si256(_mm256_loadu_si256(p), first0));
+                _mm256_storeu_si256(p + 1, _mm256_xor_si256(_mm256_loadu_si256(p + 1), first1));
+                _mm256_storeu_si256(p + 2, _mm256_xor_si256(_mm256_loadu_si256(p + 2), second0));
+                _mm256_storeu_si256(p + 3, _mm256_xor_si256(_mm256_loadu_si256(p + 3), second1));
+                row3 = _mm256_add_epi32(row3, two);
+            }
+            state[12] = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm256_castsi256_si128(row3)));
+            for (; offset < size; offset += CHACHA_BLOCK){
+                xor_block(state, data + offset, std::min(CHACHA_BLOCK, size - offset));
+            }
+        }
+
+        bool has_avx2(){
+#ifdef _MSC_VER
+            int info[4];
+            __cpuid(info, 1);
+            // 操作系统需要保存YMM寄存器
+            if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 0x6) != 0x6){
+                return false;
+            }
+            __cpuidex(info, 7, 0);
+            return (info[1] & (1 << 5)) != 0;
+#else
+            return __builtin_cpu_supports("avx2");
+#endif
+        }
+#endif
+
+        using chacha_fn = void(*)(std::byte*, size_t, const ChaCha20Key&, const ChaCha20Nonce&, uint32_t);
+
+        chacha_fn select(){
+#ifdef BWTFS_CHACHA_X86
+            if (has_avx2()){
+                return chacha20_avx2;
+            }
+#endif
+            return chacha20_soft;
+        }
+
+        const chacha_fn IMPL = select();
+    }
+
+    void chacha20(std::byte* data, size_t size, const ChaCha20Key& key, const ChaCha20Nonce& nonce, uint32_t counter){
+        IMPL(data, size, key, nonce, counter);
+    }
+
+    bool chacha20Simd(){
+        return IMPL != chacha20_soft;
+    }
+}
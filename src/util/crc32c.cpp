@@ -0,0 +1,113 @@
+#include <array>
+#include <cstring>
+#include "util/crc32c.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define BWTFS_CRC32C_X86 1
+#include <nmmintrin.h>
+#define BWTFS_TARGET_SSE42 __attribute__((target("sse4.2")))
+#elif defined(_M_X64) && defined(_MSC_VER)
+#define BWTFS_CRC32C_X86 1
+#include <intrin.h>
+#include <nmmintrin.h>
+#define BWTFS_TARGET_SSE42
+#endif
+
+namespace BwtFS::Util{
+    namespace{
+        // CRC32C多项式（反转形式）
+        constexpr uint32_t POLY = 0x82F63B78u;
+
+        // slicing-by-8查找表，table[k][b]为字节b后面跟k个0字节的CRC
+        std::array<std::array<uint32_t, 256>, 8> make_table(){
+            std::array<std::array<uint32_t, 256>, 8> table{};
+            for (uint32_t i = 0; i < 256; i++){
+                uint32_t crc = i;
+                for (int j = 0; j < 8; j++){
+                    crc = (crc >> 1) ^ ((crc & 1) ? POLY : 0);
+                }
+                table[0][i] = crc;
+            }
+            for (uint32_t i = 0; i < 256; i++){
+                for (int k = 1; k < 8; k++){
+                    table[k][i] = (table[k-1][i] >> 8) ^ table[0][table[k-1][i] & 0xFF];
+                }
+            }
+            return table;
+        }
+
+        const std::array<std::array<uint32_t, 256>, 8> TABLE = make_table();
+
+        uint32_t crc32c_soft(const std::byte* data, size_t size, uint32_t crc){
+            auto p = reinterpret_cast<const uint8_t*>(data);
+            while (size >= 8){
+                uint64_t word;
+                std::memcpy(&word, p, sizeof(word));
+                word ^= crc;
+                crc = TABLE[7][word & 0xFF] ^ TABLE[6][(word >> 8) & 0xFF] ^
+                      TABLE[5][(word >> 16) & 0xFF] ^ TABLE[4][(word >> 24) & 0xFF] ^
+                      TABLE[3][(word >> 32) & 0xFF] ^ TABLE[2][(word >> 40) & 0xFF] ^
+                      TABLE[1][(word >> 48) & 0xFF] ^ TABLE[0][word >> 56];
+                p += 8;
+                size -= 8;
+            }
+            while (size--){
+                crc = (crc >> 8) ^ TABLE[0][(crc ^ *p++) & 0xFF];
+            }
+            return crc;
+        }
+
+#ifdef BWTFS_CRC32C_X86
+        BWTFS_TARGET_SSE42
+        uint32_t crc32c_sse42(const std::byte* data, size_t size, uint32_t crc){
+            auto p = reinterpret_cast<const uint8_t*>(data);
+            uint64_t crc64 = crc;
+            // 每次处理8字节
+            while (size >= 8){
+                uint64_t word;
+                std::memcpy(&word, p, sizeof(word));
+                crc64 = _mm_crc32_u64(crc64, word);
+                p += 8;
+                size -= 8;
+            }
+            uint32_t crc32 = static_cast<uint32_t>(crc64);
+            while (size--){
+                crc32 = _mm_crc32_u8(crc32, *p++);
+            }
+            return crc32;
+        }
+
+        bool has_sse42(){
+#ifdef _MSC_VER
+            int info[4];
+            __cpuid(info, 1);
+            return (info[2] & (1 << 20)) != 0;
+#else
+            return __builtin_cpu_supports("sse4.2");
+#endif
+        }
+#endif
+
+        using crc_fn = uint32_t(*)(const std::byte*, size_t, uint32_t);
+
+        crc_fn select(){
+#ifdef BWTFS_CRC32C_X86
+            if (has_sse42()){
+                return crc32c_sse42;
+            }
+#endif
+            return crc32c_soft;
+        }
+
+        const crc_fn IMPL = select();
+    }
+
+    uint32_t crc32c(const std::byte* data, size_t size, uint32_t crc){
+        // 标准CRC32C：初值和结果都取反
+        return ~IMPL(data, size, ~crc);
+    }
+
+    bool crc32cHardware(){
+        return IMPL != crc32c_soft;
+    }
+}
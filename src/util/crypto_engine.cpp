@@ -0,0 +1,244 @@
+#include "util/crypto_engine.h"
+#include "util/cell.h"
+#include "util/secure_ptr.h"
+#include "util/ini_parser.h"
+#include "util/log.h"
+#include "config.h"
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <future>
+#include <random>
+#include <thread>
+
+using BwtFS::Util::Logger;
+
+namespace{
+    // 每个线程至少分到的任务数，任务太少时在调用线程直接完成
+    constexpr size_t MIN_JOBS_PER_THREAD = 4;
+}
+
+BwtFS::Util::CryptoEngine& BwtFS::Util::CryptoEngine::getInstance(){
+    static CryptoEngine instance;
+    return instance;
+}
+
+BwtFS::Util::CryptoEngine::CryptoEngine(){
+    auto& config = BwtFS::Config::getInstance();
+    size_t threads = std::stoul(config.get("system", "crypto_threads",
+                                std::to_string(BwtFS::DefaultConfig::SYSTEM_FILE_CRYPTO_THREADS)));
+    if (threads == 0){
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    this->workers = threads;
+    // 调用线程也参与计算，工作线程比总线程数少一个
+    if (threads > 1){
+        this->pool = std::make_unique<ThreadPool>(static_cast<int>(threads - 1));
+    }
+    this->setCipher(Cipher::RCA);
+    LOG_INFO << "Crypto engine: " << threads << " threads, RCA " << (RCA::simd() ? "SIMD" : "table")
+             << " kernel, ChaCha20 " << (chacha20Simd() ? "AVX2" : "scalar") << " kernel";
+}
+
+BwtFS::Util::CryptoEngine::~CryptoEngine(){
+    if (this->pool != nullptr){
+        this->pool->shutdown();
+    }
+}
+
+size_t BwtFS::Util::CryptoEngine::threads() const{
+    return this->workers;
+}
+
+std::vector<uint16_t> BwtFS::Util::CryptoEngine::levelSeeds(uint16_t seed, uint8_t level){
+    std::vector<uint16_t> seeds(level);
+    levelSeeds(seed, level, seeds);
+    return seeds;
+}
+
+void BwtFS::Util::CryptoEngine::levelSeeds(uint16_t seed, uint8_t level, std::span<uint16_t> out){
+    if (out.size() < level){
+        LOG_ERROR << "levelSeeds: output too small for level " << int(level);
+        throw std::runtime_error(std::string("levelSeeds: output too small: ") + __FILE__ + ":" + std::to_string(__LINE__));
+    }
+    // 与RandNumbers<uint16_t>(level, seed, 0, 1<<15)的序列一致，改变会导致已有的节点无法解密
+    std::default_random_engine generator(seed);
+    std::uniform_int_distribution<uint16_t> distribution(0, 1<<15);
+    for (uint8_t i = 0; i < level; i++){
+        out[i] = distribution(generator);
+    }
+}
+
+void BwtFS::Util::CryptoEngine::parallel(size_t count, const std::function<void(size_t, size_t)>& fn){
+    if (count == 0){
+        return;
+    }
+    size_t tasks = std::min(this->workers, (count + MIN_JOBS_PER_THREAD - 1) / MIN_JOBS_PER_THREAD);
+    if (tasks <= 1 || this->pool == nullptr){
+        fn(0, count);
+        return;
+    }
+    size_t step = (count + tasks - 1) / tasks;
+    std::vector<std::future<void>> futures;
+    // 第一段留给调用线程
+    for (size_t begin = step; begin < count; begin += step){
+        size_t end = std::min(count, begin + step);
+        futures.push_back(this->pool->submit([&fn, begin, end]{
+            fn(begin, end);
+        }));
+    }
+    std::exception_ptr error;
+    try{
+        fn(0, std::min(count, step));
+    }catch(...){
+        error = std::current_exception();
+    }
+    // 全部等待完成后再抛出第一个异常，避免任务还在使用调用者的数据
+    for (auto& f : futures){
+        try{
+            f.get();
+        }catch(...){
+            if (!error) error = std::current_exception();
+        }
+    }
+    if (error){
+        std::rethrow_exception(error);
+    }
+}
+
+void BwtFS::Util::CryptoEngine::setCipher(Cipher cipher, const ChaCha20Key& key, bool legacy_nonce){
+    std::lock_guard<std::mutex> lock(this->cipher_mutex);
+    this->current_cipher = cipher;
+    this->key = key;
+    this->legacy_nonce = legacy_nonce;
+    this->trailer = cipher == Cipher::CHACHA20 && !legacy_nonce ? CHACHA20_NONCE_TRAILER : 0;
+    std::random_device device;
+    this->nonce_prefix = device();
+    this->nonce_counter = (static_cast<uint64_t>(device()) << 32) | device();
+}
+
+size_t BwtFS::Util::CryptoEngine::trailerSize() const{
+    return this->trailer.load(std::memory_order_relaxed);
+}
+
+size_t BwtFS::Util::CryptoEngine::nodeDataSize() const{
+    return BwtFS::BLOCK_SIZE - sizeof(uint8_t) - this->trailerSize();
+}
+
+BwtFS::Util::Cipher BwtFS::Util::CryptoEngine::cipher() const{
+    std::lock_guard<std::mutex> lock(this->cipher_mutex);
+    return this->current_cipher;
+}
+
+BwtFS::Util::Cipher BwtFS::Util::CryptoEngine::parseCipher(const std::string& name){
+    if (name == "rca"){
+        return Cipher::RCA;
+    }
+    if (name == "chacha20"){
+        return Cipher::CHACHA20;
+    }
+    LOG_ERROR << "Unknown cipher: " << name;
+    throw std::runtime_error(std::string("Unknown cipher: ") + __FILE__ + ":" + std::to_string(__LINE__));
+}
+
+std::string BwtFS::Util::CryptoEngine::cipherName(Cipher cipher){
+    switch (cipher){
+        case Cipher::RCA:
+            return "rca";
+        case Cipher::CHACHA20:
+            return "chacha20";
+    }
+    return "unknown";
+}
+
+void BwtFS::Util::CryptoEngine::encrypt(std::vector<CryptoJob>& jobs){
+    Cipher cipher;
+    ChaCha20Key key;
+    bool legacy;
+    uint32_t prefix;
+    uint64_t first = 0;
+    {
+        std::lock_guard<std::mutex> lock(this->cipher_mutex);
+        cipher = this->current_cipher;
+        key = this->key;
+        legacy = this->legacy_nonce;
+        prefix = this->nonce_prefix;
+    }
+    if (cipher == Cipher::CHACHA20 && !legacy){
+        // 一批任务一次取出连续的计数
+        first = this->nonce_counter.fetch_add(jobs.size(), std::memory_order_relaxed);
+    }
+    auto work = [&jobs, cipher, &key, legacy, prefix, first](size_t begin, size_t end){
+        ChaCha20Encryptor chacha(key);
+        for (size_t i = begin; i < end; i++){
+            if (cipher == Cipher::CHACHA20){
+                auto data = jobs[i].data;
+                if (legacy){
+                    chacha.setNonce(jobs[i].bitmap, jobs[i].seed, jobs[i].level);
+                    chacha.encrypt(data.data(), data.size());
+                    continue;
+                }
+                if (data.size() <= CHACHA20_NONCE_TRAILER){
+                    throw std::runtime_error(std::string("CryptoEngine::encrypt: block too small for the nonce: ") + __FILE__ + ":" + std::to_string(__LINE__));
+                }
+                ChaCha20Nonce nonce;
+                uint64_t counter = first + i;
+                std::memcpy(nonce.data(), &prefix, sizeof(prefix));
+                std::memcpy(nonce.data() + sizeof(prefix), &counter, sizeof(counter));
+                size_t body = data.size() - CHACHA20_NONCE_TRAILER;
+                std::memcpy(data.data() + body, nonce.data(), nonce.size());
+                chacha.setNonce(nonce);
+                chacha.encrypt(data.data(), body);
+                continue;
+            }
+            std::array<uint16_t, UINT8_MAX> seeds;
+            levelSeeds(jobs[i].seed, jobs[i].level, seeds);
+            RCA::forwardLevels(jobs[i].data, std::span<const uint16_t>(seeds.data(), jobs[i].level));
+        }
+    };
+    // 按引用传入，std::function不为捕获分配内存
+    this->parallel(jobs.size(), std::ref(work));
+}
+
+void BwtFS::Util::CryptoEngine::decrypt(std::vector<CryptoJob>& jobs){
+    Cipher cipher;
+    ChaCha20Key key;
+    bool legacy;
+    {
+        std::lock_guard<std::mutex> lock(this->cipher_mutex);
+        cipher = this->current_cipher;
+        key = this->key;
+        legacy = this->legacy_nonce;
+    }
+    auto work = [&jobs, cipher, &key, legacy](size_t begin, size_t end){
+        ChaCha20Encryptor chacha(key);
+        for (size_t i = begin; i < end; i++){
+            if (cipher == Cipher::CHACHA20){
+                auto data = jobs[i].data;
+                if (legacy){
+                    chacha.setNonce(jobs[i].bitmap, jobs[i].seed, jobs[i].level);
+                    chacha.decrypt(data.data(), data.size());
+                    continue;
+                }
+                if (data.size() <= CHACHA20_NONCE_TRAILER){
+                    throw std::runtime_error(std::string("CryptoEngine::decrypt: block too small for the nonce: ") + __FILE__ + ":" + std::to_string(__LINE__));
+                }
+                // 块末尾是加密时写入的nonce
+                ChaCha20Nonce nonce;
+                size_t body = data.size() - CHACHA20_NONCE_TRAILER;
+                std::memcpy(nonce.data(), data.data() + body, nonce.size());
+                chacha.setNonce(nonce);
+                chacha.decrypt(data.data(), body);
+                continue;
+            }
+            std::array<uint16_t, UINT8_MAX> seeds;
+            levelSeeds(jobs[i].seed, jobs[i].level, seeds);
+            RCA::backwardLevels(jobs[i].data, std::span<const uint16_t>(seeds.data(), jobs[i].level));
+        }
+    };
+    // 按引用传入，std::function不为捕获分配内存
+    this->parallel(jobs.size(), std::ref(work));
+}
@@ -2,6 +2,7 @@
 #include<vector>
 #include <cstddef>
 #include <random>
+#include <cstring>
 #include "util/random.h"
 
 namespace BwtFS::Util{
@@ -11,6 +12,7 @@ namespace BwtFS::Util{
         std::default_random_engine generator(seed);
         std::uniform_int_distribution<T> distribution(min, max); // 生成[min, max]之间的随机数
         std::vector<T> v;
+        v.reserve(n > 0 ? n : 0);
         for(int i = 0; i < n; i++){
             v.push_back(distribution(generator));
         }
@@ -26,6 +28,7 @@ namespace BwtFS::Util{
         std::default_random_engine generator(seed);
         std::uniform_int_distribution<int> distribution(min, max); // 生成[min, max]之间的随机数
         std::vector<std::byte> v;
+        v.reserve(n > 0 ? n : 0);
         for(int i = 0; i < n; i++){
             v.push_back((std::byte)distribution(generator));
         }
@@ -39,4 +42,45 @@ namespace BwtFS::Util{
         std::uniform_int_distribution<int> distribution(min, max); // 生成[min, max]之间的随机数
         return distribution(generator);
     }
+
+    namespace{
+        uint64_t rotl(uint64_t x, int k){
+            return (x << k) | (x >> (64 - k));
+        }
+    }
+
+    FastRandom::FastRandom(uint64_t seed){
+        // 用splitmix64展开种子，避免状态全为0
+        for (auto& s : state){
+            seed += 0x9E3779B97F4A7C15ull;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            s = z ^ (z >> 31);
+        }
+    }
+
+    uint64_t FastRandom::next(){
+        const uint64_t result = rotl(state[1] * 5, 7) * 9;
+        const uint64_t t = state[1] << 17;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 45);
+        return result;
+    }
+
+    void FastRandom::fill(std::byte* data, size_t size){
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)){
+            uint64_t v = next();
+            std::memcpy(data + i, &v, sizeof(uint64_t));
+        }
+        if (i < size){
+            uint64_t v = next();
+            std::memcpy(data + i, &v, size - i);
+        }
+    }
 }
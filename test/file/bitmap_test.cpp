@@ -0,0 +1,196 @@
+#include "file/system.h"
+#include "file/bitmap.h"
+#include "config.h"
+#include "gtest/gtest.h"
+#include <filesystem>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <set>
+#include <map>
+
+namespace{
+    // 测试用的卷放在临时目录中，结束后删除
+    std::string test_volume(const std::string& name){
+        return (std::filesystem::temp_directory_path() / name).string();
+    }
+
+    std::shared_ptr<BwtFS::System::FileSystem> open_volume(const std::string& path){
+        std::filesystem::remove(path);
+        if (!BwtFS::System::createBwtFS(path, 64*BwtFS::MB, "") || !BwtFS::System::initBwtFS(path)){
+            return nullptr;
+        }
+        return BwtFS::System::openBwtFS(path);
+    }
+
+    size_t free_blocks(const std::shared_ptr<BwtFS::System::FileSystem>& fs){
+        return fs->getBlockCount() - fs->bitmap->getSystemUsedSize() / BwtFS::BLOCK_SIZE;
+    }
+
+    // 分配直到没有空闲块
+    std::vector<size_t> allocate_all(BwtFS::System::Bitmap& bitmap){
+        std::vector<size_t> blocks;
+        try{
+            while (true){
+                blocks.push_back(bitmap.getFreeBlock());
+            }
+        }catch(const std::out_of_range&){
+        }
+        return blocks;
+    }
+}
+
+TEST(BitmapTest, ConcurrentAllocateUnique){
+    auto path = test_volume("bwtfs_bitmap_alloc_test.bwt");
+    auto fs = open_volume(path);
+    ASSERT_NE(fs, nullptr);
+    auto expected = free_blocks(fs);
+    // 多个线程各自在自己的分片中分配，分片用完后互相借用，不会重复分配
+    std::vector<size_t> blocks;
+    std::mutex mutex;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; t++){
+        threads.emplace_back([&]{
+            auto mine = allocate_all(*fs->bitmap);
+            std::lock_guard<std::mutex> lock(mutex);
+            blocks.insert(blocks.end(), mine.begin(), mine.end());
+        });
+    }
+    for (auto& thread : threads){
+        thread.join();
+    }
+    EXPECT_EQ(blocks.size(), expected);
+    EXPECT_EQ(std::set<size_t>(blocks.begin(), blocks.end()).size(), blocks.size());
+    for (auto block : blocks){
+        ASSERT_NE(block, 0u);
+        ASSERT_LT(block, fs->getBlockCount());
+        ASSERT_FALSE(fs->bitmap->get(block));
+        ASSERT_LT(fs->bitmap->getWearBlock(block), 254);
+    }
+    // 分配不改变位图，归还后可以重新分配
+    EXPECT_EQ(free_blocks(fs), expected);
+    fs->bitmap->release(blocks);
+    EXPECT_EQ(allocate_all(*fs->bitmap).size(), expected);
+    std::filesystem::remove(path);
+}
+
+TEST(BitmapTest, ReleaseAndCommit){
+    auto path = test_volume("bwtfs_bitmap_release_test.bwt");
+    auto fs = open_volume(path);
+    ASSERT_NE(fs, nullptr);
+    auto& bitmap = *fs->bitmap;
+    auto expected = free_blocks(fs);
+    std::vector<size_t> blocks;
+    for (int i = 0; i < 16; i++){
+        blocks.push_back(bitmap.getFreeBlock());
+    }
+    std::span<const size_t> released(blocks.data(), 8);
+    std::span<const size_t> committed(blocks.data() + 8, 8);
+    bitmap.release(released);
+    bitmap.setMany(committed);
+    for (auto block : committed){
+        EXPECT_TRUE(bitmap.get(block));
+    }
+    EXPECT_EQ(free_blocks(fs), expected - committed.size());
+    // 归还的块可以再次分配，已提交的块不会
+    auto rest = allocate_all(bitmap);
+    EXPECT_EQ(rest.size(), expected - committed.size());
+    std::set<size_t> again(rest.begin(), rest.end());
+    for (auto block : released){
+        EXPECT_TRUE(again.count(block));
+    }
+    for (auto block : committed){
+        EXPECT_FALSE(again.count(block));
+    }
+    // 提交后对已提交的块调用release不影响位图
+    bitmap.release(committed);
+    for (auto block : committed){
+        EXPECT_TRUE(bitmap.get(block));
+    }
+    bitmap.release(rest);
+    bitmap.clearMany(committed);
+    EXPECT_EQ(free_blocks(fs), expected);
+    std::filesystem::remove(path);
+}
+
+TEST(BitmapTest, WearRebase){
+    auto path = test_volume("bwtfs_bitmap_wear_test.bwt");
+    auto fs = open_volume(path);
+    ASSERT_NE(fs, nullptr);
+    auto& bitmap = *fs->bitmap;
+    // 所有空闲块写一次，最小磨损值变为1
+    auto blocks = allocate_all(bitmap);
+    ASSERT_FALSE(blocks.empty());
+    bitmap.setMany(blocks);
+    bitmap.clearMany(blocks);
+    for (auto block : {blocks.front(), blocks.back()}){
+        EXPECT_EQ(bitmap.getWearBlock(block), 1);
+    }
+    // 反复写同一个块，磨损值将超过250时整体下移，其它块回到0
+    size_t hot = blocks.front();
+    std::vector<size_t> one = {hot};
+    for (int i = 0; i < 260; i++){
+        bitmap.setMany(one);
+        bitmap.clearMany(one);
+        ASSERT_LT(bitmap.getWearBlock(hot), 254);
+    }
+    EXPECT_EQ(bitmap.getWearBlock(blocks.back()), 0);
+    EXPECT_GT(bitmap.getWearBlock(hot), 0);
+    // 下移后仍从磨损值最小的块中分配
+    auto block = bitmap.getFreeBlock();
+    EXPECT_EQ(bitmap.getWearBlock(block), 0);
+    EXPECT_NE(block, hot);
+    std::vector<size_t> allocated = {block};
+    bitmap.release(allocated);
+    EXPECT_EQ(free_blocks(fs), blocks.size());
+    std::filesystem::remove(path);
+}
+
+TEST(BitmapTest, MinimumWearAmongWornBlocks){
+    auto path = test_volume("bwtfs_bitmap_min_wear_test.bwt");
+    auto fs = open_volume(path);
+    ASSERT_NE(fs, nullptr);
+    auto& bitmap = *fs->bitmap;
+    auto expected = free_blocks(fs);
+    // 每个区域（4096个块）只留一个磨损值为0的空闲块，其余空闲块写一次后释放，磨损值为1
+    auto blocks = allocate_all(bitmap);
+    std::map<size_t, size_t> kept;
+    for (auto block : blocks){
+        kept[block / BwtFS::BLOCK_SIZE] = block;
+    }
+    std::set<size_t> fresh;
+    std::vector<size_t> worn;
+    for (auto& [region, block] : kept){
+        fresh.insert(block);
+    }
+    for (auto block : blocks){
+        if (!fresh.count(block)){
+            worn.push_back(block);
+        }
+    }
+    std::vector<size_t> fresh_blocks(fresh.begin(), fresh.end());
+    bitmap.release(fresh_blocks);
+    bitmap.setMany(worn);
+    bitmap.clearMany(worn);
+    // 分片内的其它空闲块都更旧，仍然先返回剩下的磨损值为0的块，取完后才分配磨损值为1的块
+    std::vector<size_t> allocated;
+    while (true){
+        auto block = bitmap.getFreeBlock();
+        allocated.push_back(block);
+        if (bitmap.getWearBlock(block) != 0){
+            break;
+        }
+        ASSERT_TRUE(fresh.count(block)) << "block " << block;
+        ASSERT_LE(allocated.size(), fresh.size());
+    }
+    EXPECT_GE(allocated.size(), 2u);
+    EXPECT_EQ(bitmap.getWearBlock(allocated.back()), 1);
+    // 归还后同样先返回磨损值为0的块
+    bitmap.release(allocated);
+    auto block = bitmap.getFreeBlock();
+    EXPECT_TRUE(fresh.count(block));
+    allocated = {block};
+    bitmap.release(allocated);
+    EXPECT_EQ(free_blocks(fs), expected);
+    std::filesystem::remove(path);
+}
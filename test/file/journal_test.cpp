@@ -0,0 +1,177 @@
+#include "file/journal.h"
+#include "file/system_file.h"
+#include "config.h"
+#include "gtest/gtest.h"
+#include <filesystem>
+
+namespace{
+    // 日志放在临时文件中的一段块里，结束后删除文件
+    constexpr size_t JOURNAL_START = 16;
+    constexpr size_t JOURNAL_BLOCKS = 8;
+
+    std::shared_ptr<BwtFS::System::File> open_file(const std::string& name){
+        auto path = (std::filesystem::temp_directory_path() / name).string();
+        std::filesystem::remove(path);
+        BwtFS::System::File::createFile(path, 64*BwtFS::MB);
+        return BwtFS::System::File::open(path);
+    }
+
+    void remove_file(const std::shared_ptr<BwtFS::System::File>& file, const std::string& name){
+        file->close();
+        std::filesystem::remove(std::filesystem::temp_directory_path() / name);
+    }
+
+    std::vector<BwtFS::System::JournalEntry> make_entries(size_t count, uint64_t first){
+        std::vector<BwtFS::System::JournalEntry> entries(count);
+        for (size_t i = 0; i < count; i++){
+            entries[i] = {first + i, (uint32_t)(first * 31 + i), BwtFS::System::JournalEntry::SET, (uint8_t)(i % 250), {}};
+        }
+        return entries;
+    }
+
+    void expect_entries(const std::vector<BwtFS::System::JournalEntry>& actual,
+                        const std::vector<BwtFS::System::JournalEntry>& expected){
+        ASSERT_EQ(actual.size(), expected.size());
+        for (size_t i = 0; i < actual.size(); i++){
+            EXPECT_EQ(actual[i].index, expected[i].index);
+            EXPECT_EQ(actual[i].checksum, expected[i].checksum);
+            EXPECT_EQ(actual[i].type, expected[i].type);
+            EXPECT_EQ(actual[i].wear, expected[i].wear);
+        }
+    }
+
+    // 日志头之后的第n个记录块
+    unsigned long long record_offset(size_t n){
+        return (JOURNAL_START + 1 + n) * BwtFS::BLOCK_SIZE;
+    }
+}
+
+TEST(JournalTest, AppendReplay){
+    std::string name = "bwtfs_journal_replay_test.bwt";
+    auto file = open_file(name);
+    auto first = make_entries(3, 100);
+    // 超过一个块的记录
+    auto second = make_entries(400, 1000);
+    auto third = make_entries(1, 5000);
+    {
+        BwtFS::System::Journal journal(JOURNAL_START, JOURNAL_BLOCKS, file);
+        journal.init();
+        EXPECT_TRUE(journal.append(first, 11));
+        EXPECT_TRUE(journal.append(second, 22));
+        EXPECT_TRUE(journal.append(third, 33));
+    }
+    auto expected = first;
+    expected.insert(expected.end(), second.begin(), second.end());
+    expected.insert(expected.end(), third.begin(), third.end());
+    BwtFS::System::Journal journal(JOURNAL_START, JOURNAL_BLOCKS, file);
+    unsigned long long modify_time = 0;
+    expect_entries(journal.replay(modify_time), expected);
+    EXPECT_EQ(modify_time, 33u);
+    // 重复重放结果不变
+    BwtFS::System::Journal again(JOURNAL_START, JOURNAL_BLOCKS, file);
+    modify_time = 0;
+    expect_entries(again.replay(modify_time), expected);
+    EXPECT_EQ(modify_time, 33u);
+    remove_file(file, name);
+}
+
+TEST(JournalTest, TornRecord){
+    std::string name = "bwtfs_journal_torn_test.bwt";
+    auto file = open_file(name);
+    auto first = make_entries(4, 100);
+    auto second = make_entries(4, 200);
+    auto third = make_entries(4, 300);
+    {
+        BwtFS::System::Journal journal(JOURNAL_START, JOURNAL_BLOCKS, file);
+        journal.init();
+        journal.append(first, 11);
+        journal.append(second, 22);
+        journal.append(third, 33);
+    }
+    // 第二条记录损坏：改动其中的一个日志项
+    auto block = file->read(record_offset(1));
+    block.set(100, std::byte((uint8_t)block.get(100) ^ 0x5A));
+    file->write(record_offset(1), block);
+    // 遇到不完整的记录即停止，之后的记录也不重放
+    BwtFS::System::Journal journal(JOURNAL_START, JOURNAL_BLOCKS, file);
+    unsigned long long modify_time = 0;
+    expect_entries(journal.replay(modify_time), first);
+    EXPECT_EQ(modify_time, 11u);
+    remove_file(file, name);
+}
+
+TEST(JournalTest, TornTail){
+    std::string name = "bwtfs_journal_tail_test.bwt";
+    auto file = open_file(name);
+    auto first = make_entries(4, 100);
+    auto second = make_entries(400, 200);
+    auto third = make_entries(4, 300);
+    {
+        BwtFS::System::Journal journal(JOURNAL_START, JOURNAL_BLOCKS, file);
+        journal.init();
+        journal.append(first, 11);
+        journal.append(second, 22);
+    }
+    // 最后一条记录写到一半时中断：第二个块还是旧数据
+    file->write(record_offset(2), BwtFS::Node::Binary(BwtFS::BLOCK_SIZE));
+    unsigned long long modify_time = 0;
+    {
+        BwtFS::System::Journal journal(JOURNAL_START, JOURNAL_BLOCKS, file);
+        expect_entries(journal.replay(modify_time), first);
+        EXPECT_EQ(modify_time, 11u);
+        // 新的记录覆盖不完整的记录
+        journal.append(third, 44);
+    }
+    auto expected = first;
+    expected.insert(expected.end(), third.begin(), third.end());
+    BwtFS::System::Journal journal(JOURNAL_START, JOURNAL_BLOCKS, file);
+    expect_entries(journal.replay(modify_time), expected);
+    EXPECT_EQ(modify_time, 44u);
+    remove_file(file, name);
+}
+
+TEST(JournalTest, ResetAndDamagedHeader){
+    std::string name = "bwtfs_journal_reset_test.bwt";
+    auto file = open_file(name);
+    {
+        BwtFS::System::Journal journal(JOURNAL_START, JOURNAL_BLOCKS, file);
+        journal.init();
+        journal.append(make_entries(4, 100), 11);
+        // 清空后旧记录仍在文件中，但代数不同，不再重放
+        journal.reset();
+    }
+    unsigned long long modify_time = 0;
+    {
+        BwtFS::System::Journal journal(JOURNAL_START, JOURNAL_BLOCKS, file);
+        EXPECT_TRUE(journal.replay(modify_time).empty());
+        EXPECT_EQ(modify_time, 0u);
+        journal.append(make_entries(4, 200), 22);
+    }
+    // 日志头损坏时丢弃整个日志
+    auto header = file->read(JOURNAL_START * BwtFS::BLOCK_SIZE);
+    header.set(12, std::byte((uint8_t)header.get(12) ^ 0x01));
+    file->write(JOURNAL_START * BwtFS::BLOCK_SIZE, header);
+    {
+        BwtFS::System::Journal journal(JOURNAL_START, JOURNAL_BLOCKS, file);
+        EXPECT_TRUE(journal.replay(modify_time).empty());
+        EXPECT_EQ(modify_time, 0u);
+    }
+    BwtFS::System::Journal journal(JOURNAL_START, JOURNAL_BLOCKS, file);
+    EXPECT_TRUE(journal.replay(modify_time).empty());
+    remove_file(file, name);
+}
+
+TEST(JournalTest, Full){
+    std::string name = "bwtfs_journal_full_test.bwt";
+    auto file = open_file(name);
+    BwtFS::System::Journal journal(JOURNAL_START, JOURNAL_BLOCKS, file);
+    journal.init();
+    // 日志头之后还有JOURNAL_BLOCKS - 1个块
+    for (size_t i = 0; i + 1 < JOURNAL_BLOCKS; i++){
+        EXPECT_TRUE(journal.append(make_entries(1, i), i));
+    }
+    EXPECT_FALSE(journal.append(make_entries(1, 100), 100));
+    journal.reset();
+    EXPECT_TRUE(journal.append(make_entries(1, 100), 100));
+    remove_file(file, name);
+}
@@ -0,0 +1,178 @@
+#include "file/system.h"
+#include "file/striped_file.h"
+#include "util/random.h"
+#include "config.h"
+#include "gtest/gtest.h"
+#include <filesystem>
+#include <fstream>
+
+namespace{
+    // 测试用的卷放在临时目录中，结束后删除
+    std::string test_volume(const std::string& name){
+        return (std::filesystem::temp_directory_path() / name).string();
+    }
+
+    unsigned block_count_of(const std::shared_ptr<BwtFS::System::File>& file){
+        return (file->getFileSize() - sizeof(unsigned) - file->getPrefixSize()) / BwtFS::BLOCK_SIZE;
+    }
+
+    // 认证块：修改时间、超级块哈希、种子
+    const size_t AUTH_SIZE = sizeof(unsigned long long) + sizeof(size_t) + sizeof(unsigned);
+}
+
+TEST(SystemTest, OpenLegacyAuthOffset){
+    auto path = test_volume("bwtfs_legacy_auth_test.bwt");
+    std::filesystem::remove(path);
+    ASSERT_TRUE(BwtFS::System::createBwtFS(path, 64*BwtFS::MB, ""));
+    ASSERT_TRUE(BwtFS::System::initBwtFS(path));
+    unsigned long long reserved;
+    {
+        // 改成旧版本的布局：认证块在字节偏移block_count-1处，保留块中为随机数据
+        auto file = BwtFS::System::File::open(path);
+        auto block_count = block_count_of(file);
+        reserved = (unsigned long long)(block_count - 1) * BwtFS::BLOCK_SIZE;
+        auto auth = file->read(reserved).read(0, AUTH_SIZE);
+        file->write(block_count - 1, BwtFS::Node::Binary(auth));
+        file->write(reserved, BwtFS::Node::Binary(BwtFS::Util::RandBytes(BwtFS::BLOCK_SIZE, 1, 0, 255)));
+        file->sync();
+        file->close();
+    }
+    {
+        auto fs = BwtFS::System::openBwtFS(path);
+        ASSERT_NE(fs, nullptr);
+        EXPECT_TRUE(fs->check());
+    }
+    {
+        // 打开时已迁移到保留块，再次打开直接通过校验
+        auto file = BwtFS::System::File::open(path);
+        auto auth = file->read(reserved).read(0, AUTH_SIZE);
+        auto legacy = file->read(block_count_of(file) - 1).read(0, AUTH_SIZE);
+        EXPECT_EQ(auth, legacy);
+        file->close();
+        auto fs = BwtFS::System::openBwtFS(path);
+        ASSERT_NE(fs, nullptr);
+        EXPECT_TRUE(fs->check());
+    }
+    std::filesystem::remove(path);
+}
+
+TEST(SystemTest, OpenAfterInterruptedFileGrow){
+    auto path = test_volume("bwtfs_grow_file_test.bwt");
+    std::filesystem::remove(path);
+    ASSERT_TRUE(BwtFS::System::createBwtFS(path, 64*BwtFS::MB, ""));
+    ASSERT_TRUE(BwtFS::System::initBwtFS(path));
+    unsigned old_count;
+    {
+        // 扩容在扩大文件之后中断：新的最后一个块中是原来超级块的认证块，超级块和位图不变
+        auto file = BwtFS::System::File::open(path);
+        old_count = block_count_of(file);
+        auto auth = file->read((unsigned long long)(old_count - 1) * BwtFS::BLOCK_SIZE).read(0, AUTH_SIZE);
+        file->grow(96*BwtFS::MB, BwtFS::Node::Binary(auth));
+        file->sync();
+        file->close();
+    }
+    {
+        auto fs = BwtFS::System::openBwtFS(path);
+        ASSERT_NE(fs, nullptr);
+        EXPECT_TRUE(fs->check());
+        EXPECT_EQ(fs->getBlockCount(), old_count);
+        // 再次扩容时新增的空间包括上次没有用上的块
+        fs->grow(128*BwtFS::MB);
+        EXPECT_TRUE(fs->check());
+    }
+    {
+        auto file = BwtFS::System::File::open(path);
+        auto count = block_count_of(file);
+        file->close();
+        auto fs = BwtFS::System::openBwtFS(path);
+        ASSERT_NE(fs, nullptr);
+        EXPECT_TRUE(fs->check());
+        EXPECT_EQ(fs->getBlockCount(), count);
+    }
+    std::filesystem::remove(path);
+}
+
+TEST(SystemTest, OpenAfterInterruptedSuperblockRewrite){
+    auto path = test_volume("bwtfs_grow_superblock_test.bwt");
+    std::filesystem::remove(path);
+    ASSERT_TRUE(BwtFS::System::createBwtFS(path, 64*BwtFS::MB, ""));
+    ASSERT_TRUE(BwtFS::System::initBwtFS(path));
+    std::vector<std::byte> old_auth;
+    {
+        auto file = BwtFS::System::File::open(path);
+        old_auth = file->read((unsigned long long)(block_count_of(file) - 1) * BwtFS::BLOCK_SIZE).read(0, AUTH_SIZE);
+        file->close();
+    }
+    {
+        auto fs = BwtFS::System::openBwtFS(path);
+        ASSERT_NE(fs, nullptr);
+        fs->grow(96*BwtFS::MB);
+    }
+    unsigned count;
+    std::vector<std::byte> new_auth;
+    {
+        // 扩容在重写超级块之后中断：新的认证块只在预留块中，最后一个块中还是原来的认证块
+        auto file = BwtFS::System::File::open(path);
+        count = block_count_of(file);
+        new_auth = file->read((unsigned long long)(count - 1) * BwtFS::BLOCK_SIZE).read(0, AUTH_SIZE);
+        file->write((unsigned long long)(count - 2) * BwtFS::BLOCK_SIZE, BwtFS::Node::Binary(new_auth));
+        file->write((unsigned long long)(count - 1) * BwtFS::BLOCK_SIZE, BwtFS::Node::Binary(old_auth));
+        file->sync();
+        file->close();
+    }
+    {
+        auto fs = BwtFS::System::openBwtFS(path);
+        ASSERT_NE(fs, nullptr);
+        EXPECT_TRUE(fs->check());
+        EXPECT_EQ(fs->getBlockCount(), count);
+    }
+    {
+        // 打开时已恢复到最后一个块
+        auto file = BwtFS::System::File::open(path);
+        auto auth = file->read((unsigned long long)(count - 1) * BwtFS::BLOCK_SIZE).read(0, AUTH_SIZE);
+        EXPECT_EQ(auth, new_auth);
+        file->close();
+    }
+    std::filesystem::remove(path);
+}
+
+TEST(SystemTest, CreateStripedMinimumSize){
+    auto manifest = test_volume("bwtfs_stripe_min_test.bwts");
+    std::vector<std::string> members = {test_volume("bwtfs_stripe_min_0.bwt"), test_volume("bwtfs_stripe_min_1.bwt")};
+    std::filesystem::remove(manifest);
+    for (const auto& member : members){
+        std::filesystem::remove(member);
+    }
+    // 最小大小按整个卷计算，每个成员只有一半
+    EXPECT_THROW(BwtFS::System::StripedFile::create(manifest, members, 32*BwtFS::MB), std::runtime_error);
+    BwtFS::System::StripedFile::create(manifest, members, 64*BwtFS::MB);
+    {
+        BwtFS::System::StripedFile file(manifest);
+        EXPECT_EQ(file.getFileSize() - sizeof(unsigned), 64*BwtFS::MB);
+        file.close();
+    }
+    ASSERT_TRUE(BwtFS::System::initBwtFS(manifest));
+    {
+        auto fs = BwtFS::System::openBwtFS(manifest);
+        ASSERT_NE(fs, nullptr);
+        EXPECT_TRUE(fs->check());
+    }
+    std::filesystem::remove(manifest);
+    for (const auto& member : members){
+        std::filesystem::remove(member);
+    }
+}
+
+TEST(SystemTest, CreateStripedCleanupOnFailure){
+    auto manifest = test_volume("bwtfs_stripe_fail_test.bwts");
+    std::vector<std::string> members = {test_volume("bwtfs_stripe_fail_0.bwt"), test_volume("bwtfs_stripe_fail_1.bwt")};
+    std::filesystem::remove(manifest);
+    std::filesystem::remove(members[0]);
+    // 第二个成员已经存在，创建失败，只删除本次创建的第一个成员
+    std::ofstream(members[1]) << "existing";
+    EXPECT_THROW(BwtFS::System::StripedFile::create(manifest, members, 64*BwtFS::MB), std::runtime_error);
+    EXPECT_FALSE(std::filesystem::exists(members[0]));
+    EXPECT_TRUE(std::filesystem::exists(members[1]));
+    EXPECT_FALSE(std::filesystem::exists(manifest));
+    std::filesystem::remove(members[1]);
+}
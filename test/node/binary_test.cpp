@@ -1,5 +1,7 @@
 #include "node/binary.h"
 #include "gtest/gtest.h"
+#include <cstring>
+#include <vector>
 
 TEST(BinaryTest, CreateBinary) {
     BwtFS::Node::Binary binary(8);
@@ -117,4 +119,86 @@ TEST(BinaryTest, OperatorMove){
         binary2("hehe world!", BwtFS::Node::StringType::ASCII);
     binary << binary1 << binary2;
     EXPECT_EQ(binary.to_ascll_string(), "hello world!hehe world!");
-}
\ No newline at end of file
+}
+
+TEST(BinaryTest, ViewOutlivesBinary){
+    // 视图持有底层数组，原Binary析构后仍可访问
+    BwtFS::Node::BinaryView view;
+    BwtFS::Node::BinaryView part;
+    {
+        BwtFS::Node::Binary binary("hello world!", BwtFS::Node::StringType::ASCII);
+        view = binary.view();
+        part = binary.slice(6, 100);
+    }
+    ASSERT_EQ(view.size(), 12u);
+    EXPECT_EQ(view.to_binary().to_ascll_string(), "hello world!");
+    // 越界部分截断
+    ASSERT_EQ(part.size(), 6u);
+    EXPECT_EQ(part.to_binary().to_ascll_string(), "world!");
+    // 子视图同样持有底层数组
+    BwtFS::Node::BinaryView sub;
+    {
+        BwtFS::Node::Binary binary("0123456789", BwtFS::Node::StringType::ASCII);
+        sub = binary.slice(2, 6).slice(1, 3);
+    }
+    EXPECT_EQ(sub.to_binary().to_ascll_string(), "345");
+    EXPECT_TRUE(BwtFS::Node::Binary("abc", BwtFS::Node::StringType::ASCII).slice(3, 1).empty());
+}
+
+TEST(BinaryTest, ViewAfterMoveAndAssign){
+    BwtFS::Node::Binary binary("hello world!", BwtFS::Node::StringType::ASCII);
+    auto view = binary.slice(0, 5);
+    // 移动Binary不重新分配底层数组
+    BwtFS::Node::Binary moved(std::move(binary));
+    EXPECT_EQ(view.data(), moved.view().data());
+    // 原位修改通过视图可见
+    moved.set(0, std::byte('j'));
+    EXPECT_EQ(view.to_binary().to_ascll_string(), "jello");
+    // Binary指向新的数据后，视图仍是旧的数据
+    moved = BwtFS::Node::Binary("other", BwtFS::Node::StringType::ASCII);
+    EXPECT_EQ(view.to_binary().to_ascll_string(), "jello");
+    // to_binary是独立的拷贝
+    auto copy = view.to_binary();
+    copy.set(0, std::byte('h'));
+    EXPECT_EQ(view.get(0), std::byte('j'));
+    EXPECT_THROW(view.get(5), std::runtime_error);
+    EXPECT_THROW(view.load<uint32_t>(2), std::runtime_error);
+}
+
+TEST(BinaryTest, NonOwningView){
+    // 引用外部内存的视图不持有数据，直接反映外部内存的内容
+    std::vector<std::byte> buffer(16, std::byte(0));
+    BwtFS::Node::BinaryView view(buffer.data(), buffer.size());
+    auto part = view.slice(4, 8);
+    buffer[4] = std::byte(0x12);
+    buffer[5] = std::byte(0x34);
+    EXPECT_EQ(part.data(), buffer.data() + 4);
+    EXPECT_EQ(part.get(0), std::byte(0x12));
+    uint16_t expected;
+    std::memcpy(&expected, buffer.data() + 4, sizeof(expected));
+    EXPECT_EQ(part.load<uint16_t>(0), expected);
+    EXPECT_TRUE(BwtFS::Node::BinaryView(nullptr, 8).empty());
+}
+
+TEST(BinaryTest, AppendSelf){
+    // 追加指向自身的视图，扩容后仍拷贝原来的数据
+    BwtFS::Node::Binary binary("hello world!", BwtFS::Node::StringType::ASCII);
+    binary.append(binary.view());
+    EXPECT_EQ(binary.to_ascll_string(), "hello world!hello world!");
+    binary.append(binary.slice(6, 5));
+    EXPECT_EQ(binary.to_ascll_string(), "hello world!hello world!world");
+    // 多次追加使底层数组反复重新分配
+    BwtFS::Node::Binary grow("ab", BwtFS::Node::StringType::ASCII);
+    for (int i = 0; i < 10; i++){
+        grow.append(grow.view());
+    }
+    ASSERT_EQ(grow.size(), 2u << 10);
+    for (size_t i = 0; i < grow.size(); i++){
+        ASSERT_EQ(grow.get(i), std::byte(i % 2 == 0 ? 'a' : 'b')) << "byte " << i;
+    }
+    // 引用外部内存的视图照常追加
+    std::vector<std::byte> other = {std::byte('x'), std::byte('y')};
+    grow.clear();
+    grow.append(BwtFS::Node::BinaryView(other.data(), other.size()));
+    EXPECT_EQ(grow.to_ascll_string(), "xy");
+}
@@ -0,0 +1,155 @@
+#include "node/block_buffer.h"
+#include "config.h"
+#include "gtest/gtest.h"
+#include <cstring>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace{
+    // 用线程号和轮次填满缓冲区，检查期间没有被其他线程写入
+    void fill(BwtFS::Node::BlockBuffer& buffer, uint8_t tag){
+        std::memset(buffer.data(), tag, buffer.size());
+    }
+
+    bool check(const BwtFS::Node::BlockBuffer& buffer, uint8_t tag){
+        for (size_t i = 0; i < buffer.size(); i++){
+            if (buffer.data()[i] != std::byte(tag)){
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+TEST(BlockBufferTest, AppendAndMove){
+    BwtFS::Node::BlockBuffer buffer;
+    EXPECT_TRUE(buffer.empty());
+    EXPECT_EQ(buffer.data(), nullptr);
+    std::string text = "hello world!";
+    buffer.append(reinterpret_cast<const std::byte*>(text.data()), text.size());
+    ASSERT_NE(buffer.data(), nullptr);
+    // 按页对齐
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(buffer.data()) % BwtFS::BLOCK_SIZE, 0u);
+    EXPECT_EQ(buffer.to_binary().to_ascll_string(), text);
+    // 移动后原对象不再持有缓冲区
+    auto ptr = buffer.data();
+    BwtFS::Node::BlockBuffer moved(std::move(buffer));
+    EXPECT_EQ(moved.data(), ptr);
+    EXPECT_EQ(buffer.data(), nullptr);
+    EXPECT_TRUE(buffer.empty());
+    // 超过容量时抛出异常，内容不变
+    EXPECT_THROW(moved.extend(BwtFS::BLOCK_SIZE), std::runtime_error);
+    EXPECT_THROW(moved.resize(BwtFS::BLOCK_SIZE + 1), std::runtime_error);
+    EXPECT_EQ(moved.size(), text.size());
+    moved.resize(BwtFS::BLOCK_SIZE);
+    EXPECT_EQ(moved.view().size(), BwtFS::BLOCK_SIZE);
+    moved.clear();
+    EXPECT_TRUE(moved.empty());
+    EXPECT_EQ(moved.data(), ptr);
+}
+
+TEST(BlockBufferTest, ConcurrentAcquireRelease){
+    // 多个线程反复取出和归还，同时持有的缓冲区互不重叠
+    constexpr int THREADS = 8;
+    constexpr int ROUNDS = 200;
+    constexpr int HELD = 32;
+    std::vector<std::thread> threads;
+    std::vector<int> errors(THREADS, 0);
+    for (int t = 0; t < THREADS; t++){
+        threads.emplace_back([&, t]{
+            std::vector<BwtFS::Node::BlockBuffer> held;
+            for (int round = 0; round < ROUNDS; round++){
+                uint8_t tag = (uint8_t)(t * 31 + round);
+                for (int i = 0; i < HELD; i++){
+                    held.emplace_back(BwtFS::BLOCK_SIZE);
+                    fill(held.back(), tag);
+                }
+                std::this_thread::yield();
+                for (auto& buffer : held){
+                    if (!check(buffer, tag)){
+                        errors[t]++;
+                    }
+                }
+                // 交替释放一半和全部，让归还顺序与取出顺序不同
+                if (round % 2 == 0){
+                    for (int i = 0; i < HELD; i += 2){
+                        held[i] = BwtFS::Node::BlockBuffer();
+                    }
+                }
+                held.clear();
+            }
+        });
+    }
+    for (auto& thread : threads){
+        thread.join();
+    }
+    for (int t = 0; t < THREADS; t++){
+        EXPECT_EQ(errors[t], 0) << "thread " << t;
+    }
+    // 池的大小只取决于同时持有的峰值
+    EXPECT_LE(BwtFS::Node::BlockPool::getInstance().capacity(), 16384u);
+}
+
+TEST(BlockBufferTest, PoolUnique){
+    auto& pool = BwtFS::Node::BlockPool::getInstance();
+    // 同时取出的编号和地址都不重复，归还后可以再次取出
+    std::vector<uint32_t> ids;
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    for (int t = 0; t < 4; t++){
+        threads.emplace_back([&]{
+            std::vector<uint32_t> mine;
+            for (int i = 0; i < 300; i++){
+                mine.push_back(pool.acquire());
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            ids.insert(ids.end(), mine.begin(), mine.end());
+        });
+    }
+    for (auto& thread : threads){
+        thread.join();
+    }
+    std::set<uint32_t> unique_ids(ids.begin(), ids.end());
+    EXPECT_EQ(unique_ids.size(), ids.size());
+    EXPECT_FALSE(unique_ids.count(BwtFS::Node::BlockPool::NONE));
+    std::set<std::byte*> buffers;
+    for (auto id : ids){
+        buffers.insert(pool.buffer(id));
+    }
+    EXPECT_EQ(buffers.size(), ids.size());
+    auto capacity = pool.capacity();
+    EXPECT_GE(capacity, ids.size());
+    for (auto id : ids){
+        pool.release(id);
+    }
+    // 归还后再取出同样多的缓冲区不需要扩充
+    ids.clear();
+    for (int i = 0; i < 1200; i++){
+        ids.push_back(pool.acquire());
+    }
+    EXPECT_EQ(pool.capacity(), capacity);
+    for (auto id : ids){
+        pool.release(id);
+    }
+}
+
+TEST(BlockBufferTest, ExhaustedFallsBackToHeap){
+    auto& pool = BwtFS::Node::BlockPool::getInstance();
+    // 取出缓冲区直到池达到上限，之后的缓冲区从堆上分配
+    std::vector<BwtFS::Node::BlockBuffer> held;
+    while (pool.overflow() < 2 && held.size() < (1u << 16)){
+        held.emplace_back(BwtFS::BLOCK_SIZE);
+        fill(held.back(), (uint8_t)held.size());
+    }
+    ASSERT_EQ(pool.overflow(), 2u);
+    EXPECT_EQ(pool.capacity(), held.size() - 2);
+    EXPECT_TRUE(check(held.back(), (uint8_t)held.size()));
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(held.back().data()) % BwtFS::BLOCK_SIZE, 0u);
+    // 堆上的缓冲区用完即释放，池内的缓冲区可以再次取出
+    held.clear();
+    EXPECT_EQ(pool.overflow(), 0u);
+    BwtFS::Node::BlockBuffer again(BwtFS::BLOCK_SIZE);
+    EXPECT_EQ(pool.overflow(), 0u);
+}
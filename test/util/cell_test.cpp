@@ -1,5 +1,7 @@
 #include "gtest/gtest.h"
 #include "util/cell.h"
+#include <random>
+#include <vector>
 
 TEST(CellTest, XOR){
     std::byte b = std::byte{0b11010001};
@@ -60,4 +62,58 @@ TEST(CellTest, RCell){
     auto data1 = binary1.to_ascll_string();
     // std::cout << data1 << std::endl;
     EXPECT_EQ("Hello World!", data1);
-}
\ No newline at end of file
+}
+
+TEST(CellTest, TransformMatchesApply){
+    // 查表或SIMD实现与逐字节apply的结果一致，覆盖不足16、32字节的尾部
+    std::mt19937 generator(7);
+    for (size_t size : std::vector<size_t>{1, 3, 15, 16, 17, 31, 32, 33, 100, 4095, 4096, 5000}){
+        std::vector<std::byte> data(size);
+        std::vector<short> operations(size);
+        std::vector<uint8_t> rule((size + 3) / 4, 0);
+        for (size_t i = 0; i < size; i++){
+            data[i] = std::byte(generator());
+            operations[i] = generator() % 4;
+            rule[i / 4] |= operations[i] << (2 * (i % 4));
+        }
+        auto expected = data;
+        for (size_t i = 0; i < size; i++){
+            BwtFS::Util::RCA::apply(expected[i], operations[i], true);
+        }
+        auto actual = data;
+        BwtFS::Util::RCA::transform(actual.data(), rule.data(), size, true);
+        EXPECT_EQ(actual, expected) << "size " << size << (BwtFS::Util::RCA::simd() ? " (simd)" : "");
+        BwtFS::Util::RCA::transform(actual.data(), rule.data(), size, false);
+        EXPECT_EQ(actual, data) << "size " << size;
+    }
+}
+
+TEST(CellTest, FusedLevelsMatchSequential){
+    // 多层一遍完成的结果与逐层forward一致，backwardLevels为其逆
+    std::mt19937 generator(11);
+    for (size_t size : std::vector<size_t>{1, 17, 33, 4096}){
+        for (size_t levels : std::vector<size_t>{1, 2, 5}){
+            std::vector<uint16_t> seeds(levels);
+            for (auto& seed : seeds){
+                seed = generator() % 32769;
+            }
+            std::vector<std::byte> data(size);
+            for (auto& b : data){
+                b = std::byte(generator());
+            }
+            BwtFS::Node::Binary sequential(data);
+            for (auto seed : seeds){
+                BwtFS::Util::RCA cell(seed, sequential);
+                cell.forward();
+            }
+            BwtFS::Node::Binary fused(data);
+            BwtFS::Util::RCA::forwardLevels(fused, seeds);
+            EXPECT_TRUE(fused == sequential) << "size " << size << " levels " << levels;
+            auto raw = data;
+            BwtFS::Util::RCA::forwardLevels(std::span<std::byte>(raw), seeds);
+            EXPECT_TRUE(BwtFS::Node::Binary(raw) == sequential) << "size " << size << " levels " << levels;
+            BwtFS::Util::RCA::backwardLevels(fused, seeds);
+            EXPECT_TRUE(fused == BwtFS::Node::Binary(data)) << "size " << size << " levels " << levels;
+        }
+    }
+}
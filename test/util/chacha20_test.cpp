@@ -0,0 +1,74 @@
+#include "util/chacha20.h"
+#include "gtest/gtest.h"
+#include <string>
+#include <vector>
+
+namespace{
+    BwtFS::Util::ChaCha20Key test_key(){
+        BwtFS::Util::ChaCha20Key key;
+        for (size_t i = 0; i < key.size(); i++){
+            key[i] = (uint8_t)i;
+        }
+        return key;
+    }
+
+    std::vector<std::byte> test_data(size_t size){
+        std::vector<std::byte> data(size);
+        for (size_t i = 0; i < size; i++){
+            data[i] = std::byte(i * 131 + 7);
+        }
+        return data;
+    }
+}
+
+TEST(ChaCha20Test, Rfc8439Vector){
+    // RFC 8439 2.4.2 中的测试向量
+    std::string plaintext = "Ladies and Gentlemen of the class of '99: If I could offer you only one tip "
+                            "for the future, sunscreen would be it.";
+    const uint8_t expected[] = {
+        0x6e, 0x2e, 0x35, 0x9a, 0x25, 0x68, 0xf9, 0x80, 0x41, 0xba, 0x07, 0x28, 0xdd, 0x0d, 0x69, 0x81,
+        0xe9, 0x7e, 0x7a, 0xec, 0x1d, 0x43, 0x60, 0xc2, 0x0a, 0x27, 0xaf, 0xcc, 0xfd, 0x9f, 0xae, 0x0b,
+        0xf9, 0x1b, 0x65, 0xc5, 0x52, 0x47, 0x33, 0xab, 0x8f, 0x59, 0x3d, 0xab, 0xcd, 0x62, 0xb3, 0x57,
+        0x16, 0x39, 0xd6, 0x24, 0xe6, 0x51, 0x52, 0xab, 0x8f, 0x53, 0x0c, 0x35, 0x9f, 0x08, 0x61, 0xd8,
+        0x07, 0xca, 0x0d, 0xbf, 0x50, 0x0d, 0x6a, 0x61, 0x56, 0xa3, 0x8e, 0x08, 0x8a, 0x22, 0xb6, 0x5e,
+        0x52, 0xbc, 0x51, 0x4d, 0x16, 0xcc, 0xf8, 0x06, 0x81, 0x8c, 0xe9, 0x1a, 0xb7, 0x79, 0x37, 0x36,
+        0x5a, 0xf9, 0x0b, 0xbf, 0x74, 0xa3, 0x5b, 0xe6, 0xb4, 0x0b, 0x8e, 0xed, 0xf2, 0x78, 0x5e, 0x42,
+        0x87, 0x4d,
+    };
+    ASSERT_EQ(plaintext.size(), sizeof(expected));
+    BwtFS::Util::ChaCha20Nonce nonce = {0, 0, 0, 0, 0, 0, 0, 0x4a, 0, 0, 0, 0};
+    std::vector<std::byte> data(plaintext.size());
+    for (size_t i = 0; i < data.size(); i++){
+        data[i] = std::byte(plaintext[i]);
+    }
+    BwtFS::Util::chacha20(data.data(), data.size(), test_key(), nonce, 1);
+    for (size_t i = 0; i < data.size(); i++){
+        EXPECT_EQ((uint8_t)data[i], expected[i]) << "byte " << i;
+    }
+    // 再做一次得到明文
+    BwtFS::Util::chacha20(data.data(), data.size(), test_key(), nonce, 1);
+    for (size_t i = 0; i < data.size(); i++){
+        ASSERT_EQ((char)data[i], plaintext[i]) << "byte " << i;
+    }
+}
+
+TEST(ChaCha20Test, SplitMatchesWhole){
+    // 按64字节的块分段并递增计数，结果与一次计算一致，覆盖SIMD一次两个块和剩余单块的情况
+    BwtFS::Util::ChaCha20Nonce nonce = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12};
+    for (size_t size : std::vector<size_t>{1, 63, 64, 65, 127, 128, 129, 192, 1000, 4096}){
+        auto whole = test_data(size);
+        BwtFS::Util::chacha20(whole.data(), whole.size(), test_key(), nonce, 7);
+        for (size_t split = 64; split < size; split += 64){
+            auto parts = test_data(size);
+            BwtFS::Util::chacha20(parts.data(), split, test_key(), nonce, 7);
+            BwtFS::Util::chacha20(parts.data() + split, size - split, test_key(), nonce, 7 + (uint32_t)(split / 64));
+            ASSERT_EQ(parts, whole) << "size " << size << " split " << split;
+        }
+        // 不同的nonce得到不同的密文
+        auto other = test_data(size);
+        auto other_nonce = nonce;
+        other_nonce[8] ^= 1;
+        BwtFS::Util::chacha20(other.data(), other.size(), test_key(), other_nonce, 7);
+        EXPECT_NE(other, whole) << "size " << size;
+    }
+}
@@ -0,0 +1,54 @@
+#include "util/crc32c.h"
+#include "gtest/gtest.h"
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace{
+    uint32_t crc_of(const std::vector<std::byte>& data){
+        return BwtFS::Util::crc32c(data.data(), data.size());
+    }
+}
+
+TEST(Crc32cTest, CheckValue){
+    std::string check = "123456789";
+    EXPECT_EQ(BwtFS::Util::crc32c(reinterpret_cast<const std::byte*>(check.data()), check.size()), 0xE3069283u);
+    EXPECT_EQ(BwtFS::Util::crc32c(nullptr, 0), 0u);
+}
+
+TEST(Crc32cTest, Rfc3720Vectors){
+    // RFC 3720 B.4 中的测试向量
+    std::vector<std::byte> data(32, std::byte(0));
+    EXPECT_EQ(crc_of(data), 0x8A9136AAu);
+    data.assign(32, std::byte(0xFF));
+    EXPECT_EQ(crc_of(data), 0x62A8AB43u);
+    for (size_t i = 0; i < data.size(); i++){
+        data[i] = std::byte(i);
+    }
+    EXPECT_EQ(crc_of(data), 0x46DD794Eu);
+    for (size_t i = 0; i < data.size(); i++){
+        data[i] = std::byte(31 - i);
+    }
+    EXPECT_EQ(crc_of(data), 0x113FDB5Cu);
+}
+
+TEST(Crc32cTest, ChainedAndUnaligned){
+    // 分段计算与一次计算结果一致，覆盖不按8字节对齐的起始位置和长度
+    std::vector<std::byte> data(4096 + 16);
+    for (size_t i = 0; i < data.size(); i++){
+        data[i] = std::byte(i * 131 + 7);
+    }
+    for (size_t offset = 0; offset < 8; offset++){
+        for (size_t size : std::vector<size_t>{0, 1, 7, 8, 9, 63, 64, 65, 1000, 4096}){
+            auto whole = BwtFS::Util::crc32c(data.data() + offset, size);
+            for (size_t split : std::vector<size_t>{0, 1, 3, size / 2, size}){
+                if (split > size){
+                    continue;
+                }
+                auto head = BwtFS::Util::crc32c(data.data() + offset, split);
+                EXPECT_EQ(BwtFS::Util::crc32c(data.data() + offset + split, size - split, head), whole)
+                    << "offset " << offset << " size " << size << " split " << split;
+            }
+        }
+    }
+}
@@ -0,0 +1,72 @@
+#include "util/crypto_engine.h"
+#include "config.h"
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <vector>
+
+namespace{
+    BwtFS::Util::ChaCha20Key test_key(){
+        BwtFS::Util::ChaCha20Key key;
+        for (size_t i = 0; i < key.size(); i++){
+            key[i] = (uint8_t)(i * 7 + 1);
+        }
+        return key;
+    }
+
+    std::vector<std::byte> test_block(){
+        std::vector<std::byte> data(BwtFS::BLOCK_SIZE);
+        for (size_t i = 0; i < data.size(); i++){
+            data[i] = std::byte(i * 131 + 7);
+        }
+        return data;
+    }
+}
+
+TEST(CryptoEngineTest, ChaCha20NonceNotReused){
+    auto& crypto = BwtFS::Util::CryptoEngine::getInstance();
+    crypto.setCipher(BwtFS::Util::Cipher::CHACHA20, test_key());
+    EXPECT_EQ(crypto.trailerSize(), BwtFS::Util::CHACHA20_NONCE_TRAILER);
+    EXPECT_EQ(crypto.nodeDataSize(), BwtFS::BLOCK_SIZE - sizeof(uint8_t) - BwtFS::Util::CHACHA20_NONCE_TRAILER);
+    // 同一个块、同样的seed和level写入两次，nonce和密文都不同
+    auto plain = test_block();
+    auto first = plain;
+    auto second = plain;
+    std::vector<BwtFS::Util::CryptoJob> jobs{{first, 42, 1234, 1}, {second, 42, 1234, 1}};
+    crypto.encrypt(jobs);
+    size_t body = BwtFS::BLOCK_SIZE - BwtFS::Util::CHACHA20_NONCE_TRAILER;
+    EXPECT_FALSE(std::equal(first.begin() + body, first.end(), second.begin() + body));
+    EXPECT_FALSE(std::equal(first.begin(), first.begin() + body, second.begin()));
+    // 重新设置后计数重新随机选取，与之前的nonce也不同
+    auto third = plain;
+    crypto.setCipher(BwtFS::Util::Cipher::CHACHA20, test_key());
+    std::vector<BwtFS::Util::CryptoJob> again{{third, 42, 1234, 1}};
+    crypto.encrypt(again);
+    EXPECT_FALSE(std::equal(first.begin() + body, first.end(), third.begin() + body));
+    // 解密只依赖块末尾的nonce，不需要bitmap、seed和level
+    std::vector<BwtFS::Util::CryptoJob> back{{first, 0, 0, 0}, {second, 0, 0, 0}, {third, 0, 0, 0}};
+    crypto.decrypt(back);
+    EXPECT_TRUE(std::equal(plain.begin(), plain.begin() + body, first.begin()));
+    EXPECT_TRUE(std::equal(plain.begin(), plain.begin() + body, second.begin()));
+    EXPECT_TRUE(std::equal(plain.begin(), plain.begin() + body, third.begin()));
+    crypto.setCipher(BwtFS::Util::Cipher::RCA);
+    EXPECT_EQ(crypto.trailerSize(), 0u);
+}
+
+TEST(CryptoEngineTest, ChaCha20LegacyNonce){
+    // 版本4的卷：nonce由bitmap、seed和level生成，整个块加密，块末尾不保存nonce
+    auto& crypto = BwtFS::Util::CryptoEngine::getInstance();
+    crypto.setCipher(BwtFS::Util::Cipher::CHACHA20, test_key(), true);
+    EXPECT_EQ(crypto.trailerSize(), 0u);
+    EXPECT_EQ(crypto.nodeDataSize(), BwtFS::BLOCK_SIZE - sizeof(uint8_t));
+    auto plain = test_block();
+    auto first = plain;
+    auto second = plain;
+    std::vector<BwtFS::Util::CryptoJob> jobs{{first, 42, 1234, 1}, {second, 42, 1234, 1}};
+    crypto.encrypt(jobs);
+    EXPECT_EQ(first, second);
+    EXPECT_NE(first, plain);
+    std::vector<BwtFS::Util::CryptoJob> back{{first, 42, 1234, 1}};
+    crypto.decrypt(back);
+    EXPECT_EQ(first, plain);
+    crypto.setCipher(BwtFS::Util::Cipher::RCA);
+}